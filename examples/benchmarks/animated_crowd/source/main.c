@@ -0,0 +1,149 @@
+// SPDX-License-Identifier: CC0-1.0
+//
+// SPDX-FileContributor: Antonio Niño Díaz, 2008-2011, 2019, 2022
+//
+// This file is part of Nitro Engine
+
+// This example draws a crowd of animated models. All of them use the same
+// animation, but they are split in a few groups that are at different frames
+// of the animation. Models of the same group have the same pose, so the joint
+// matrices only need to be calculated once per group if the pose cache is
+// enabled. Models that are far from the camera can also use animation LOD: they
+// are drawn at the nearest frame and their pose isn't updated every frame.
+
+#include <NEMain.h>
+
+#include "robot_dsm_bin.h"
+#include "robot_walk_dsa_bin.h"
+#include "texture_tex_bin.h"
+
+#define NUM_ROWS    5
+#define NUM_COLUMNS 6
+#define NUM_MODELS  (NUM_ROWS * NUM_COLUMNS)
+#define NUM_GROUPS  3
+
+NE_Camera *Camera;
+NE_Model *Model[NUM_MODELS];
+NE_Animation *Animation;
+NE_Material *Texture;
+
+void SetAnimationLOD(bool enabled)
+{
+    for (int i = 0; i < NUM_MODELS; i++)
+    {
+        if (enabled)
+            NE_ModelAnimSetLOD(Model[i], 13, 15, 3);
+        else
+            NE_ModelAnimSetLOD(Model[i], 0, 0, 1);
+    }
+}
+
+void Draw3DScene(void)
+{
+    NE_PolyFormat(31, 0, NE_LIGHT_0, NE_CULL_BACK, 0);
+
+    NE_CameraUse(Camera);
+
+    for (int i = 0; i < NUM_MODELS; i++)
+        NE_ModelDraw(Model[i]);
+}
+
+int main(void)
+{
+    irqEnable(IRQ_HBLANK);
+    irqSet(IRQ_VBLANK, NE_VBLFunc);
+    irqSet(IRQ_HBLANK, NE_HBLFunc);
+
+    NE_Init3D();
+    NE_InitConsole();
+
+    Camera = NE_CameraCreate();
+    Animation = NE_AnimationCreate();
+    Texture = NE_MaterialCreate();
+
+    NE_AnimationLoad(Animation, robot_walk_dsa_bin);
+
+    NE_MaterialTexLoad(Texture, NE_A1RGB5, 256, 256, NE_TEXGEN_TEXCOORD,
+                       (void *)texture_tex_bin);
+
+    for (int i = 0; i < NUM_MODELS; i++)
+    {
+        Model[i] = NE_ModelCreate(NE_Animated);
+        NE_ModelLoadDSM(Model[i], robot_dsm_bin);
+        NE_ModelSetAnimation(Model[i], Animation);
+        NE_ModelSetMaterial(Model[i], Texture);
+        NE_ModelAnimStart(Model[i], NE_ANIM_LOOP, floattof32(0.1));
+
+        // Split the models in groups that play the animation at different
+        // frames
+        NE_ModelAnimSetFrame(Model[i], inttof32(i % NUM_GROUPS));
+
+        int x = i % NUM_COLUMNS;
+        int z = i / NUM_COLUMNS;
+        NE_ModelSetCoordI(Model[i], inttof32(x * 2 - NUM_COLUMNS + 1), 0,
+                          inttof32(z * 2 - NUM_ROWS + 1));
+    }
+
+    NE_CameraSet(Camera,
+                 0, 9, -12,
+                 0, 2, 0,
+                 0, 1, 0);
+
+    NE_LightSet(0, NE_White, -0.9, -0.5, 0);
+    NE_ClearColorSet(NE_Black, 31, 63);
+
+    bool cache_enabled = true;
+    bool anim_lod_enabled = false;
+
+    printf("\x1b[0;0H"
+           "A: Enable/disable pose cache\n"
+           "B: Enable/disable animation LOD\n");
+
+    while (1)
+    {
+        NE_WaitForVBL(NE_UPDATE_ANIMATIONS);
+
+        scanKeys();
+        uint32 keys = keysDown();
+
+        if (keys & KEY_A)
+        {
+            cache_enabled = !cache_enabled;
+            if (cache_enabled)
+                NE_ModelPoseCacheSetSize(NE_DEFAULT_POSE_CACHE_SIZE);
+            else
+                NE_ModelPoseCacheSetSize(0);
+        }
+
+        if (keys & KEY_B)
+        {
+            anim_lod_enabled = !anim_lod_enabled;
+            SetAnimationLOD(anim_lod_enabled);
+        }
+
+        // Measure the time it takes to draw the scene
+        cpuStartTiming(0);
+        NE_Process(Draw3DScene);
+        uint32_t ticks = cpuEndTiming();
+
+        int hits, misses;
+        NE_ModelPoseCacheGetStats(&hits, &misses);
+
+        NE_ModelAnimStats stats;
+        NE_ModelAnimGetStats(&stats);
+
+        printf("\x1b[16;0H"
+               "Pose cache: %s\n"
+               "Animation LOD: %s\n"
+               "Hits: %d  Misses: %d    \n"
+               "Joints evaluated: %d    \n"
+               "Draw time: %lu us      \n"
+               "CPU%%: %d  ",
+               cache_enabled ? "Enabled " : "Disabled",
+               anim_lod_enabled ? "Enabled " : "Disabled",
+               hits, misses, stats.joints_evaluated,
+               timerTicks2usec(ticks), NE_GetCPUPercent());
+    }
+
+    return 0;
+}
@@ -0,0 +1,165 @@
+// SPDX-License-Identifier: CC0-1.0
+//
+// SPDX-FileContributor: Antonio Niño Díaz, 2008-2011, 2019, 2022
+//
+// This file is part of Nitro Engine
+
+// This example drops many boxes on a floor, stacked in towers. It shows how
+// many pairs of objects are tested for collisions each frame and how long it
+// takes to update the physics engine, with and without the broadphase. Without
+// it, every box is tested against every other box. Boxes that stop moving go
+// to sleep, and they aren't updated until something wakes them up.
+
+#include <NEMain.h>
+
+#include "cube_bin.h"
+
+#define NUM_TOWERS_X    8
+#define NUM_TOWERS_Z    8
+#define TOWER_HEIGHT    4
+#define NUM_BOXES       (NUM_TOWERS_X * NUM_TOWERS_Z * TOWER_HEIGHT)
+#define NUM_OBJECTS     (NUM_BOXES + 1)
+
+NE_Camera *Camera;
+NE_Model *Model[NUM_OBJECTS];
+NE_Physics *Physics[NUM_OBJECTS];
+
+bool DebugDraw = false;
+
+void Draw3DScene(void)
+{
+    NE_CameraUse(Camera);
+
+    NE_PolyFormat(31, 0, NE_LIGHT_0, NE_CULL_BACK, 0);
+    for (int i = 0; i < NUM_BOXES; i++)
+        NE_ModelDraw(Model[i]);
+
+    NE_PolyFormat(31, 0, NE_LIGHT_1, NE_CULL_BACK, 0);
+    NE_ModelDraw(Model[NUM_BOXES]);
+
+    if (DebugDraw)
+        NE_PhysicsDebugDraw();
+}
+
+void ResetBoxes(void)
+{
+    for (int i = 0; i < NUM_BOXES; i++)
+    {
+        int tower = i / TOWER_HEIGHT;
+        int x = tower % NUM_TOWERS_X;
+        int z = tower / NUM_TOWERS_X;
+        int y = i % TOWER_HEIGHT;
+
+        NE_ModelSetCoordI(Model[i],
+                          inttof32(x * 2 - NUM_TOWERS_X + 1),
+                          inttof32(y * 2 + 2),
+                          inttof32(z * 2 - NUM_TOWERS_Z + 1));
+        NE_PhysicsSetSpeedI(Physics[i], 0, 0, 0);
+    }
+}
+
+int main(void)
+{
+    irqEnable(IRQ_HBLANK);
+    irqSet(IRQ_VBLANK, NE_VBLFunc);
+    irqSet(IRQ_HBLANK, NE_HBLFunc);
+
+    NE_Init3D();
+    NE_InitConsole();
+
+    NE_PhysicsSystemReset(NUM_OBJECTS);
+
+    Camera = NE_CameraCreate();
+    NE_CameraSet(Camera,
+                 -14, 12, -14,
+                   0, 2, 0,
+                   0, 1, 0);
+
+    // Create objects
+    for (int i = 0; i < NUM_OBJECTS; i++)
+    {
+        Model[i] = NE_ModelCreate(NE_Static);
+        Physics[i] = NE_PhysicsCreate(NE_BoundingBox);
+
+        NE_ModelLoadStaticMesh(Model[i], (u32 *)cube_bin);
+
+        NE_PhysicsSetModel(Physics[i], (void *)Model[i]);
+    }
+
+    for (int i = 0; i < NUM_BOXES; i++)
+    {
+        NE_PhysicsSetSize(Physics[i], 1, 1, 1);
+        NE_PhysicsSetGravity(Physics[i], 0.001);
+        NE_PhysicsOnCollision(Physics[i], NE_ColBounce);
+        NE_PhysicsSetBounceEnergy(Physics[i], 50);
+    }
+
+    // The floor is a big box that doesn't move
+    NE_ModelSetCoord(Model[NUM_BOXES], 0, 0, 0);
+    NE_ModelScale(Model[NUM_BOXES], NUM_TOWERS_X * 2, 1, NUM_TOWERS_Z * 2);
+    NE_PhysicsSetSize(Physics[NUM_BOXES],
+                      NUM_TOWERS_X * 2, 1, NUM_TOWERS_Z * 2);
+    NE_PhysicsSetBodyType(Physics[NUM_BOXES], NE_BodyStatic);
+
+    ResetBoxes();
+
+    // Lights
+    NE_LightSet(0, NE_Green, -1, -1, 0);
+    NE_LightSet(1, NE_Blue, -1, -1, 0);
+
+    // Background
+    NE_ClearColorSet(NE_Red, 31, 63);
+
+    bool broadphase = true;
+
+    printf("\x1b[0;0H"
+           "A: Enable/disable broadphase\n"
+           "B: Reset boxes\n"
+           "X: Show/hide bounding boxes\n"
+           "\n"
+           "Boxes: %d\n", NUM_BOXES);
+
+    while (1)
+    {
+        NE_WaitForVBL(0);
+
+        scanKeys();
+        uint32 keys = keysDown();
+
+        if (keys & KEY_A)
+        {
+            broadphase = !broadphase;
+            NE_PhysicsSetBroadphase(broadphase);
+        }
+
+        if (keys & KEY_B)
+            ResetBoxes();
+
+        if (keys & KEY_X)
+            DebugDraw = !DebugDraw;
+
+        // Measure the time it takes to update the physics engine
+        cpuStartTiming(0);
+        NE_PhysicsUpdateAll();
+        uint32_t ticks = cpuEndTiming();
+
+        NE_PhysicsStats stats;
+        NE_PhysicsGetStats(&stats);
+
+        printf("\x1b[16;0H"
+               "Broadphase: %s\n"
+               "Awake boxes: %d    \n"
+               "Pair tests: %d      \n"
+               "Contacts: %d      \n"
+               "Update time: %lu us      \n"
+               "CPU%%: %d  ",
+               broadphase ? "Enabled " : "Disabled",
+               NE_PhysicsGetAwakeCount(), stats.pair_tests,
+               NE_PhysicsGetContactCount(),
+               timerTicks2usec(ticks), NE_GetCPUPercent());
+
+        NE_Process(Draw3DScene);
+    }
+
+    return 0;
+}
@@ -8,39 +8,82 @@
 
 #include "texture_tex_bin.h"
 
+// The quad is split in GRID_SIZE x GRID_SIZE smaller quads so that the cost of
+// sending the vertices one by one is easy to see in the CPU meter.
+#define GRID_SIZE 16
+
 NE_Camera *Camera;
 NE_Material *Material;
+void *DisplayList;
+bool UseDisplayList = true;
 
-void Draw3DScene(void)
+// Interpolate the colors of the corners of the quad
+u32 GetColor(int x, int y)
 {
-    NE_CameraUse(Camera);
+    // Top left: red, bottom left: blue, bottom right: green, top right: yellow
+    const int corners[4][3] = {
+        { 31, 0, 0 }, { 0, 0, 31 }, { 0, 31, 0 }, { 31, 31, 0 }
+    };
 
-    // This set material's color to drawing color (default = white)
-    NE_MaterialUse(Material);
+    int c[3];
+    for (int i = 0; i < 3; i++)
+    {
+        int left = (corners[0][i] * (GRID_SIZE - y) + corners[1][i] * y);
+        int right = (corners[3][i] * (GRID_SIZE - y) + corners[2][i] * y);
+        c[i] = (left * (GRID_SIZE - x) + right * x) / (GRID_SIZE * GRID_SIZE);
+    }
+
+    return RGB15(c[0], c[1], c[2]);
+}
 
+void SendVertex(int x, int y)
+{
+    // Set next vertex color
+    NE_PolyColor(GetColor(x, y));
+
+    // Texture coordinates
+    NE_PolyTexCoord((64 * x) / GRID_SIZE, (64 * y) / GRID_SIZE);
+
+    // Send new vertex
+    NE_PolyVertexI(inttov16(-1) + (inttov16(2) * x) / GRID_SIZE,
+                   inttov16(1) - (inttov16(2) * y) / GRID_SIZE,
+                   0);
+}
+
+void DrawQuad(void)
+{
     // In general you should avoid using the functions below
 
     // Begin drawing
     NE_PolyBegin(GL_QUAD);
 
-        NE_PolyColor(NE_Red);    // Set next vertices color
-        NE_PolyTexCoord(0, 0);   // Texture coordinates
-        NE_PolyVertex(-1, 1, 0); // Send new vertex
+    for (int y = 0; y < GRID_SIZE; y++)
+    {
+        for (int x = 0; x < GRID_SIZE; x++)
+        {
+            SendVertex(x, y);
+            SendVertex(x, y + 1);
+            SendVertex(x + 1, y + 1);
+            SendVertex(x + 1, y);
+        }
+    }
 
-        NE_PolyColor(NE_Blue);
-        NE_PolyTexCoord(0, 64);
-        NE_PolyVertex(-1, -1, 0);
+    // Apparently this command is ignored by the GPU
+    NE_PolyEnd();
+}
 
-        NE_PolyColor(NE_Green);
-        NE_PolyTexCoord(64, 64);
-        NE_PolyVertex(1, -1, 0);
+void Draw3DScene(void)
+{
+    NE_CameraUse(Camera);
 
-        NE_PolyColor(NE_Yellow);
-        NE_PolyTexCoord(64, 0);
-        NE_PolyVertex(1, 1, 0);
+    // This set material's color to drawing color (default = white). Materials
+    // aren't recorded in display lists, they have to be set before drawing it.
+    NE_MaterialUse(Material);
 
-    // Apparently this command is ignored by the GPU
-    NE_PolyEnd();
+    if (UseDisplayList)
+        NE_DisplayListDraw(DisplayList); // Send the recorded commands by DMA
+    else
+        DrawQuad(); // Send all commands with the CPU
 }
 
 int main(void)
@@ -50,6 +93,10 @@ int main(void)
     irqSet(IRQ_HBLANK, NE_HBLFunc);
 
     NE_Init3D();
+    // libnds uses VRAM_C for the text console, reserve A and B only
+    NE_TextureSystemReset(0, 0, NE_VRAM_AB);
+    // Init console in non-3D screen
+    consoleDemoInit();
 
     Camera = NE_CameraCreate();
     Material = NE_MaterialCreate();
@@ -62,10 +109,28 @@ int main(void)
     NE_MaterialTexLoad(Material, NE_A1RGB5, 128, 128, NE_TEXGEN_TEXCOORD,
                        (u8 *)texture_tex_bin);
 
+    // Record the polygon in a display list. The commands aren't sent to the
+    // GPU, they are saved in RAM so that they can be sent later.
+    NE_DisplayListBegin();
+    DrawQuad();
+    DisplayList = NE_DisplayListEnd();
+    if (DisplayList == NULL)
+        UseDisplayList = false;
+
+    printf("A: Switch drawing mode");
+
     while (1)
     {
         NE_WaitForVBL(0);
 
+        scanKeys();
+        if ((keysDown() & KEY_A) && (DisplayList != NULL))
+            UseDisplayList = !UseDisplayList;
+
+        printf("\x1b[2;0HMode: %s",
+               UseDisplayList ? "Display list  " : "Immediate mode");
+        printf("\x1b[3;0HCPU: %d%%  ", NE_GetCPUPercent());
+
         NE_Process(Draw3DScene);
     }
 
@@ -0,0 +1,28 @@
+#!/bin/sh
+
+NITRO_ENGINE=$DEVKITPRO/nitro-engine
+ASSETS=$NITRO_ENGINE/examples/assets
+TOOLS=$NITRO_ENGINE/tools
+OBJ2DL=$TOOLS/obj2dl/obj2dl.py
+OBJ2COL=$TOOLS/obj2col/obj2col.py
+
+mkdir -p data
+
+python3 $OBJ2DL \
+    --input $ASSETS/cube.obj \
+    --output data/cube.bin \
+    --texture 32 32
+
+python3 $OBJ2DL \
+    --input $ASSETS/sphere.obj \
+    --output data/sphere.bin \
+    --texture 32 32
+
+python3 $OBJ2DL \
+    --input $ASSETS/level.obj \
+    --output data/level.bin \
+    --texture 32 32
+
+python3 $OBJ2COL \
+    --input $ASSETS/level.obj \
+    --output data/level_col.bin
@@ -0,0 +1,145 @@
+// SPDX-License-Identifier: CC0-1.0
+//
+// SPDX-FileContributor: Antonio Niño Díaz, 2023
+//
+// This file is part of Nitro Engine
+
+// This example drops boxes and balls on a level. The level is one physics
+// object: a collision mesh created with obj2col from the same OBJ file as the
+// model of the level. Objects collide with the triangles of the mesh, so they
+// roll down the ramp and stop against the walls.
+
+#include <NEMain.h>
+
+#include "cube_bin.h"
+#include "level_bin.h"
+#include "level_col_bin.h"
+#include "sphere_bin.h"
+
+#define NUM_BOXES       8
+#define NUM_BALLS       8
+#define NUM_OBJECTS     (NUM_BOXES + NUM_BALLS)
+
+NE_Camera *Camera;
+NE_Model *Level;
+NE_Physics *LevelPhysics;
+NE_Model *Model[NUM_OBJECTS];
+NE_Physics *Physics[NUM_OBJECTS];
+
+bool DebugDraw = false;
+
+void Draw3DScene(void)
+{
+    NE_CameraUse(Camera);
+
+    NE_PolyFormat(31, 0, NE_LIGHT_0, NE_CULL_BACK, 0);
+    NE_ModelDraw(Level);
+
+    NE_PolyFormat(31, 0, NE_LIGHT_1, NE_CULL_BACK, 0);
+    for (int i = 0; i < NUM_OBJECTS; i++)
+        NE_ModelDraw(Model[i]);
+
+    if (DebugDraw)
+        NE_PhysicsDebugDraw();
+}
+
+void ResetObjects(void)
+{
+    for (int i = 0; i < NUM_OBJECTS; i++)
+    {
+        // Half of the objects fall on the ramp, the rest on the floor
+        int x = (i & 1) ? -4 : (i % 4) - 1;
+        int z = (i >> 1) % 4 - 2;
+
+        NE_ModelSetCoordI(Model[i], inttof32(x), inttof32(5 + i),
+                          inttof32(z));
+        NE_PhysicsSetSpeedI(Physics[i], 0, 0, 0);
+    }
+}
+
+int main(void)
+{
+    irqEnable(IRQ_HBLANK);
+    irqSet(IRQ_VBLANK, NE_VBLFunc);
+    irqSet(IRQ_HBLANK, NE_HBLFunc);
+
+    NE_Init3D();
+    NE_InitConsole();
+
+    NE_PhysicsSystemReset(NUM_OBJECTS + 1);
+
+    Camera = NE_CameraCreate();
+    NE_CameraSet(Camera,
+                 8, 9, 8,
+                 0, 0, 0,
+                 0, 1, 0);
+
+    // The level is drawn with its model and collides with its collision mesh
+    Level = NE_ModelCreate(NE_Static);
+    NE_ModelLoadStaticMesh(Level, (u32 *)level_bin);
+
+    LevelPhysics = NE_PhysicsCreate(NE_CollisionMesh);
+    NE_PhysicsSetModel(LevelPhysics, Level);
+    NE_PhysicsSetMesh(LevelPhysics, level_col_bin);
+
+    for (int i = 0; i < NUM_OBJECTS; i++)
+    {
+        Model[i] = NE_ModelCreate(NE_Static);
+
+        if (i < NUM_BOXES)
+        {
+            NE_ModelLoadStaticMesh(Model[i], (u32 *)cube_bin);
+            Physics[i] = NE_PhysicsCreate(NE_BoundingBox);
+            NE_PhysicsSetSize(Physics[i], 1, 1, 1);
+        }
+        else
+        {
+            NE_ModelLoadStaticMesh(Model[i], (u32 *)sphere_bin);
+            Physics[i] = NE_PhysicsCreate(NE_BoundingSphere);
+            NE_PhysicsSetRadius(Physics[i], 0.45);
+        }
+
+        NE_PhysicsSetModel(Physics[i], Model[i]);
+        NE_PhysicsSetGravity(Physics[i], 0.005);
+        NE_PhysicsOnCollision(Physics[i], NE_ColBounce);
+        NE_PhysicsSetBounceEnergy(Physics[i], 30);
+    }
+
+    ResetObjects();
+
+    // Lights
+    NE_LightSet(0, NE_White, -1, -1, -1);
+    NE_LightSet(1, NE_Yellow, -1, -1, 0);
+
+    // Background
+    NE_ClearColorSet(NE_DarkBlue, 31, 63);
+
+    printf("\x1b[0;0H"
+           "A: Reset objects\n"
+           "X: Show/hide collision shapes\n");
+
+    while (1)
+    {
+        NE_WaitForVBL(NE_UPDATE_PHYSICS);
+
+        scanKeys();
+        uint32 keys = keysDown();
+
+        if (keys & KEY_A)
+            ResetObjects();
+
+        if (keys & KEY_X)
+            DebugDraw = !DebugDraw;
+
+        printf("\x1b[20;0H"
+               "Contacts: %d    \n"
+               "Awake objects: %d    \n"
+               "CPU%%: %d  ",
+               NE_PhysicsGetContactCount(), NE_PhysicsGetAwakeCount(),
+               NE_GetCPUPercent());
+
+        NE_Process(Draw3DScene);
+    }
+
+    return 0;
+}
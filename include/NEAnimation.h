@@ -36,6 +36,12 @@ void NE_AnimationDelete(NE_Animation *animation);
 
 /// Loads a DSA file in RAM to an animation object.
 ///
+/// DSA files with quaternions (version 1), with baked joint matrices (version
+/// 2, generated by md5_to_dsma with --baked-matrices) and compressed (version 3,
+/// generated by md5_to_dsma with --compress) are supported. Baked matrices use
+/// more memory, but they need less CPU time to be drawn. Compressed files use
+/// less memory, but they need more CPU time to be drawn.
+///
 /// @param animation Pointer to the animation.
 /// @param pointer Pointer to the file.
 /// @return It returns 1 on success.
@@ -61,6 +67,18 @@ int NE_AnimationSystemReset(int max_animations);
 /// Ends animation system and all memory used by it.
 void NE_AnimationSystemEnd(void);
 
+/// Enables or disables normalization of interpolated quaternions.
+///
+/// When a model is drawn between two frames of an animation, or blending two
+/// animations, the orientations of the joints are interpolated linearly. The
+/// result isn't normalized by default, which makes the limbs of the model
+/// shrink a bit when the two orientations are very different. Normalizing them
+/// fixes it, but it needs more CPU time. It doesn't affect animations with
+/// baked joint matrices. It is disabled by default.
+///
+/// @param enabled True to enable normalization, false to disable it.
+void NE_AnimationSetQuaternionNormalization(bool enabled);
+
 /// @}
 
 #endif // NE_ANIMATION_H__
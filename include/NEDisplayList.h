@@ -0,0 +1,142 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright (c) 2008-2011, 2019, 2022 Antonio Niño Díaz
+//
+// This file is part of Nitro Engine
+
+#ifndef NE_DISPLAYLIST_H__
+#define NE_DISPLAYLIST_H__
+
+#include <nds.h>
+
+/// @file   NEDisplayList.h
+/// @brief  Functions to record and inspect display lists.
+
+/// @defgroup display_list Display lists
+///
+/// Functions to record geometry drawn with the polygon functions (like
+/// NE_PolyBegin() or NE_PolyVertex()) into a display list in RAM.
+///
+/// Geometry drawn with the polygon functions is sent to the GPU one command at
+/// a time by the CPU every frame, even if it never changes. A recorded display
+/// list can be sent by DMA with NE_DisplayListDraw(), or it can be used as the
+/// mesh of a static model with NE_ModelLoadStaticMesh().
+///
+/// The display lists use the same format as the ones generated by the tools of
+/// Nitro Engine: the first word is the size of the list in words, and the rest
+/// of the list is made of packed GX FIFO commands.
+///
+/// @{
+
+/// Starts recording a display list.
+///
+/// While a display list is being recorded, NE_PolyBegin(), NE_PolyEnd(),
+/// NE_PolyColor(), NE_PolyNormal(), NE_PolyTexCoord(), NE_PolyVertex() and
+/// NE_PolyFormat() don't send their commands to the GPU, they add them to the
+/// display list instead. Other functions, like NE_MaterialUse(), are not
+/// recorded.
+///
+/// @return Returns 1 on success, 0 on error.
+int NE_DisplayListBegin(void);
+
+/// Stops recording a display list and returns it.
+///
+/// @return Returns a pointer to the display list, that has to be freed with
+///         free() when it isn't needed anymore. On error, it returns NULL.
+void *NE_DisplayListEnd(void);
+
+/// Adds a GX command to the display list that is being recorded.
+///
+/// This can be used to record commands that don't have a function in Nitro
+/// Engine (like matrix commands).
+///
+/// @param id Command ID (FIFO_COLOR, FIFO_BEGIN, etc).
+/// @param params Pointer to the parameters of the command.
+/// @param num_params Number of parameters.
+void NE_DisplayListAddCommand(u32 id, const u32 *params, int num_params);
+
+/// Adds a vertex to the display list that is being recorded.
+///
+/// The smallest command that can represent the vertex exactly is used. If one
+/// of the coordinates is the same as in the previous vertex, VTX_XY, VTX_XZ or
+/// VTX_YZ is used. If the vertex is close to the previous one and the
+/// difference can be represented exactly (VTX_DIFF uses units of 1/512),
+/// VTX_DIFF is used. If not, VTX_10 or VTX_16 are used depending on the
+/// precision needed.
+///
+/// NE_PolyVertex() uses this function while a display list is recorded.
+///
+/// @param x (x, y, z) Vertex coordinates (v16).
+/// @param y (x, y, z) Vertex coordinates (v16).
+/// @param z (x, y, z) Vertex coordinates (v16).
+void NE_DisplayListAddVertexI(int x, int y, int z);
+
+/// Returns true if a display list is being recorded.
+///
+/// @return True if NE_DisplayListBegin() has been called, but not
+///         NE_DisplayListEnd().
+bool NE_DisplayListIsRecording(void);
+
+/// Sends a display list to the GPU.
+///
+/// @param list Pointer to the display list.
+void NE_DisplayListDraw(const void *list);
+
+/// Returns the size of a display list in bytes.
+///
+/// @param list Pointer to the display list.
+/// @return Size in bytes.
+size_t NE_DisplayListGetSize(const void *list);
+
+/// Counts the polygons and vertices sent to the GPU by a display list.
+///
+/// The values don't take culling or clipping into account, so they are an
+/// upper bound of the polygons and vertices that the list really uses.
+///
+/// @param list Pointer to the display list.
+/// @param polygons Pointer to store the number of polygons.
+/// @param vertices Pointer to store the number of vertices.
+/// @return Returns 1 on success, 0 if the list has invalid commands.
+int NE_DisplayListGetCounts(const void *list, int *polygons, int *vertices);
+
+/// Display list placed in the world, used by NE_DisplayListMerge().
+///
+/// The transformation is applied in the same order as in NE_ModelDraw().
+typedef struct {
+    const void *list; ///< Display list (it can't have matrix commands)
+    int x;            ///< X position (f32)
+    int y;            ///< Y position (f32)
+    int z;            ///< Z position (f32)
+    int rx;           ///< Rotation by X axis (0 - 511)
+    int ry;           ///< Rotation by Y axis (0 - 511)
+    int rz;           ///< Rotation by Z axis (0 - 511)
+    int sx;           ///< X scale (f32)
+    int sy;           ///< Y scale (f32)
+    int sz;           ///< Z scale (f32)
+} NE_DisplayListInstance;
+
+/// Merges several display lists into one, baking their transformations.
+///
+/// The vertices of each list are transformed by the position, rotation and
+/// scale of its instance, and normals are rotated. All other commands (like
+/// colors or texture coordinates) are copied as they are. Lists with matrix
+/// commands (like the ones used by animated models) can't be merged.
+///
+/// The transformed vertices are centered and divided by a power of two so that
+/// they fit in the range of v16 values. They are sent with the smallest vertex
+/// command that can represent them (see NE_DisplayListAddVertexI()). The list
+/// has to be drawn with the returned position and scale to look like the
+/// original instances.
+///
+/// @param instances Array of instances.
+/// @param num_instances Number of instances.
+/// @param position Array of 3 values to store the position of the list (f32).
+/// @param scale Pointer to store the scale of the list (f32).
+/// @return Returns a pointer to the new display list, that has to be freed
+///         with free() when it isn't needed anymore. On error, it returns NULL.
+void *NE_DisplayListMerge(const NE_DisplayListInstance *instances,
+                          int num_instances, int32_t *position, int32_t *scale);
+
+/// @}
+
+#endif // NE_DISPLAYLIST_H__
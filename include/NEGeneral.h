@@ -199,7 +199,9 @@ typedef enum {
     NE_UPDATE_GUI = BIT(0),
     /// Update all animated models.
     NE_UPDATE_ANIMATIONS = BIT(1),
-    /// Updates the physics engine.
+    /// Updates the physics engine. If it has a fixed timestep, it is updated
+    /// according to the number of frames since the last update (check
+    /// NE_PhysicsAdvanceI()).
     NE_UPDATE_PHYSICS = BIT(2),
     /// Allows Nitro Engine to skip the wait to the vertical blank if CPU load
     /// is greater than 100%. You can use this if you don't need to load
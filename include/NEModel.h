@@ -21,6 +21,15 @@
 
 #define NE_DEFAULT_MODELS   512 ///< Default max number of models
 
+#define NE_MODEL_MAX_LOD_LEVELS 4 ///< Max number of LOD levels of a model
+
+/// Default margin used to go back to a more detailed LOD level (f32).
+#define NE_MODEL_LOD_DEFAULT_HYSTERESIS (floattof32(0.25))
+
+/// Number of animations of a model: the main animation, the secondary
+/// animation, and the extra animation layers.
+#define NE_MODEL_MAX_ANIM_LAYERS 4
+
 /// Possible animation types.
 typedef enum {
     NE_ANIM_LOOP,    ///< When the end is reached it jumps to the start.
@@ -34,8 +43,84 @@ typedef struct {
     int32_t speed;           ///< Animation speed (f32).
     int32_t currframe;       ///< Current frame. It can be between frames (f32).
     int32_t numframes;       ///< Number of frames in the animation (int).
+    int32_t weight;          ///< Weight of an extra layer (f32).
+    bool additive;           ///< True if this is an additive extra layer.
 } NE_AnimInfo;
 
+/// Holds the level of detail (LOD) information of a model.
+///
+/// Level 0 is the mesh loaded with the regular functions (like
+/// NE_ModelLoadStaticMesh()). Levels 1 to NE_MODEL_MAX_LOD_LEVELS - 1 are
+/// meshes with less detail that are used when the model is far from the camera.
+typedef struct {
+    /// Index of the mesh of each level (level 0 isn't used)
+    int meshindex[NE_MODEL_MAX_LOD_LEVELS];
+    /// Distance from the camera where each level starts to be used (f32)
+    int32_t distance[NE_MODEL_MAX_LOD_LEVELS];
+    /// Margin used to go back to a more detailed level (f32)
+    int32_t hysteresis;
+    /// Level used the last time the model was drawn
+    int current;
+} NE_ModelLOD;
+
+/// Draw priorities used by the polygon budget of the model system.
+typedef enum {
+    NE_PRIORITY_HIGH = 0, ///< Always drawn, even if the budget is exceeded.
+    NE_PRIORITY_LOW       ///< Downgraded or skipped if the budget is exceeded.
+} NE_ModelPriority;
+
+/// Max number of rejected draws whose models are saved in the budget stats.
+#define NE_MODEL_BUDGET_MAX_REJECTED 16
+
+/// Polygon and vertex usage of a frame, as tracked by the budget.
+typedef struct {
+    int polygons;   ///< Projected number of polygons drawn
+    int vertices;   ///< Projected number of vertices drawn
+    int draws;      ///< Number of models drawn
+    int downgraded; ///< Draws that used a less detailed LOD level to fit
+    int rejected;   ///< Draws that were skipped because they didn't fit
+    /// First NE_MODEL_BUDGET_MAX_REJECTED models that were skipped
+    const void *rejected_models[NE_MODEL_BUDGET_MAX_REJECTED];
+} NE_ModelBudgetStats;
+
+/// Default number of poses kept by the pose cache of animated models.
+#define NE_DEFAULT_POSE_CACHE_SIZE 8
+
+/// Holds the animation level of detail information of an animated model.
+///
+/// Animated models that are far from the camera can be animated with less
+/// precision to save CPU time. The distances are the ones used for a model
+/// with scale 1.0. They are multiplied by the biggest scale of the model so
+/// that models that look bigger on the screen keep the full animation quality
+/// for longer.
+typedef struct {
+    /// Distance from which frames aren't interpolated (f32, 0 = disabled)
+    int32_t snap_distance;
+    /// Distance from which the pose isn't updated every frame (f32, 0 =
+    /// disabled)
+    int32_t update_distance;
+    /// Number of frames between pose updates when the update rate is reduced
+    int update_period;
+    /// Number of frames left until the saved pose is updated
+    int frames_left;
+    /// Offset used to spread the pose updates of models with the same period
+    /// across different frames
+    int phase;
+    /// Number of joints of the saved pose (0 if there isn't a saved pose)
+    int num_joints;
+    /// Size of the saved pose buffer in joints
+    int max_joints;
+    /// Pose used while the update rate is reduced (NULL if not allocated)
+    int32_t *matrices;
+} NE_ModelAnimLOD;
+
+/// Statistics of the animation of models.
+typedef struct {
+    int joints_evaluated; ///< Number of joint matrices that were calculated
+    int poses_reused;     ///< Draws that reused the pose of a previous frame
+    int frames_snapped;   ///< Draws that used the nearest frame
+} NE_ModelAnimStats;
+
 /// Possible model types.
 typedef enum {
     NE_Static,  ///< Not animated.
@@ -46,8 +131,14 @@ typedef enum {
 typedef struct {
     NE_ModelType modeltype;   ///< Model type (static or animated)
     int meshindex;            ///< Index of mesh (static or DSM)
-    NE_AnimInfo *animinfo[2]; ///< Animation information (two can be blended)
+    /// Animation information. Index 0 is the main animation, 1 is the
+    /// secondary animation, and the others are the extra animation layers.
+    NE_AnimInfo *animinfo[NE_MODEL_MAX_ANIM_LAYERS];
     int32_t anim_blend;       ///< Animation blend factor
+    NE_ModelLOD *lod;         ///< LOD information (NULL if not used)
+    NE_ModelAnimLOD *anim_lod; ///< Animation LOD information (NULL if not used)
+    int anim_active;          ///< Index in the list of running animations (or -1)
+    NE_ModelPriority priority; ///< Priority used by the polygon budget
     NE_Material *texture;     ///< Material used by this model
     int x;                    ///< X position of the model (f32)
     int y;                    ///< Y position of the model (f32)
@@ -76,7 +167,8 @@ void NE_ModelDelete(NE_Model *model);
 /// When a model is loaded with NE_ModelLoadStaticMeshFAT() or
 /// NE_ModelLoadDSMFAT(), the mesh is read from storage into RAM to a buffer
 /// allocated witn malloc(). This buffer is freed with free() when
-/// NE_ModelDelete() is called.
+/// NE_ModelDelete() is called (unless it is used by other models or it is kept
+/// by the mesh cache, see NE_ModelMeshCacheSetBudget()).
 ///
 /// If the mesh is loaded using NE_ModelLoadStaticMesh() or NE_ModelLoadDSM(),
 /// Nitro Engine can't tell if the user has loaded it from storage, or if it has
@@ -92,6 +184,30 @@ void NE_ModelDelete(NE_Model *model);
 /// @param model Pointer to the model.
 void NE_ModelFreeMeshWhenDeleted(NE_Model *model);
 
+/// Sets the max size of the meshes loaded from the filesystem kept in RAM.
+///
+/// Meshes loaded with NE_ModelLoadStaticMeshFAT() or NE_ModelLoadDSMFAT() (and
+/// their LOD versions) are kept in a cache indexed by their path. Loading the
+/// same file for a different model doesn't read the file again, the mesh is
+/// shared between the models as if NE_ModelClone() had been used.
+///
+/// By default, meshes are freed when no model uses them. If a budget is set,
+/// meshes that aren't used by any model are kept in RAM in case they are loaded
+/// again, and the least recently used ones are freed when the total size of all
+/// meshes loaded from the filesystem exceeds the budget. Meshes that are used
+/// by models are never freed, even if that means that the budget is exceeded.
+///
+/// @param size Budget in bytes. 0 disables the cache of unused meshes.
+void NE_ModelMeshCacheSetBudget(size_t size);
+
+/// Frees all meshes loaded from the filesystem that aren't used by any model.
+void NE_ModelMeshCacheFlush(void);
+
+/// Returns the total size of all meshes loaded from the filesystem.
+///
+/// @return Size in bytes.
+size_t NE_ModelMeshCacheGetSize(void);
+
 /// Assign a display list in RAM to a static model.
 ///
 /// @param model Pointer to the model.
@@ -106,6 +222,121 @@ int NE_ModelLoadStaticMesh(NE_Model *model, const void *pointer);
 /// @return It returns 1 on success, 0 on error.
 int NE_ModelLoadStaticMeshFAT(NE_Model *model, const char *path);
 
+/// Assign a display list in RAM to a LOD level of a static model.
+///
+/// The model will use this mesh instead of the main mesh when the distance to
+/// the camera is bigger than the distance set with NE_ModelSetLODDistanceI().
+///
+/// @param model Pointer to the model.
+/// @param level LOD level (1 to NE_MODEL_MAX_LOD_LEVELS - 1).
+/// @param pointer Pointer to the display list.
+/// @return It returns 1 on success, 0 on error.
+int NE_ModelLoadStaticMeshLOD(NE_Model *model, int level, const void *pointer);
+
+/// Loads a display list from a filesystem and assigns it to a LOD level of a
+/// static model.
+///
+/// @param model Pointer to the model.
+/// @param level LOD level (1 to NE_MODEL_MAX_LOD_LEVELS - 1).
+/// @param path Path to the display list.
+/// @return It returns 1 on success, 0 on error.
+int NE_ModelLoadStaticMeshLODFAT(NE_Model *model, int level, const char *path);
+
+/// Sets the distance from the camera where a LOD level starts being used.
+///
+/// The distance is measured from the position of the camera that was used last
+/// with NE_CameraUse() to the position of the model. Levels must have
+/// increasing distances.
+///
+/// @param model Pointer to the model.
+/// @param level LOD level (1 to NE_MODEL_MAX_LOD_LEVELS - 1).
+/// @param distance Distance (f32).
+void NE_ModelSetLODDistanceI(NE_Model *model, int level, int32_t distance);
+
+/// Sets the distance from the camera where a LOD level starts being used.
+///
+/// @param m Pointer to the model.
+/// @param l LOD level (1 to NE_MODEL_MAX_LOD_LEVELS - 1).
+/// @param d Distance (float).
+#define NE_ModelSetLODDistance(m, l, d) \
+    NE_ModelSetLODDistanceI(m, l, floattof32(d))
+
+/// Sets the hysteresis margin of the LOD levels of a model.
+///
+/// When a model switches to a less detailed level, it has to get closer to the
+/// camera than the distance of that level minus this margin before it switches
+/// back. This prevents the levels from flickering when the model is right at
+/// the distance of a level. The default value is
+/// NE_MODEL_LOD_DEFAULT_HYSTERESIS.
+///
+/// @param model Pointer to the model.
+/// @param margin Margin (f32).
+void NE_ModelSetLODHysteresisI(NE_Model *model, int32_t margin);
+
+/// Returns the LOD level used the last time the model was drawn.
+///
+/// @param model Pointer to the model.
+/// @return LOD level (0 to NE_MODEL_MAX_LOD_LEVELS - 1).
+int NE_ModelGetLODLevel(const NE_Model *model);
+
+/// Sets the number of free polygons below which models drop one LOD level.
+///
+/// If the number of polygons drawn in the current frame is close to the limit
+/// of the hardware (2048 polygons), models with LOD levels will be drawn with
+/// one level less of detail than the one that corresponds to their distance.
+/// This is done per draw, the level selected by distance isn't affected.
+///
+/// @param margin Number of polygons. Set it to 0 to disable this (default).
+void NE_ModelLODSetPolygonMargin(int margin);
+
+/// Sets the max number of polygons and vertices that can be drawn per frame.
+///
+/// The hardware can only draw 2048 polygons and 6144 vertices per frame. Any
+/// polygon sent after that limit is silently dropped. When a budget is set,
+/// NE_ModelDraw() keeps track of the projected number of polygons and vertices
+/// of the frame (using the number of polygons and vertices of the meshes, which
+/// is calculated when they are loaded). Models with priority NE_PRIORITY_LOW
+/// that don't fit in the budget are drawn with a less detailed LOD level or, if
+/// that isn't enough, they aren't drawn at all.
+///
+/// The values are projected, they don't take culling or clipping into account,
+/// so they are an upper bound of the real values. Geometry drawn without
+/// NE_ModelDraw() isn't tracked, use NE_ModelBudgetAdd() to account for it.
+///
+/// @param max_polygons Max number of polygons (0 - 2048). 0 disables it.
+/// @param max_vertices Max number of vertices (0 - 6144). 0 disables it.
+void NE_ModelBudgetSet(int max_polygons, int max_vertices);
+
+/// Adds polygons and vertices to the budget of the current frame.
+///
+/// @param polygons Number of polygons.
+/// @param vertices Number of vertices.
+void NE_ModelBudgetAdd(int polygons, int vertices);
+
+/// Starts a new frame in the polygon budget.
+///
+/// This is called by NE_Process() and NE_ProcessDual(), you only need to call
+/// it if you don't use them.
+void NE_ModelBudgetFrameStart(void);
+
+/// Gets the budget usage of the last frame that has been completed.
+///
+/// @param stats Pointer to a struct where the stats will be stored.
+void NE_ModelBudgetGetStats(NE_ModelBudgetStats *stats);
+
+/// Sets the priority of a model for the polygon budget.
+///
+/// @param model Pointer to the model.
+/// @param priority New priority.
+void NE_ModelSetPriority(NE_Model *model, NE_ModelPriority priority);
+
+/// Gets the number of polygons and vertices of the main mesh of a model.
+///
+/// @param model Pointer to the model.
+/// @param polygons Pointer to store the number of polygons.
+/// @param vertices Pointer to store the number of vertices.
+void NE_ModelGetMeshInfo(const NE_Model *model, int *polygons, int *vertices);
+
 /// Assign a material to a model.
 ///
 /// @param model Pointer to the model.
@@ -154,6 +385,89 @@ void NE_ModelDraw(const NE_Model *model);
 /// @param source Pointer to the source model.
 void NE_ModelClone(NE_Model *dest, NE_Model *source);
 
+/// Sets the number of poses kept in the pose cache of animated models.
+///
+/// Drawing an animated model requires calculating the matrix of each joint of
+/// its skeleton, which takes a lot of CPU time. When several models are drawn
+/// with the same animations at the same frames (and with the same blending
+/// factor) they have the same pose, so the matrices are calculated once and
+/// saved in a cache so that the other models can reuse them.
+///
+/// The cache is indexed by the DSA files, the frames and the blending factor,
+/// and the least recently used entries are replaced when it is full. By
+/// default it has NE_DEFAULT_POSE_CACHE_SIZE entries.
+///
+/// @param entries Number of entries. 0 disables the cache.
+void NE_ModelPoseCacheSetSize(int entries);
+
+/// Gets the number of hits and misses of the pose cache.
+///
+/// The counters are reset after calling this function.
+///
+/// @param hits Pointer to store the number of draws that reused a pose.
+/// @param misses Pointer to store the number of poses that were calculated.
+void NE_ModelPoseCacheGetStats(int *hits, int *misses);
+
+/// Sets the animation level of detail settings of an animated model.
+///
+/// When the model is further from the camera than the snap distance, it is
+/// drawn at the nearest frame of its animations instead of interpolating
+/// between two frames. This also makes it more likely that the pose is found in
+/// the pose cache.
+///
+/// When the model is further than the update distance, the pose of the model
+/// is only calculated once every 'update_period' frames, and the saved pose is
+/// used in the frames in between. The pose is taken from the pose cache if
+/// possible. Each model updates its pose in a different frame of the period,
+/// so that models with the same settings don't update their poses at the same
+/// time.
+///
+/// The distances are multiplied by the biggest scale of the model. Use 0 as
+/// distance to disable each setting.
+///
+/// @param model Pointer to the model.
+/// @param snap_distance Distance to start using the nearest frame (f32).
+/// @param update_distance Distance to start reducing the update rate (f32).
+/// @param update_period Frames between pose updates (1 or more).
+void NE_ModelAnimSetLODI(NE_Model *model, int32_t snap_distance,
+                         int32_t update_distance, int update_period);
+
+/// Sets the animation level of detail settings of an animated model.
+///
+/// @param m Pointer to the model.
+/// @param s Distance to start using the nearest frame (float).
+/// @param u Distance to start reducing the update rate (float).
+/// @param p Frames between pose updates (1 or more).
+#define NE_ModelAnimSetLOD(m, s, u, p) \
+    NE_ModelAnimSetLODI(m, floattof32(s), floattof32(u), p)
+
+/// Gets the animation statistics of all models.
+///
+/// The counters are reset after calling this function, so calling it once per
+/// frame returns the values of each frame.
+///
+/// @param stats Pointer to store the statistics.
+void NE_ModelAnimGetStats(NE_ModelAnimStats *stats);
+
+/// Merges several static models that use the same material into one model.
+///
+/// Each model is drawn with its own matrix push, transformation, material
+/// setup and matrix pop. Static scenery made of many models can be merged into
+/// one model so that it only costs one draw. The position, rotation and scale
+/// of each model are baked into the vertices of a new display list (see
+/// NE_DisplayListMerge()), and the position and scale of the destination model
+/// are set so that it looks like the original models. The destination model
+/// uses the material of the source models.
+///
+/// Only the main mesh of the source models is used, LOD levels are ignored.
+/// The source models aren't modified, they can be deleted after this call.
+///
+/// @param dest Pointer to the destination model (it must be static).
+/// @param models Array of pointers to the static models to merge.
+/// @param num_models Number of models in the array.
+/// @return It returns 1 on success, 0 on error.
+int NE_ModelBatch(NE_Model *dest, NE_Model **models, int num_models);
+
 /// Set position of a model.
 ///
 /// @param model Pointer to the model.
@@ -226,6 +540,10 @@ void NE_ModelSetRot(NE_Model *model, int rx, int ry, int rz);
 void NE_ModelRotate(NE_Model *model, int rx, int ry, int rz);
 
 /// Update internal state of the animation of all models.
+///
+/// Only models with running animations are updated (models that have an
+/// animation with a speed different than 0). One-shot animations stop running
+/// when they reach their end.
 void NE_ModelAnimateAll(void);
 
 /// Starts the animation of an animated model.
@@ -309,8 +627,80 @@ void NE_ModelAnimSecondarySetFactor(NE_Model *model, int32_t factor);
 ///                          secondary animation.
 void NE_ModelAnimSecondaryClear(NE_Model *model, bool replace_base_anim);
 
+/// Assigns an animation to an extra animation layer of a model.
+///
+/// Extra layers are drawn together with the main and secondary animations. The
+/// main and secondary animations are blended as usual (see
+/// NE_ModelAnimSecondarySetFactor()), and the extra layers are blended with
+/// them depending on their type:
+///
+/// - Regular layers are averaged with the main and secondary animations using
+///   their weights. The weights are normalized, so several layers can be used
+///   to create blend spaces (like walking and running at different speeds).
+///
+/// - Additive layers add the difference between their current frame and their
+///   frame 0, scaled by their weight, on top of the result. They can be used to
+///   animate parts of the skeleton independently (like waving while walking).
+///
+/// All layers are evaluated in one pass per joint. Models with extra layers
+/// don't use the pose cache. The initial weight of the layer is 1.0.
+///
+/// @param model Pointer to the model.
+/// @param layer Layer index (2 to NE_MODEL_MAX_ANIM_LAYERS - 1).
+/// @param anim Pointer to the animation.
+/// @param additive True for an additive layer, false for a regular layer.
+void NE_ModelSetAnimationLayer(NE_Model *model, int layer, NE_Animation *anim,
+                               bool additive);
+
+/// Starts the animation of an extra animation layer of a model.
+///
+/// @param model Pointer to the model.
+/// @param layer Layer index (2 to NE_MODEL_MAX_ANIM_LAYERS - 1).
+/// @param type Animation type (NE_ANIM_LOOP / NE_ANIM_ONESHOT).
+/// @param speed Animation speed. (f32)
+void NE_ModelAnimLayerStart(NE_Model *model, int layer, NE_AnimationType type,
+                            int32_t speed);
+
+/// Sets the animation speed of an extra animation layer of a model.
+///
+/// @param model Pointer to the model.
+/// @param layer Layer index (2 to NE_MODEL_MAX_ANIM_LAYERS - 1).
+/// @param speed New speed. (f32)
+void NE_ModelAnimLayerSetSpeed(NE_Model *model, int layer, int32_t speed);
+
+/// Returns the current frame of an extra animation layer of a model.
+///
+/// @param model Pointer to the model.
+/// @param layer Layer index (2 to NE_MODEL_MAX_ANIM_LAYERS - 1).
+/// @return Returns the frame in f32 format.
+int32_t NE_ModelAnimLayerGetFrame(const NE_Model *model, int layer);
+
+/// Sets the current frame of an extra animation layer of a model.
+///
+/// @param model Pointer to the model.
+/// @param layer Layer index (2 to NE_MODEL_MAX_ANIM_LAYERS - 1).
+/// @param frame Frame to set. (f32)
+void NE_ModelAnimLayerSetFrame(NE_Model *model, int layer, int32_t frame);
+
+/// Sets the weight of an extra animation layer of a model.
+///
+/// @param model Pointer to the model.
+/// @param layer Layer index (2 to NE_MODEL_MAX_ANIM_LAYERS - 1).
+/// @param weight Weight from 0.0 to 1.0. (f32)
+void NE_ModelAnimLayerSetWeight(NE_Model *model, int layer, int32_t weight);
+
+/// Removes the animation of an extra animation layer of a model.
+///
+/// @param model Pointer to the model.
+/// @param layer Layer index (2 to NE_MODEL_MAX_ANIM_LAYERS - 1).
+void NE_ModelAnimLayerClear(NE_Model *model, int layer);
+
 /// Loads a DSM file stored in RAM to a model.
 ///
+/// The DSM file may be split in sub-meshes (with the "--max-joints" option of
+/// md5_to_dsma) so that skeletons with more joints than the ones that fit in
+/// the matrix stack can be used.
+///
 /// @param model Pointer to the model.
 /// @param pointer Pointer to the file.
 /// @return It returns 1 on success, 0 on error.
@@ -323,6 +713,25 @@ int NE_ModelLoadDSM(NE_Model *model, const void *pointer);
 /// @return It returns 1 on success, 0 on error.
 int NE_ModelLoadDSMFAT(NE_Model *model, const char *path);
 
+/// Loads a DSM file stored in RAM to a LOD level of a model.
+///
+/// All the LOD levels of an animated model are drawn with the same animation,
+/// so all the DSM files must have been exported with the same skeleton.
+///
+/// @param model Pointer to the model.
+/// @param level LOD level (1 to NE_MODEL_MAX_LOD_LEVELS - 1).
+/// @param pointer Pointer to the file.
+/// @return It returns 1 on success, 0 on error.
+int NE_ModelLoadDSMLOD(NE_Model *model, int level, const void *pointer);
+
+/// Loads a DSM file stored in a filesystem to a LOD level of a model.
+///
+/// @param model Pointer to the model.
+/// @param level LOD level (1 to NE_MODEL_MAX_LOD_LEVELS - 1).
+/// @param path Path to the file.
+/// @return It returns 1 on success, 0 on error.
+int NE_ModelLoadDSMLODFAT(NE_Model *model, int level, const char *path);
+
 /// Deletes all models and frees all memory used by them.
 void NE_ModelDeleteAll(void);
 
@@ -14,23 +14,73 @@
 
 /// @defgroup physics Physics engine
 ///
-/// A very simple physics engine. It only supports axis-aligned bounding boxes
-/// at the moment.
+/// A very simple physics engine. It supports axis-aligned bounding boxes,
+/// bounding spheres and dots.
 ///
 /// @{
 
 #define NE_DEFAULT_PHYSICS  64 ///< Default max number of physic objects
 
+/// Default size of the cells of the broadphase grid (f32).
+#define NE_DEFAULT_PHYSICS_CELL_SIZE (floattof32(2.0))
+
+/// Max number of cells of the broadphase grid that an object can be in.
+///
+/// Bigger objects (like floors) are tested against all objects.
+#define NE_PHYSICS_MAX_CELLS 8
+
+/// Default speed under which an object is considered to be resting (f32).
+#define NE_DEFAULT_PHYSICS_SLEEP_SPEED (floattof32(0.01))
+
+/// Default number of updates that an object needs to be resting to sleep.
+#define NE_DEFAULT_PHYSICS_SLEEP_FRAMES 60
+
+/// Color of dynamic objects that are awake in NE_PhysicsDebugDraw().
+#define NE_PHYSICS_DEBUG_COLOR_AWAKE     RGB15(0, 31, 0)
+/// Color of dynamic objects that are sleeping in NE_PhysicsDebugDraw().
+#define NE_PHYSICS_DEBUG_COLOR_SLEEPING  RGB15(0, 12, 31)
+/// Color of kinematic objects in NE_PhysicsDebugDraw().
+#define NE_PHYSICS_DEBUG_COLOR_KINEMATIC RGB15(31, 31, 0)
+/// Color of static and disabled objects in NE_PhysicsDebugDraw().
+#define NE_PHYSICS_DEBUG_COLOR_STATIC    RGB15(20, 20, 20)
+
+/// Size of the boxes used to draw dots in NE_PhysicsDebugDraw() (f32).
+#define NE_PHYSICS_DEBUG_DOT_SIZE        (floattof32(0.1))
+
+/// Number of contacts per object that fit in the contact list.
+///
+/// The list can hold NE_PHYSICS_CONTACTS_PER_OBJECT times the max number of
+/// objects. Check NE_PhysicsGetContactCount().
+#define NE_PHYSICS_CONTACTS_PER_OBJECT 4
+
+/// Default collision category of physics objects.
+#define NE_PHYSICS_CATEGORY_DEFAULT BIT(0)
+
+/// Collision mask that makes an object collide with all categories.
+#define NE_PHYSICS_MASK_ALL 0xFFFFFFFF
+
+/// Max depth of the bounding volume hierarchy of collision meshes.
+///
+/// It must match the limit of obj2col.
+#define NE_PHYSICS_MESH_MAX_DEPTH 32
+
 /// Minimun speed that an object needs to have to rebound after a collision.
 ///
 /// If the object has less speed than this, it will stop after a collision.
 #define NE_MIN_BOUNCE_SPEED (floattof32(0.01))
 
 /// Object types supported by the physics engine.
+///
+/// When an object collides with another one, the response (bounce or stop) is
+/// calculated with the bounding boxes of both shapes. A sphere is handled as a
+/// box of the size of its diameter, and a dot as a box of size zero.
+///
+/// Collisions against a collision mesh use the triangles of the mesh instead.
 typedef enum {
     NE_BoundingBox    = 1, ///< Axis-aligned bounding box.
     NE_BoundingSphere = 2, ///< Bounding sphere.
-    NE_Dot            = 3  ///< Dot. Use this for really small objects.
+    NE_Dot            = 3, ///< Dot. Use this for really small objects.
+    NE_CollisionMesh  = 4  ///< Static triangle mesh. Check NE_PhysicsSetMesh().
 } NE_PhysicsTypes;
 
 /// Possible actions that can happen to an object after a collision.
@@ -40,6 +90,34 @@ typedef enum {
     NE_ColStop         ///< Stop.
 } NE_OnCollision;
 
+/// Types of bodies, depending on how they are moved.
+typedef enum {
+    /// Moved by the physics engine. It is affected by gravity, friction and
+    /// collisions. This is the default type.
+    NE_BodyDynamic = 0,
+    /// Moved by the physics engine with its speed, but it isn't affected by
+    /// gravity, friction or collisions. Dynamic objects still collide with it.
+    /// Use it for things like moving platforms.
+    NE_BodyKinematic,
+    /// Never moved by the physics engine, and never tested against other
+    /// objects. Dynamic objects collide with it. Use it for floors and walls.
+    NE_BodyStatic
+} NE_PhysicsBodyType;
+
+/// Events of the contact list.
+typedef enum {
+    NE_ContactBegin, ///< The objects have started touching in this update.
+    NE_ContactStay,  ///< The objects were touching in the previous update too.
+    NE_ContactEnd    ///< The objects have stopped touching in this update.
+} NE_PhysicsContactEvent;
+
+/// Axes of the contacts of the contact list.
+typedef enum {
+    NE_AxisX, ///< X axis.
+    NE_AxisY, ///< Y axis.
+    NE_AxisZ  ///< Z axis.
+} NE_PhysicsAxis;
+
 /// Holds information of a physics object.
 //
 /// Values are in fixed point (f32).
@@ -68,8 +146,46 @@ typedef struct {
     NE_OnCollision oncollision; ///< Action to do if there is a collision.
     bool iscolliding; ///< True if a collision has been detected.
     int physicsgroup; ///< Objects interact with others in the same group only
+    uint32_t category; ///< Collision categories of this object (bit field).
+    uint32_t mask;    ///< Categories that this object collides with.
+    int slot;         ///< Index of the object in the physics engine (internal)
+    NE_PhysicsBodyType bodytype; ///< Dynamic, kinematic or static.
+    bool sleeping;    ///< True if the object is sleeping.
+    int sleepframes;  ///< Number of updates the object has been resting.
+    int sleepx;       ///< X coordinate of the model when it went to sleep.
+    int sleepy;       ///< Y coordinate of the model when it went to sleep.
+    int sleepz;       ///< Z coordinate of the model when it went to sleep.
+    bool continuous;  ///< True if continuous collisions are enabled.
+    int prevx;        ///< X coordinate before the last fixed step.
+    int prevy;        ///< Y coordinate before the last fixed step.
+    int prevz;        ///< Z coordinate before the last fixed step.
+    int currx;        ///< X coordinate after the last fixed step.
+    int curry;        ///< Y coordinate after the last fixed step.
+    int currz;        ///< Z coordinate after the last fixed step.
+    const void *mesh; ///< Data of a collision mesh created by obj2col.
 } NE_Physics;
 
+/// Contact between two physics objects.
+///
+/// The axis and the penetration are calculated with the bounding boxes of both
+/// objects, with the position of object A after its movement and before the
+/// response to the collision. If object B is a collision mesh, they are the
+/// ones of the deepest contact with a triangle, and the axis is the one closest
+/// to the normal of the contact.
+typedef struct {
+    NE_Physics *a;      ///< Object that has been moved (NULL if deleted).
+    NE_Physics *b;      ///< Object it has collided with (NULL if deleted).
+    NE_PhysicsContactEvent event; ///< Event of this contact.
+    NE_PhysicsAxis axis; ///< Axis with the smallest penetration.
+    int penetration;    ///< Penetration along that axis (f32).
+} NE_PhysicsContact;
+
+/// Statistics of the physics engine.
+typedef struct {
+    int pair_tests;   ///< Number of pairs of objects tested for collisions
+    int contacts_dropped; ///< Number of contacts that didn't fit in the list
+} NE_PhysicsStats;
+
 /// Creates a new physics object.
 ///
 /// @param type Type of physics object.
@@ -107,6 +223,27 @@ void NE_PhysicsSetRadiusI(NE_Physics *pointer, int radius);
 #define NE_PhysicsSetRadius(p, r) \
     NE_PhysicsSetRadiusI(p, floattof32(r))
 
+/// Set the data of a physics object that is a collision mesh.
+///
+/// Collision meshes are created from OBJ files with obj2col. They contain the
+/// triangles of the mesh and a bounding volume hierarchy, so that objects are
+/// only tested against the triangles that are close to them. This way, a whole
+/// level can be one object.
+///
+/// Boxes and spheres collide with the triangles of the mesh, and they are
+/// pushed out of them along the normal of the contact. Dots don't collide with
+/// collision meshes. Triangles are one-sided: objects only collide with the
+/// face that has the vertices in counter-clockwise order.
+///
+/// Collision meshes are always static. The position of the model is the origin
+/// of the mesh. The rotation and scale of the model aren't used. The data isn't
+/// copied, so it must be kept in memory while it's used.
+///
+/// @param pointer Pointer to the object.
+/// @param data Pointer to the collision mesh.
+/// @return It returns 1 on success, 0 on error.
+int NE_PhysicsSetMesh(NE_Physics *pointer, const void *data);
+
 /// Set speed of a physics object.
 ///
 /// @param pointer Pointer to the object.
@@ -175,13 +312,48 @@ void NE_PhysicsSetBounceEnergy(NE_Physics *pointer, int percent);
 
 /// Enable movement of a physics object.
 ///
-/// If disabled, it will never update the position of this object. Use it for
-/// objects that interact with others, but that are fixed, like the floor.
+/// If disabled, it will never update the position of this object. Objects that
+/// are always fixed, like the floor, should be static instead (check
+/// NE_PhysicsSetBodyType()), as they are cheaper to handle.
 ///
 /// @param pointer Pointer to the physics object.
 /// @param value True enables movelent, false disables it.
 void NE_PhysicsEnable(NE_Physics *pointer, bool value);
 
+/// Sets the body type of a physics object.
+///
+/// Static objects are stored in a different broadphase grid than the rest of
+/// objects, which is only rebuilt when a static object is created, deleted,
+/// resized or assigned a new model. If the model of a static object is moved,
+/// NE_PhysicsStaticChanged() must be called.
+///
+/// Kinematic and static objects don't check collisions, so
+/// NE_PhysicsIsColliding() always returns false for them.
+///
+/// @param pointer Pointer to the physics object.
+/// @param type New body type.
+void NE_PhysicsSetBodyType(NE_Physics *pointer, NE_PhysicsBodyType type);
+
+/// Enables or disables continuous collisions for a dynamic object.
+///
+/// Objects that move more than the size of other objects in one update can go
+/// through them. Objects with continuous collisions check all the space that
+/// they cover during the movement, and they are stopped at the first object in
+/// their way. The test treats both objects as their bounding boxes. It's more
+/// expensive than the regular test, so only enable it for fast objects, like
+/// projectiles. Collision meshes are ignored by this test.
+///
+/// @param pointer Pointer to the physics object.
+/// @param enabled True to enable continuous collisions, false to disable them.
+void NE_PhysicsSetContinuous(NE_Physics *pointer, bool enabled);
+
+/// Tells the physics engine that static objects have been moved.
+///
+/// The broadphase grid of static objects is rebuilt in the next update.
+/// Sleeping objects that touch a static object that has changed, before or
+/// after the change, are woken up.
+void NE_PhysicsStaticChanged(void);
+
 /// Assign a model object to a physics object.
 ///
 /// @param physics Pointer to the physics object.
@@ -198,6 +370,33 @@ void NE_PhysicsSetModel(NE_Physics *physics, NE_Model *modelpointer);
 /// @param group New physics group number.
 void NE_PhysicsSetGroup(NE_Physics *physics, int group);
 
+/// Sets the collision categories of an object.
+///
+/// Each bit of the value is a category, and an object can be in several
+/// categories. An object only collides with the objects that have at least
+/// one of their categories in its mask (check NE_PhysicsSetMask()). This check
+/// is done before any other check, and it's used to skip parts of the
+/// broadphase grid that don't contain any object of the right categories.
+///
+/// By default, objects are in category NE_PHYSICS_CATEGORY_DEFAULT and they
+/// collide with all categories, so only physics groups are used. Groups are
+/// still checked when categories are used.
+///
+/// @param physics Pointer to the object.
+/// @param category Categories of the object.
+void NE_PhysicsSetCategory(NE_Physics *physics, uint32_t category);
+
+/// Sets the collision categories that an object collides with.
+///
+/// The mask only affects the object itself. For example, if a player collides
+/// with enemies and walls, but not with pickups, the mask of the player must
+/// not contain the category of the pickups. The pickups can still collide
+/// with the player if their mask contains the category of the player.
+///
+/// @param physics Pointer to the object.
+/// @param mask Categories that the object collides with.
+void NE_PhysicsSetMask(NE_Physics *physics, uint32_t mask);
+
 /// Set action to do if this object collides with another one.
 ///
 /// @param physics Pointer to the object.
@@ -213,18 +412,182 @@ void NE_PhysicsOnCollision(NE_Physics *physics, NE_OnCollision action);
 /// @return True if there is a collision, false otherwise.
 bool NE_PhysicsIsColliding(const NE_Physics *pointer);
 
+/// Returns the number of contacts found in the last call to
+/// NE_PhysicsUpdateAll().
+///
+/// The contact list has an entry for each pair of objects that is touching
+/// after the update or that has stopped touching in the update. There is an
+/// entry for each object that has been moved: if two dynamic objects collide,
+/// there are two entries, one with each object as object A. Kinematic and
+/// static objects are never object A. Sleeping objects keep the contacts that
+/// they had when they went to sleep.
+///
+/// Entries are sorted by the slots of the objects, so the order doesn't depend
+/// on the broadphase. NE_PhysicsUpdate() doesn't change the list.
+///
+/// If the list is full, the rest of the contacts are dropped, and they are
+/// counted in the statistics (check NE_PhysicsGetStats()).
+///
+/// @return Number of contacts.
+int NE_PhysicsGetContactCount(void);
+
+/// Returns a contact of the contact list.
+///
+/// Contacts are valid until the next call to NE_PhysicsUpdateAll(). If an
+/// object is deleted, the pointers to it in the list are set to NULL, so it is
+/// safe to delete objects while going through the list. Deleted objects don't
+/// get NE_ContactEnd events.
+///
+/// @param index Index of the contact (from 0 to the number of contacts - 1).
+/// @return Pointer to the contact.
+const NE_PhysicsContact *NE_PhysicsGetContact(int index);
+
+/// Wakes up a sleeping physics object.
+///
+/// Objects are also woken up when their speed, size, gravity or model are
+/// changed, when their model is moved, when a moving object collides with them
+/// and when an object that touches them is deleted.
+///
+/// @param pointer Pointer to the object.
+void NE_PhysicsWake(NE_Physics *pointer);
+
+/// Returns true if the given object is sleeping.
+///
+/// @param pointer Pointer to the object.
+/// @return True if the object is sleeping.
+bool NE_PhysicsIsSleeping(const NE_Physics *pointer);
+
+/// Sets the conditions for dynamic objects to go to sleep.
+///
+/// If the speed of a dynamic object is lower than the specified speed in all
+/// axes for the specified number of updates, it goes to sleep. Sleeping objects
+/// aren't moved or tested against other objects, but other objects can collide
+/// with them. When an object wakes up, all sleeping objects that touch it and
+/// whose mask includes its category wake up as well.
+///
+/// @param speed Max speed of a resting object (f32).
+/// @param frames Number of updates. If it is 0 or lower, objects never sleep,
+///               and all sleeping objects are woken up.
+void NE_PhysicsSetSleepI(int speed, int frames);
+
+/// Sets the conditions for dynamic objects to go to sleep.
+///
+/// @param s Max speed of a resting object (float).
+/// @param f Number of updates.
+#define NE_PhysicsSetSleep(s, f) \
+    NE_PhysicsSetSleepI(floattof32(s), f)
+
+/// Returns the number of dynamic and kinematic objects that are enabled and
+/// not sleeping.
+///
+/// @return Number of awake objects.
+int NE_PhysicsGetAwakeCount(void);
+
+/// Enables or disables the broadphase of the physics engine.
+///
+/// When it is enabled (the default), objects are stored in a uniform grid (a
+/// spatial hash) and each object is only tested against the objects that share
+/// grid cells with it. When it is disabled, each object is tested against all
+/// other objects. The result of the simulation is the same in both cases.
+///
+/// @param enabled True to enable the broadphase, false to disable it.
+void NE_PhysicsSetBroadphase(bool enabled);
+
+/// Sets the size of the cells of the broadphase grid.
+///
+/// The size is rounded up to a power of two. Objects that cover more than
+/// NE_PHYSICS_MAX_CELLS cells are tested against all objects, so the size
+/// should be at least as big as most of the objects. Cells that are too big
+/// contain too many objects.
+///
+/// @param size Size of the cells (f32).
+void NE_PhysicsSetCellSizeI(int size);
+
+/// Sets the size of the cells of the broadphase grid.
+///
+/// @param s Size of the cells (float).
+#define NE_PhysicsSetCellSize(s) \
+    NE_PhysicsSetCellSizeI(floattof32(s))
+
+/// Gets statistics of the physics engine since the last call to this function.
+///
+/// The counters are reset after they are read, so calling this function once
+/// per frame returns the values of each frame.
+///
+/// @param stats Pointer to store the statistics.
+void NE_PhysicsGetStats(NE_PhysicsStats *stats);
+
 /// Updates all physics objects.
 void NE_PhysicsUpdateAll(void);
 
+/// Sets a fixed timestep for the physics engine.
+///
+/// By default, NE_PhysicsAdvanceI() updates the physics engine once per call.
+/// With a fixed timestep, it updates it once per step of time that has
+/// passed, so the speed of the simulation doesn't depend on the framerate. For
+/// example, a step of 2 frames updates the physics engine at 30 Hz, which
+/// halves the CPU time it uses.
+///
+/// Models are drawn at a position interpolated between their positions in the
+/// last two steps, so they move smoothly even if the physics engine isn't
+/// updated every frame. Speeds, gravity and friction are applied once per step.
+///
+/// @param step Length of a step in frames (f32). If it is 0 or lower, the
+///             fixed timestep is disabled.
+/// @param max_steps Max number of steps done in one call to
+///                  NE_PhysicsAdvanceI(). If the CPU can't keep up, the rest of
+///                  the time is dropped.
+void NE_PhysicsSetFixedStepI(int step, int max_steps);
+
+/// Sets a fixed timestep for the physics engine.
+///
+/// @param s Length of a step in frames (float).
+/// @param m Max number of steps done in one call to NE_PhysicsAdvanceI().
+#define NE_PhysicsSetFixedStep(s, m) \
+    NE_PhysicsSetFixedStepI(floattof32(s), m)
+
+/// Advances the simulation by the specified amount of time.
+///
+/// If there is no fixed timestep, it calls NE_PhysicsUpdateAll() once. If there
+/// is a fixed timestep, it calls NE_PhysicsUpdateAll() once per step that fits
+/// in the time that has passed, and then it interpolates the positions of the
+/// models. Models can still be moved between calls to this function, but they
+/// aren't interpolated in the next call.
+///
+/// NE_WaitForVBL() calls this function with the number of frames that have
+/// passed since the last call if NE_UPDATE_PHYSICS is used. For that to work,
+/// NE_VBLFunc() needs to be set as VBL interrupt handler.
+///
+/// @param time Time that has passed in frames (f32).
+/// @return Number of updates done.
+int NE_PhysicsAdvanceI(int time);
+
+/// Returns the factor used to interpolate the positions of models.
+///
+/// It's the fraction of a step that has passed since the last step (f32). It
+/// can be used to interpolate other objects, like cameras. It's always 0 if
+/// there is no fixed timestep.
+///
+/// @return Interpolation factor (from 0 to 1, f32).
+int NE_PhysicsGetInterpolation(void);
+
 /// Updates the provided physics object.
 ///
 /// @param pointer Pointer to the object.
 void NE_PhysicsUpdate(NE_Physics *pointer);
 
+/// Draws the bounding boxes of all physics objects.
+///
+/// The color of each box depends on the state of the object (check the
+/// NE_PHYSICS_DEBUG_COLOR_* definitions). Call it from the function that draws
+/// the 3D scene.
+void NE_PhysicsDebugDraw(void);
+
 /// Returns true if the given objects are colliding.
 ///
-/// It doesn't check physic groups. Two objects in different groups can still
-/// collide according to this function.
+/// It doesn't check physic groups, categories or masks. Two objects in
+/// different groups can still collide according to this function. Two dots
+/// never collide.
 ///
 /// @param pointer1 Pointer to first object.
 /// @param pointer2 Pointer to second object.
@@ -6,10 +6,16 @@
 
 #include <nds/arm9/postest.h>
 
+#include "dsma/dsma.h"
+
 #include "NEMain.h"
 
 /// @file NEAnimation.c
 
+// From NEModel.c
+extern void ne_model_pose_cache_invalidate(const void *dsa);
+extern void ne_model_pose_cache_invalidate_all(void);
+
 static NE_Animation **NE_AnimationPointers;
 static int NE_MAX_ANIMATIONS;
 static bool ne_animation_system_inited = false;
@@ -72,6 +78,8 @@ void NE_AnimationDelete(NE_Animation *animation)
         i++;
     }
 
+    ne_model_pose_cache_invalidate(animation->data);
+
     if (animation->loadedfromfat)
         free((void *)animation->data);
 
@@ -86,6 +94,8 @@ int NE_AnimationLoadFAT(NE_Animation *animation, const char *dsa_path)
     NE_AssertPointer(animation, "NULL animation pointer");
     NE_AssertPointer(dsa_path, "NULL path pointer");
 
+    ne_model_pose_cache_invalidate(animation->data);
+
     if (animation->loadedfromfat)
         free((void *)animation->data);
 
@@ -100,9 +110,9 @@ int NE_AnimationLoadFAT(NE_Animation *animation, const char *dsa_path)
 
     // Check version
     uint32_t version = pointer[0];
-    if (version != 1)
+    if ((version < 1) || (version > 3))
     {
-        NE_DebugPrint("file version is %ld, it should be 1", version);
+        NE_DebugPrint("file version is %ld, it should be 1, 2 or 3", version);
         free(pointer);
         return 0;
     }
@@ -119,6 +129,8 @@ int NE_AnimationLoad(NE_Animation *animation, const void *dsa_pointer)
     NE_AssertPointer(animation, "NULL animation pointer");
     NE_AssertPointer(dsa_pointer, "NULL data pointer");
 
+    ne_model_pose_cache_invalidate(animation->data);
+
     if (animation->loadedfromfat)
         free((void *)animation->data);
 
@@ -128,9 +140,9 @@ int NE_AnimationLoad(NE_Animation *animation, const void *dsa_pointer)
 
     // Check version
     uint32_t version = pointer[0];
-    if (version != 1)
+    if ((version < 1) || (version > 3))
     {
-        NE_DebugPrint("file version is %ld, it should be 1", version);
+        NE_DebugPrint("file version is %ld, it should be 1, 2 or 3", version);
         free((void *)pointer);
         return 0;
     }
@@ -184,3 +196,14 @@ void NE_AnimationSystemEnd(void)
 
     ne_animation_system_inited = false;
 }
+
+void NE_AnimationSetQuaternionNormalization(bool enabled)
+{
+    if (DSMA_GetQuaternionNormalization() == enabled)
+        return;
+
+    DSMA_SetQuaternionNormalization(enabled);
+
+    // Poses calculated with the previous setting aren't valid anymore
+    ne_model_pose_cache_invalidate_all();
+}
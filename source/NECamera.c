@@ -12,6 +12,10 @@ static NE_Camera **NE_UserCamera;
 static int NE_MAX_CAMERAS;
 static bool ne_camera_system_inited = false;
 
+// Last camera passed to NE_CameraUse(). Internal use, the model system uses it
+// to calculate the distance from models to the viewer.
+const NE_Camera *NE_CameraLastUsed = NULL;
+
 // Internal use only
 static void __NE_CameraUpdateMatrix(NE_Camera * cam)
 {
@@ -116,6 +120,8 @@ void NE_CameraUse(NE_Camera *cam)
     }
 
     glLoadMatrix4x4(&cam->matrix);
+
+    NE_CameraLastUsed = cam;
 }
 
 void NE_CameraMoveFreeI(NE_Camera *cam, int front, int right, int up)
@@ -363,6 +369,9 @@ void NE_CameraDelete(NE_Camera *cam)
         if (NE_UserCamera[i] != cam)
             continue;
 
+        if (NE_CameraLastUsed == cam)
+            NE_CameraLastUsed = NULL;
+
         NE_UserCamera[i] = NULL;
         free(cam);
         return;
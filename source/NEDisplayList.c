@@ -0,0 +1,615 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright (c) 2008-2011, 2019, 2022 Antonio Niño Díaz
+//
+// This file is part of Nitro Engine
+
+#include "NEMain.h"
+
+/// @file NEDisplayList.c
+
+// Initial size of the buffer of a display list in words
+#define NE_DISPLAYLIST_INITIAL_SIZE 64
+
+// This is checked by the polygon functions to know if they have to send their
+// commands to the GPU or to the display list.
+bool NE_DisplayListRecording = false;
+
+static uint32_t *ne_dl_buffer = NULL;
+static size_t ne_dl_capacity; // In words
+static size_t ne_dl_size; // In words, including the size word
+static size_t ne_dl_header; // Index of the current command header word
+static int ne_dl_header_cmds; // Number of commands in the current header
+static bool ne_dl_error;
+
+// Last vertex added to the display list, used to pick the smallest command
+static bool ne_dl_vtx_last_valid;
+static int ne_dl_vtx_last[3];
+
+static bool ne_dl_reserve(size_t words)
+{
+    if (ne_dl_size + words <= ne_dl_capacity)
+        return true;
+
+    size_t capacity = ne_dl_capacity * 2;
+    while (capacity < ne_dl_size + words)
+        capacity *= 2;
+
+    uint32_t *buffer = realloc(ne_dl_buffer, capacity * sizeof(uint32_t));
+    if (buffer == NULL)
+    {
+        NE_DebugPrint("Not enough memory");
+        return false;
+    }
+
+    ne_dl_buffer = buffer;
+    ne_dl_capacity = capacity;
+    return true;
+}
+
+int NE_DisplayListBegin(void)
+{
+    NE_Assert(!NE_DisplayListRecording, "Already recording a display list");
+
+    free(ne_dl_buffer);
+
+    ne_dl_buffer = malloc(NE_DISPLAYLIST_INITIAL_SIZE * sizeof(uint32_t));
+    if (ne_dl_buffer == NULL)
+    {
+        NE_DebugPrint("Not enough memory");
+        return 0;
+    }
+
+    ne_dl_capacity = NE_DISPLAYLIST_INITIAL_SIZE;
+    ne_dl_size = 1; // Leave space for the size of the list
+    ne_dl_header_cmds = 4; // Force the creation of a new header
+    ne_dl_error = false;
+    ne_dl_vtx_last_valid = false;
+
+    NE_DisplayListRecording = true;
+    return 1;
+}
+
+void *NE_DisplayListEnd(void)
+{
+    NE_Assert(NE_DisplayListRecording, "Not recording a display list");
+
+    NE_DisplayListRecording = false;
+
+    uint32_t *list = ne_dl_buffer;
+    ne_dl_buffer = NULL;
+
+    if (ne_dl_error)
+    {
+        free(list);
+        return NULL;
+    }
+
+    // The unused commands of the last header are already NOPs
+    list[0] = ne_dl_size - 1;
+
+    // Release the unused part of the buffer
+    uint32_t *shrunk = realloc(list, ne_dl_size * sizeof(uint32_t));
+    if (shrunk != NULL)
+        list = shrunk;
+
+    return list;
+}
+
+void NE_DisplayListAddCommand(u32 id, const u32 *params, int num_params)
+{
+    NE_Assert(NE_DisplayListRecording, "Not recording a display list");
+
+    if (ne_dl_error)
+        return;
+
+    if (!ne_dl_reserve(1 + num_params))
+    {
+        ne_dl_error = true;
+        return;
+    }
+
+    if (ne_dl_header_cmds == 4)
+    {
+        ne_dl_header = ne_dl_size++;
+        ne_dl_buffer[ne_dl_header] = 0;
+        ne_dl_header_cmds = 0;
+    }
+
+    ne_dl_buffer[ne_dl_header] |= (id & 0xFF) << (ne_dl_header_cmds * 8);
+    ne_dl_header_cmds++;
+
+    for (int i = 0; i < num_params; i++)
+        ne_dl_buffer[ne_dl_size++] = params[i];
+
+    // The previous vertex isn't known anymore after a new BEGIN_VTXS command
+    // or a vertex command that hasn't been sent by NE_DisplayListAddVertexI()
+    if ((id == FIFO_BEGIN) ||
+        ((id >= FIFO_VERTEX16) && (id <= FIFO_VERTEX_DIFF)))
+    {
+        ne_dl_vtx_last_valid = false;
+    }
+}
+
+void NE_DisplayListAddVertexI(int x, int y, int z)
+{
+    NE_Assert(NE_DisplayListRecording, "Not recording a display list");
+
+    // Make sure that the values are in v16 range
+    x = (int16_t)x;
+    y = (int16_t)y;
+    z = (int16_t)z;
+
+    u32 param;
+
+    if (ne_dl_vtx_last_valid)
+    {
+        const int *last = ne_dl_vtx_last;
+
+        // If one of the coordinates is the same as in the previous vertex, it
+        // is enough to send the other two.
+        if (last[0] == x)
+        {
+            param = (y & 0xFFFF) | ((u32)z << 16);
+            NE_DisplayListAddCommand(FIFO_VERTEX_YZ, &param, 1);
+            goto end;
+        }
+        if (last[1] == y)
+        {
+            param = (x & 0xFFFF) | ((u32)z << 16);
+            NE_DisplayListAddCommand(FIFO_VERTEX_XZ, &param, 1);
+            goto end;
+        }
+        if (last[2] == z)
+        {
+            param = (x & 0xFFFF) | ((u32)y << 16);
+            NE_DisplayListAddCommand(FIFO_VERTEX_XY, &param, 1);
+            goto end;
+        }
+
+        // If the vertex is close to the previous one, send the difference.
+        // The parameters of VTX_DIFF are in 1.0.9 format, so each unit is 8
+        // units of a v16 value, and the difference must be a multiple of 8.
+        int dx = x - last[0];
+        int dy = y - last[1];
+        int dz = z - last[2];
+        if ((((dx | dy | dz) & 7) == 0) &&
+            (dx >= -4096) && (dx <= 4088) && (dy >= -4096) && (dy <= 4088) &&
+            (dz >= -4096) && (dz <= 4088))
+        {
+            param = ((dx >> 3) & 0x3FF) | (((dy >> 3) & 0x3FF) << 10)
+                  | (((dz >> 3) & 0x3FF) << 20);
+            NE_DisplayListAddCommand(FIFO_VERTEX_DIFF, &param, 1);
+            goto end;
+        }
+    }
+
+    // If the coordinates don't use the 6 lowest bits, VTX_10 is enough
+    if (((x | y | z) & 0x3F) == 0)
+    {
+        param = ((x >> 6) & 0x3FF) | (((y >> 6) & 0x3FF) << 10)
+              | (((z >> 6) & 0x3FF) << 20);
+        NE_DisplayListAddCommand(FIFO_VERTEX10, &param, 1);
+        goto end;
+    }
+
+    u32 params[2] = {
+        (y << 16) | (x & 0xFFFF),
+        (uint32) (uint16) (z)
+    };
+    NE_DisplayListAddCommand(FIFO_VERTEX16, params, 2);
+
+end:
+    ne_dl_vtx_last[0] = x;
+    ne_dl_vtx_last[1] = y;
+    ne_dl_vtx_last[2] = z;
+    ne_dl_vtx_last_valid = true;
+}
+
+bool NE_DisplayListIsRecording(void)
+{
+    return NE_DisplayListRecording;
+}
+
+void NE_DisplayListDraw(const void *list)
+{
+    NE_AssertPointer(list, "NULL list pointer");
+    glCallList(list);
+}
+
+size_t NE_DisplayListGetSize(const void *list)
+{
+    NE_AssertPointer(list, "NULL list pointer");
+
+    const uint32_t *words = list;
+    return (words[0] + 1) * sizeof(uint32_t);
+}
+
+// Number of parameters of each geometry command, indexed by command ID. Invalid
+// commands are marked as -1.
+static const int8_t ne_dl_command_params[0x80] = {
+    [0x00] = 0,
+    [0x01 ... 0x0F] = -1,
+    [0x10] = 1, [0x11] = 0, [0x12] = 1, [0x13] = 1, [0x14] = 1, [0x15] = 0,
+    [0x16] = 16, [0x17] = 12, [0x18] = 16, [0x19] = 12, [0x1A] = 9,
+    [0x1B] = 3, [0x1C] = 3,
+    [0x1D ... 0x1F] = -1,
+    [0x20] = 1, [0x21] = 1, [0x22] = 1, [0x23] = 2, [0x24] = 1, [0x25] = 1,
+    [0x26] = 1, [0x27] = 1, [0x28] = 1, [0x29] = 1, [0x2A] = 1, [0x2B] = 1,
+    [0x2C ... 0x2F] = -1,
+    [0x30] = 1, [0x31] = 1, [0x32] = 1, [0x33] = 1, [0x34] = 32,
+    [0x35 ... 0x3F] = -1,
+    [0x40] = 1, [0x41] = 0,
+    [0x42 ... 0x4F] = -1,
+    [0x50] = 1,
+    [0x51 ... 0x5F] = -1,
+    [0x60] = 1,
+    [0x61 ... 0x6F] = -1,
+    [0x70] = 3, [0x71] = 2, [0x72] = 1,
+    [0x73 ... 0x7F] = -1,
+};
+
+// Returns the number of polygons generated by a number of vertices sent after a
+// BEGIN_VTXS command of the specified type.
+static int ne_dl_polygons_from_vertices(int type, int vertices)
+{
+    switch (type)
+    {
+        case GL_TRIANGLES:
+            return vertices / 3;
+        case GL_QUADS:
+            return vertices / 4;
+        case GL_TRIANGLE_STRIP:
+            return vertices > 2 ? vertices - 2 : 0;
+        case GL_QUAD_STRIP:
+            return vertices > 2 ? (vertices - 2) / 2 : 0;
+        default:
+            return 0;
+    }
+}
+
+int NE_DisplayListGetCounts(const void *list, int *polygons, int *vertices)
+{
+    NE_AssertPointer(list, "NULL list pointer");
+    NE_AssertPointer(polygons, "NULL polygons pointer");
+    NE_AssertPointer(vertices, "NULL vertices pointer");
+
+    const uint32_t *words = list;
+    const uint32_t *end = words + 1 + words[0];
+    words++;
+
+    int total_polygons = 0;
+    int total_vertices = 0;
+
+    int type = -1;
+    int batch_vertices = 0;
+    int ret = 1;
+
+    while (words < end)
+    {
+        uint32_t header = *words++;
+
+        for (int i = 0; i < 4; i++)
+        {
+            uint32_t cmd = (header >> (i * 8)) & 0xFF;
+
+            int params = (cmd < 0x80) ? ne_dl_command_params[cmd] : -1;
+            if (params < 0)
+            {
+                NE_DebugPrint("Invalid command: 0x%02lX", cmd);
+                ret = 0;
+                goto end;
+            }
+
+            if ((cmd >= 0x23) && (cmd <= 0x28)) // VTX_*
+            {
+                batch_vertices++;
+            }
+            else if ((cmd == 0x40) || (cmd == 0x41)) // BEGIN_VTXS, END_VTXS
+            {
+                total_polygons += ne_dl_polygons_from_vertices(type,
+                                                               batch_vertices);
+                total_vertices += batch_vertices;
+                batch_vertices = 0;
+                type = (cmd == 0x40) ? (int)(words[0] & 3) : -1;
+            }
+
+            words += params;
+        }
+    }
+
+end:
+    total_polygons += ne_dl_polygons_from_vertices(type, batch_vertices);
+    total_vertices += batch_vertices;
+
+    *polygons = total_polygons;
+    *vertices = total_vertices;
+
+    return ret;
+}
+
+// Rotation and scale of an instance, in the same order as NE_ModelDraw()
+typedef struct {
+    int32_t m[3][3]; // Rotation and scale (f32)
+    int32_t n[3][3]; // Rotation (f32), used for normals
+} ne_dl_matrix_t;
+
+static void ne_dl_mat3_mul(int32_t out[3][3], int32_t a[3][3], int32_t b[3][3])
+{
+    for (int i = 0; i < 3; i++)
+    {
+        for (int j = 0; j < 3; j++)
+        {
+            int64_t sum = 0;
+            for (int k = 0; k < 3; k++)
+                sum += (int64_t)a[i][k] * b[k][j];
+            out[i][j] = sum >> 12;
+        }
+    }
+}
+
+static void ne_dl_instance_matrix(const NE_DisplayListInstance *instance,
+                                  ne_dl_matrix_t *mtx)
+{
+    int32_t s, c;
+
+    s = sinLerp(instance->rx << 6);
+    c = cosLerp(instance->rx << 6);
+    int32_t rx[3][3] = {
+        { inttof32(1), 0, 0 },
+        { 0, c, -s },
+        { 0, s, c }
+    };
+
+    s = sinLerp(instance->ry << 6);
+    c = cosLerp(instance->ry << 6);
+    int32_t ry[3][3] = {
+        { c, 0, s },
+        { 0, inttof32(1), 0 },
+        { -s, 0, c }
+    };
+
+    s = sinLerp(instance->rz << 6);
+    c = cosLerp(instance->rz << 6);
+    int32_t rz[3][3] = {
+        { c, -s, 0 },
+        { s, c, 0 },
+        { 0, 0, inttof32(1) }
+    };
+
+    // The vertices are scaled, then rotated by Z, Y and X
+    int32_t rxy[3][3];
+    ne_dl_mat3_mul(rxy, rx, ry);
+    ne_dl_mat3_mul(mtx->n, rxy, rz);
+
+    const int32_t scale[3] = { instance->sx, instance->sy, instance->sz };
+
+    for (int i = 0; i < 3; i++)
+    {
+        for (int j = 0; j < 3; j++)
+            mtx->m[i][j] = mulf32(mtx->n[i][j], scale[j]);
+    }
+}
+
+static inline int32_t ne_dl_sign_extend(uint32_t value, int bits)
+{
+    int shift = 32 - bits;
+    return (int32_t)(value << shift) >> shift;
+}
+
+// Walks the display list of an instance and transforms its vertices. If record
+// is false, it only updates the bounding box of the transformed vertices. If it
+// is true, it adds the commands to the display list that is being recorded,
+// with the vertices moved by -center and divided by 2^shift.
+static int ne_dl_merge_instance(const NE_DisplayListInstance *instance,
+                                int32_t *min, int32_t *max,
+                                const int32_t *center, int shift, bool record)
+{
+    ne_dl_matrix_t mtx;
+    ne_dl_instance_matrix(instance, &mtx);
+
+    const int32_t translation[3] = { instance->x, instance->y, instance->z };
+
+    const uint32_t *words = instance->list;
+    const uint32_t *end = words + 1 + words[0];
+    words++;
+
+    // Last vertex sent in the coordinate system of the original list
+    int32_t vtx[3] = { 0, 0, 0 };
+
+    while (words < end)
+    {
+        uint32_t header = *words++;
+
+        for (int i = 0; i < 4; i++)
+        {
+            uint32_t cmd = (header >> (i * 8)) & 0xFF;
+
+            int params = (cmd < 0x80) ? ne_dl_command_params[cmd] : -1;
+            if (params < 0)
+            {
+                NE_DebugPrint("Invalid command: 0x%02lX", cmd);
+                return 0;
+            }
+
+            if ((cmd >= 0x10) && (cmd <= 0x1C))
+            {
+                NE_DebugPrint("Lists with matrix commands can't be merged");
+                return 0;
+            }
+
+            const uint32_t *p = words;
+            words += params;
+
+            if (cmd == FIFO_NOP)
+                continue;
+
+            if ((cmd >= FIFO_VERTEX16) && (cmd <= FIFO_VERTEX_DIFF))
+            {
+                switch (cmd)
+                {
+                    case FIFO_VERTEX16:
+                        vtx[0] = ne_dl_sign_extend(p[0], 16);
+                        vtx[1] = ne_dl_sign_extend(p[0] >> 16, 16);
+                        vtx[2] = ne_dl_sign_extend(p[1], 16);
+                        break;
+                    case FIFO_VERTEX10:
+                        vtx[0] = ne_dl_sign_extend(p[0], 10) << 6;
+                        vtx[1] = ne_dl_sign_extend(p[0] >> 10, 10) << 6;
+                        vtx[2] = ne_dl_sign_extend(p[0] >> 20, 10) << 6;
+                        break;
+                    case FIFO_VERTEX_XY:
+                        vtx[0] = ne_dl_sign_extend(p[0], 16);
+                        vtx[1] = ne_dl_sign_extend(p[0] >> 16, 16);
+                        break;
+                    case FIFO_VERTEX_XZ:
+                        vtx[0] = ne_dl_sign_extend(p[0], 16);
+                        vtx[2] = ne_dl_sign_extend(p[0] >> 16, 16);
+                        break;
+                    case FIFO_VERTEX_YZ:
+                        vtx[1] = ne_dl_sign_extend(p[0], 16);
+                        vtx[2] = ne_dl_sign_extend(p[0] >> 16, 16);
+                        break;
+                    case FIFO_VERTEX_DIFF:
+                        vtx[0] += ne_dl_sign_extend(p[0], 10) << 3;
+                        vtx[1] += ne_dl_sign_extend(p[0] >> 10, 10) << 3;
+                        vtx[2] += ne_dl_sign_extend(p[0] >> 20, 10) << 3;
+                        break;
+                }
+
+                int32_t out[3];
+                for (int j = 0; j < 3; j++)
+                {
+                    int64_t sum = 0;
+                    for (int k = 0; k < 3; k++)
+                        sum += (int64_t)mtx.m[j][k] * vtx[k];
+                    out[j] = (sum >> 12) + translation[j];
+                }
+
+                if (!record)
+                {
+                    for (int j = 0; j < 3; j++)
+                    {
+                        if (out[j] < min[j])
+                            min[j] = out[j];
+                        if (out[j] > max[j])
+                            max[j] = out[j];
+                    }
+                    continue;
+                }
+
+                int32_t round = (1 << shift) >> 1;
+                for (int j = 0; j < 3; j++)
+                    out[j] = (out[j] - center[j] + round) >> shift;
+
+                NE_DisplayListAddVertexI(out[0], out[1], out[2]);
+                continue;
+            }
+
+            if (!record)
+                continue;
+
+            if (cmd == FIFO_NORMAL)
+            {
+                int32_t n[3] = {
+                    ne_dl_sign_extend(p[0], 10),
+                    ne_dl_sign_extend(p[0] >> 10, 10),
+                    ne_dl_sign_extend(p[0] >> 20, 10)
+                };
+
+                int32_t out[3];
+                for (int j = 0; j < 3; j++)
+                {
+                    int32_t sum = 0;
+                    for (int k = 0; k < 3; k++)
+                        sum += (mtx.n[j][k] * n[k]) >> 12;
+
+                    if (sum < -0x200)
+                        sum = -0x200;
+                    if (sum > 0x1FF)
+                        sum = 0x1FF;
+
+                    out[j] = sum;
+                }
+
+                u32 param = NORMAL_PACK(out[0], out[1], out[2]);
+                NE_DisplayListAddCommand(FIFO_NORMAL, &param, 1);
+                continue;
+            }
+
+            NE_DisplayListAddCommand(cmd, p, params);
+        }
+    }
+
+    return 1;
+}
+
+void *NE_DisplayListMerge(const NE_DisplayListInstance *instances,
+                          int num_instances, int32_t *position, int32_t *scale)
+{
+    NE_AssertPointer(instances, "NULL instances pointer");
+    NE_AssertPointer(position, "NULL position pointer");
+    NE_AssertPointer(scale, "NULL scale pointer");
+    NE_Assert(num_instances > 0, "No instances to merge");
+    NE_Assert(!NE_DisplayListRecording, "Already recording a display list");
+
+    // Calculate the bounding box of all the transformed vertices
+
+    int32_t min[3] = { INT32_MAX, INT32_MAX, INT32_MAX };
+    int32_t max[3] = { INT32_MIN, INT32_MIN, INT32_MIN };
+
+    for (int i = 0; i < num_instances; i++)
+    {
+        if (!ne_dl_merge_instance(&instances[i], min, max, NULL, 0, false))
+            return NULL;
+    }
+
+    // Center the vertices in the bounding box and scale them down by a power
+    // of two so that they fit in a v16
+
+    int32_t center[3] = { 0, 0, 0 };
+    int64_t extent = 0;
+
+    for (int i = 0; i < 3; i++)
+    {
+        if (min[i] > max[i]) // No vertices
+            continue;
+
+        center[i] = min[i] + (int32_t)(((int64_t)max[i] - min[i]) / 2);
+
+        if ((int64_t)max[i] - center[i] > extent)
+            extent = (int64_t)max[i] - center[i];
+        if ((int64_t)center[i] - min[i] > extent)
+            extent = (int64_t)center[i] - min[i];
+    }
+
+    int shift = 0;
+    while (((extent + ((1 << shift) >> 1)) >> shift) > 0x7FFF)
+        shift++;
+
+    // Generate the merged list
+
+    if (NE_DisplayListBegin() == 0)
+        return NULL;
+
+    for (int i = 0; i < num_instances; i++)
+    {
+        if (!ne_dl_merge_instance(&instances[i], NULL, NULL, center, shift,
+                                  true))
+        {
+            free(NE_DisplayListEnd());
+            return NULL;
+        }
+    }
+
+    void *list = NE_DisplayListEnd();
+    if (list == NULL)
+        return NULL;
+
+    for (int i = 0; i < 3; i++)
+        position[i] = center[i];
+
+    *scale = inttof32(1) << shift;
+
+    return list;
+}
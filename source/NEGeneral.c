@@ -374,6 +374,8 @@ void NE_Process(NE_Voidfunc drawscene)
     MATRIX_CONTROL = GL_MODELVIEW;
     MATRIX_IDENTITY = 0;
 
+    NE_ModelBudgetFrameStart();
+
     NE_AssertPointer(drawscene, "NULL function pointer");
     drawscene();
 
@@ -433,6 +435,8 @@ void NE_ProcessDual(NE_Voidfunc mainscreen, NE_Voidfunc subscreen)
 
     MATRIX_IDENTITY = 0;
 
+    NE_ModelBudgetFrameStart();
+
     if (NE_Screen == 1)
         mainscreen();
     else
@@ -480,6 +484,8 @@ static bool NE_effectpause;
 #define NE_NOISEPAUSE_SIZE 512
 static int *ne_noisepause;
 static int ne_cpucount;
+static volatile uint32_t ne_vblcount;
+static uint32_t ne_vblcount_physics;
 static int ne_noise_value = 0xF;
 static int ne_sine_mult = 10, ne_sine_shift = 9;
 
@@ -495,6 +501,9 @@ void NE_VBLFunc(void)
     }
 
     NE_Screen ^= 1;
+
+    // This counter is used by the fixed timestep of the physics engine
+    ne_vblcount++;
 }
 
 void NE_SpecialEffectPause(bool pause)
@@ -593,7 +602,18 @@ void NE_WaitForVBL(NE_UpdateFlags flags)
     if (flags & NE_UPDATE_ANIMATIONS)
         NE_ModelAnimateAll();
     if (flags & NE_UPDATE_PHYSICS)
-        NE_PhysicsUpdateAll();
+    {
+        uint32_t frames = ne_vblcount - ne_vblcount_physics;
+        ne_vblcount_physics += frames;
+
+        // If the physics engine hasn't been updated for a long time, the
+        // number of frames can't be converted to f32. Most of that time would
+        // be dropped by NE_PhysicsAdvanceI() anyway.
+        if (frames > (INT32_MAX >> 12))
+            frames = INT32_MAX >> 12;
+
+        NE_PhysicsAdvanceI(inttof32(frames));
+    }
 
     NE_CPUPercent = div32(ne_cpucount * 100, 263);
     if (flags & NE_CAN_SKIP_VBL)
@@ -16,13 +16,80 @@ typedef struct {
     void *address;
     int uses; // Number of models that use this mesh
     bool has_to_free;
+    int num_polygons; // Polygons drawn by the display list
+    int num_vertices; // Vertices sent by the display list
+    char *path; // Path of the file, only for meshes loaded from the filesystem
+    size_t size; // Size in bytes, only for meshes loaded from the filesystem
+    uint32_t last_used; // Time when the mesh stopped being used
 } ne_mesh_info_t;
 
 static ne_mesh_info_t *NE_Mesh = NULL;
 static NE_Model **NE_ModelPointers;
 static int NE_MAX_MODELS;
+// Compact list of animated models with running animations
+static NE_Model **ne_model_active;
+static int ne_model_active_count;
 static bool ne_model_system_inited = false;
 
+// Max size of the meshes loaded from the filesystem. Meshes that aren't used by
+// any model are kept in RAM until this size is exceeded. If it is 0, they are
+// freed as soon as they stop being used.
+static size_t ne_mesh_cache_budget = 0;
+// Size of all meshes loaded from the filesystem
+static size_t ne_mesh_cache_size = 0;
+// Counter used to find the least recently used meshes
+static uint32_t ne_mesh_cache_time = 0;
+
+static void ne_mesh_free(int slot)
+{
+    ne_mesh_info_t *mesh = &NE_Mesh[slot];
+
+    if (mesh->has_to_free)
+        free(mesh->address);
+
+    if (mesh->path != NULL)
+    {
+        free(mesh->path);
+        mesh->path = NULL;
+        ne_mesh_cache_size -= mesh->size;
+    }
+
+    mesh->address = NULL;
+}
+
+// Frees the least recently used mesh that isn't used by any model. It returns
+// false if there are no meshes that can be freed.
+static bool ne_mesh_cache_evict(void)
+{
+    int slot = NE_NO_MESH;
+
+    for (int i = 0; i < NE_MAX_MODELS; i++)
+    {
+        ne_mesh_info_t *mesh = &NE_Mesh[i];
+
+        if ((mesh->address == NULL) || (mesh->uses > 0))
+            continue;
+
+        if ((slot == NE_NO_MESH) || (mesh->last_used < NE_Mesh[slot].last_used))
+            slot = i;
+    }
+
+    if (slot == NE_NO_MESH)
+        return false;
+
+    ne_mesh_free(slot);
+    return true;
+}
+
+static void ne_mesh_cache_trim(void)
+{
+    while (ne_mesh_cache_size > ne_mesh_cache_budget)
+    {
+        if (!ne_mesh_cache_evict())
+            break;
+    }
+}
+
 static void ne_mesh_delete(int mesh_index)
 {
     int slot = mesh_index;
@@ -30,81 +97,540 @@ static void ne_mesh_delete(int mesh_index)
     // A mesh may be used by several models
     NE_Mesh[slot].uses--;
 
-    // If the number of users is zero, delete it.
+    // If the number of users is zero, delete it. Meshes loaded from the
+    // filesystem are kept in the cache if there is a budget for them.
     if (NE_Mesh[slot].uses == 0)
     {
-        if (NE_Mesh[slot].has_to_free)
-            free(NE_Mesh[slot].address);
-
-        NE_Mesh[slot].address = NULL;
+        if ((NE_Mesh[slot].path != NULL) && (ne_mesh_cache_budget > 0))
+        {
+            NE_Mesh[slot].last_used = ne_mesh_cache_time++;
+            ne_mesh_cache_trim();
+        }
+        else
+        {
+            ne_mesh_free(slot);
+        }
     }
 }
 
 static int ne_model_get_free_mesh_slot(void)
 {
-    // Get free slot
+    while (1)
+    {
+        // Get free slot
+        for (int i = 0; i < NE_MAX_MODELS; i++)
+        {
+            if (NE_Mesh[i].address == NULL)
+                return i;
+        }
+
+        // If there are no free slots, free meshes that aren't used
+        if (!ne_mesh_cache_evict())
+            break;
+    }
+
+    NE_DebugPrint("No free slots");
+    return NE_NO_MESH;
+}
+
+// Returns the slot of a mesh loaded from the filesystem, or NE_NO_MESH if it
+// hasn't been loaded.
+static int ne_mesh_cache_find(const char *path)
+{
     for (int i = 0; i < NE_MAX_MODELS; i++)
     {
-        if (NE_Mesh[i].address == NULL)
+        ne_mesh_info_t *mesh = &NE_Mesh[i];
+
+        if ((mesh->address == NULL) || (mesh->path == NULL))
+            continue;
+
+        if (strcmp(mesh->path, path) == 0)
             return i;
     }
 
-    NE_DebugPrint("No free slots");
     return NE_NO_MESH;
 }
 
-static int ne_model_load_ram_common(NE_Model *model, const void *pointer)
+static void ne_mesh_update_counts(ne_mesh_info_t *mesh)
+{
+    // DSM files may be split in several sub-meshes, each one with its own
+    // display list. Static meshes are a single display list.
+    mesh->num_polygons = 0;
+    mesh->num_vertices = 0;
+
+    uint32_t num_submeshes = DSMA_GetNumSubmeshes(mesh->address);
+
+    for (uint32_t i = 0; i < num_submeshes; i++)
+    {
+        int polygons, vertices;
+        NE_DisplayListGetCounts(DSMA_GetSubmeshDisplayList(mesh->address, i),
+                                &polygons, &vertices);
+        mesh->num_polygons += polygons;
+        mesh->num_vertices += vertices;
+    }
+}
+
+static int ne_model_load_ram_common(int *meshindex, const void *pointer)
 {
-    NE_AssertPointer(model, "NULL model pointer");
     NE_AssertPointer(pointer, "NULL data pointer");
 
     // Check if a mesh exists
-    if (model->meshindex != NE_NO_MESH)
-        ne_mesh_delete(model->meshindex);
+    if (*meshindex != NE_NO_MESH)
+    {
+        ne_mesh_delete(*meshindex);
+        *meshindex = NE_NO_MESH;
+    }
 
     int slot = ne_model_get_free_mesh_slot();
     if (slot == NE_NO_MESH)
         return 0;
 
-    model->meshindex = slot;
+    *meshindex = slot;
 
     ne_mesh_info_t *mesh = &NE_Mesh[slot];
 
     mesh->address = (void *)pointer;
     mesh->has_to_free = false;
     mesh->uses = 1;
+    mesh->path = NULL;
+
+    ne_mesh_update_counts(mesh);
 
     return 1;
 }
 
-static int ne_model_load_filesystem_common(NE_Model *model, const char *path)
+static int ne_model_load_filesystem_common(int *meshindex, const char *path)
 {
-    NE_AssertPointer(model, "NULL model pointer");
     NE_AssertPointer(path, "NULL path pointer");
 
+    // If the file has already been loaded, reuse it
+    int cached = ne_mesh_cache_find(path);
+    if (cached != NE_NO_MESH)
+    {
+        // Increase the count of users before releasing the old mesh in case it
+        // is the same one.
+        NE_Mesh[cached].uses++;
+
+        if (*meshindex != NE_NO_MESH)
+            ne_mesh_delete(*meshindex);
+
+        *meshindex = cached;
+        return 1;
+    }
+
     // Check if a mesh exists
-    if (model->meshindex != NE_NO_MESH)
-        ne_mesh_delete(model->meshindex);
+    if (*meshindex != NE_NO_MESH)
+    {
+        ne_mesh_delete(*meshindex);
+        *meshindex = NE_NO_MESH;
+    }
 
     int slot = ne_model_get_free_mesh_slot();
     if (slot == NE_NO_MESH)
         return 0;
 
+    char *path_copy = strdup(path);
+    if (path_copy == NULL)
+    {
+        NE_DebugPrint("Not enough memory");
+        return 0;
+    }
+
+    // The size of the file is used instead of the size of the display list
+    // because DSM files may be split in several sub-meshes.
+    size_t size = NE_FATFileSize(path);
+    if ((size == (size_t)-1) || (size == 0))
+    {
+        NE_DebugPrint("Couldn't obtain file size");
+        free(path_copy);
+        return 0;
+    }
+
     void *pointer = NE_FATLoadData(path);
     if (pointer == NULL)
+    {
+        free(path_copy);
         return 0;
+    }
 
-    model->meshindex = slot;
+    *meshindex = slot;
 
     ne_mesh_info_t *mesh = &NE_Mesh[slot];
 
     mesh->address = pointer;
     mesh->has_to_free = true;
     mesh->uses = 1;
+    mesh->path = path_copy;
+    mesh->size = size;
+
+    ne_mesh_cache_size += mesh->size;
+
+    ne_mesh_update_counts(mesh);
+
+    // Make room for the new mesh if the cache is over budget
+    if (ne_mesh_cache_budget > 0)
+        ne_mesh_cache_trim();
 
     return 1;
 }
 
+void NE_ModelMeshCacheSetBudget(size_t size)
+{
+    ne_mesh_cache_budget = size;
+
+    if (!ne_model_system_inited)
+        return;
+
+    if (ne_mesh_cache_budget == 0)
+        NE_ModelMeshCacheFlush();
+    else
+        ne_mesh_cache_trim();
+}
+
+void NE_ModelMeshCacheFlush(void)
+{
+    if (!ne_model_system_inited)
+        return;
+
+    while (ne_mesh_cache_evict())
+        ;
+}
+
+size_t NE_ModelMeshCacheGetSize(void)
+{
+    return ne_mesh_cache_size;
+}
+
+// Returns a pointer to the mesh index of the specified LOD level of a model.
+// Level 0 is the main mesh of the model.
+static int *ne_model_lod_get_meshindex(NE_Model *model, int level)
+{
+    NE_AssertPointer(model, "NULL model pointer");
+
+    if (level == 0)
+        return &model->meshindex;
+
+    if ((level < 0) || (level >= NE_MODEL_MAX_LOD_LEVELS))
+    {
+        NE_DebugPrint("Invalid LOD level: %d", level);
+        return NULL;
+    }
+
+    if (model->lod == NULL)
+    {
+        NE_ModelLOD *lod = calloc(1, sizeof(NE_ModelLOD));
+        if (lod == NULL)
+        {
+            NE_DebugPrint("Not enough memory");
+            return NULL;
+        }
+
+        for (int i = 0; i < NE_MODEL_MAX_LOD_LEVELS; i++)
+            lod->meshindex[i] = NE_NO_MESH;
+
+        lod->hysteresis = NE_MODEL_LOD_DEFAULT_HYSTERESIS;
+
+        model->lod = lod;
+    }
+
+    return &model->lod->meshindex[level];
+}
+
+static void ne_model_lod_delete(NE_Model *model)
+{
+    if (model->lod == NULL)
+        return;
+
+    for (int i = 1; i < NE_MODEL_MAX_LOD_LEVELS; i++)
+    {
+        if (model->lod->meshindex[i] != NE_NO_MESH)
+            ne_mesh_delete(model->lod->meshindex[i]);
+    }
+
+    free(model->lod);
+    model->lod = NULL;
+}
+
+static void ne_model_anim_lod_delete(NE_Model *model)
+{
+    if (model->anim_lod == NULL)
+        return;
+
+    free(model->anim_lod->matrices);
+    free(model->anim_lod);
+    model->anim_lod = NULL;
+}
+
+// Forces the saved pose of a model to be updated the next time it is drawn
+static void ne_model_anim_lod_reset(NE_Model *model)
+{
+    if (model->anim_lod != NULL)
+    {
+        model->anim_lod->frames_left = 0;
+        model->anim_lod->num_joints = 0;
+    }
+}
+
+// Returns true if any of the animations of the model is running.
+static bool ne_model_anim_is_running(const NE_Model *model)
+{
+    for (int i = 0; i < NE_MODEL_MAX_ANIM_LAYERS; i++)
+    {
+        if (model->animinfo[i]->speed != 0)
+            return true;
+    }
+
+    return false;
+}
+
+static void ne_model_active_remove(NE_Model *model)
+{
+    int index = model->anim_active;
+    if (index < 0)
+        return;
+
+    // Move the last model of the list to the free slot
+    NE_Model *last = ne_model_active[--ne_model_active_count];
+    ne_model_active[index] = last;
+    last->anim_active = index;
+
+    model->anim_active = -1;
+}
+
+// Adds the model to the list of active models or removes it from the list,
+// depending on whether its animations are running or not.
+static void ne_model_active_update(NE_Model *model)
+{
+    if (model->modeltype != NE_Animated)
+        return;
+
+    if (ne_model_anim_is_running(model))
+    {
+        if (model->anim_active < 0)
+        {
+            model->anim_active = ne_model_active_count;
+            ne_model_active[ne_model_active_count++] = model;
+        }
+    }
+    else
+    {
+        ne_model_active_remove(model);
+    }
+}
+
+// Number of free polygons below which models are drawn with one less LOD level
+static int ne_model_lod_polygon_margin = 0;
+
+// Polygon and vertex budget of the current frame
+static int ne_budget_max_polygons = 0;
+static int ne_budget_max_vertices = 0;
+static NE_ModelBudgetStats ne_budget_frame;
+static NE_ModelBudgetStats ne_budget_last_frame;
+
+// Animation statistics since the last call to NE_ModelAnimGetStats()
+static NE_ModelAnimStats ne_anim_stats;
+
+// Phase given to the next model that uses animation LOD
+static int ne_anim_lod_next_phase = 0;
+
+// From NECamera.c
+extern const NE_Camera *NE_CameraLastUsed;
+
+// Returns the mesh index of a LOD level. It returns NE_NO_MESH if the level
+// doesn't have a mesh.
+static int ne_model_lod_get_mesh(const NE_Model *model, int level)
+{
+    if (level == 0)
+        return model->meshindex;
+
+    if ((model->lod == NULL) || (level >= NE_MODEL_MAX_LOD_LEVELS))
+        return NE_NO_MESH;
+
+    return model->lod->meshindex[level];
+}
+
+// Returns the number of polygons drawn in the current frame. If the budget is
+// enabled it returns the projected number, if not it reads the hardware
+// counter. The hardware counter may be a bit behind because this doesn't wait
+// for the geometry engine to be idle.
+static int ne_model_frame_polygons(void)
+{
+    if (ne_budget_max_polygons > 0)
+        return ne_budget_frame.polygons;
+
+    return GFX_POLYGON_RAM_USAGE;
+}
+
+// Returns the squared distance from the last camera used to the model. The
+// values are in f32 format, so the result needs 64 bits.
+static int64_t ne_model_camera_distance2(const NE_Model *model)
+{
+    const int32_t *from = NE_CameraLastUsed->from;
+    int64_t dx = model->x - from[0];
+    int64_t dy = model->y - from[1];
+    int64_t dz = model->z - from[2];
+    return dx * dx + dy * dy + dz * dz;
+}
+
+// Returns the LOD level that has to be drawn for this model, and it updates the
+// current LOD level of the model.
+static int ne_model_lod_select(const NE_Model *model)
+{
+    NE_ModelLOD *lod = model->lod;
+
+    if ((lod == NULL) || (NE_CameraLastUsed == NULL))
+        return 0;
+
+    int64_t dist2 = ne_model_camera_distance2(model);
+
+    int level = lod->current;
+
+    // Move to less detailed levels as soon as their distance is reached
+    while (level < NE_MODEL_MAX_LOD_LEVELS - 1)
+    {
+        int next = level + 1;
+        if (lod->meshindex[next] == NE_NO_MESH)
+            break;
+
+        int64_t d = lod->distance[next];
+        if (dist2 < d * d)
+            break;
+
+        level = next;
+    }
+
+    // Move to more detailed levels only if the model is closer than the
+    // distance of the current level minus the hysteresis margin
+    while (level > 0)
+    {
+        int64_t d = lod->distance[level] - lod->hysteresis;
+        if (d < 0)
+            d = 0;
+        if (dist2 >= d * d)
+            break;
+
+        level--;
+    }
+
+    lod->current = level;
+
+    // If the polygon RAM is almost full, drop one extra level.
+    if (ne_model_lod_polygon_margin > 0)
+    {
+        if ((2048 - ne_model_frame_polygons()) < ne_model_lod_polygon_margin)
+        {
+            if (ne_model_lod_get_mesh(model, level + 1) != NE_NO_MESH)
+                level++;
+        }
+    }
+
+    return level;
+}
+
+// Checks if the selected LOD level of a model fits in the budget of the frame.
+// It returns the level to draw (which may be less detailed than the requested
+// one for low priority models), or -1 if the model must not be drawn.
+static int ne_model_budget_check(const NE_Model *model, int level)
+{
+    NE_ModelBudgetStats *frame = &ne_budget_frame;
+
+    if ((ne_budget_max_polygons == 0) && (ne_budget_max_vertices == 0))
+        return level;
+
+    int max_polygons = ne_budget_max_polygons > 0 ?
+                       ne_budget_max_polygons : INT32_MAX;
+    int max_vertices = ne_budget_max_vertices > 0 ?
+                       ne_budget_max_vertices : INT32_MAX;
+
+    int first_level = level;
+
+    while (1)
+    {
+        int meshindex = ne_model_lod_get_mesh(model, level);
+        if (meshindex == NE_NO_MESH)
+            break;
+
+        ne_mesh_info_t *mesh = &NE_Mesh[meshindex];
+
+        int polygons = frame->polygons + mesh->num_polygons;
+        int vertices = frame->vertices + mesh->num_vertices;
+
+        bool fits = (polygons <= max_polygons) && (vertices <= max_vertices);
+
+        // High priority models are always drawn. Low priority models are only
+        // drawn if they fit in the budget.
+        if (fits || (model->priority == NE_PRIORITY_HIGH))
+        {
+            frame->polygons = polygons;
+            frame->vertices = vertices;
+            frame->draws++;
+            if (level != first_level)
+                frame->downgraded++;
+            return level;
+        }
+
+        // Try with a less detailed level
+        level++;
+    }
+
+    if (frame->rejected < NE_MODEL_BUDGET_MAX_REJECTED)
+        frame->rejected_models[frame->rejected] = model;
+    frame->rejected++;
+
+    return -1;
+}
+
+void NE_ModelBudgetSet(int max_polygons, int max_vertices)
+{
+    NE_AssertMinMax(0, max_polygons, 2048, "Invalid polygon budget");
+    NE_AssertMinMax(0, max_vertices, 6144, "Invalid vertex budget");
+
+    ne_budget_max_polygons = max_polygons;
+    ne_budget_max_vertices = max_vertices;
+}
+
+void NE_ModelBudgetAdd(int polygons, int vertices)
+{
+    ne_budget_frame.polygons += polygons;
+    ne_budget_frame.vertices += vertices;
+}
+
+void NE_ModelBudgetFrameStart(void)
+{
+    ne_budget_last_frame = ne_budget_frame;
+    memset(&ne_budget_frame, 0, sizeof(ne_budget_frame));
+}
+
+void NE_ModelBudgetGetStats(NE_ModelBudgetStats *stats)
+{
+    NE_AssertPointer(stats, "NULL pointer");
+    *stats = ne_budget_last_frame;
+}
+
+void NE_ModelSetPriority(NE_Model *model, NE_ModelPriority priority)
+{
+    NE_AssertPointer(model, "NULL model pointer");
+    model->priority = priority;
+}
+
+void NE_ModelGetMeshInfo(const NE_Model *model, int *polygons, int *vertices)
+{
+    NE_AssertPointer(model, "NULL model pointer");
+    NE_AssertPointer(polygons, "NULL polygons pointer");
+    NE_AssertPointer(vertices, "NULL vertices pointer");
+
+    if (model->meshindex == NE_NO_MESH)
+    {
+        *polygons = 0;
+        *vertices = 0;
+        return;
+    }
+
+    ne_mesh_info_t *mesh = &NE_Mesh[model->meshindex];
+    *polygons = mesh->num_polygons;
+    *vertices = mesh->num_vertices;
+}
+
 //--------------------------------------------------------------------------
 
 NE_Model *NE_ModelCreate(NE_ModelType type)
@@ -143,10 +669,11 @@ NE_Model *NE_ModelCreate(NE_ModelType type)
 
     model->modeltype = type;
     model->meshindex = NE_NO_MESH;
+    model->anim_active = -1;
 
     if (type == NE_Animated)
     {
-        for (int i = 0; i < 2; i++)
+        for (int i = 0; i < NE_MODEL_MAX_ANIM_LAYERS; i++)
         {
             model->animinfo[i] = calloc(sizeof(NE_AnimInfo), 1);
             NE_AssertPointer(model->animinfo[i],
@@ -154,100 +681,659 @@ NE_Model *NE_ModelCreate(NE_ModelType type)
         }
     }
 
-    return model;
-}
-
-void NE_ModelDelete(NE_Model *model)
-{
-    if (!ne_model_system_inited)
-        return;
+    return model;
+}
+
+void NE_ModelDelete(NE_Model *model)
+{
+    if (!ne_model_system_inited)
+        return;
+
+    NE_AssertPointer(model, "NULL pointer");
+
+    int i = 0;
+    while (1)
+    {
+        if (i == NE_MAX_MODELS)
+        {
+            NE_DebugPrint("Model not found");
+            return;
+        }
+        if (NE_ModelPointers[i] == model)
+        {
+            NE_ModelPointers[i] = NULL;
+            break;
+        }
+        i++;
+    }
+
+    if (model->modeltype == NE_Animated)
+    {
+        ne_model_active_remove(model);
+
+        for (int i = 0; i < NE_MODEL_MAX_ANIM_LAYERS; i++)
+            free(model->animinfo[i]);
+    }
+
+    // If there is an asigned mesh
+    if (model->meshindex != NE_NO_MESH)
+        ne_mesh_delete(model->meshindex);
+
+    ne_model_lod_delete(model);
+    ne_model_anim_lod_delete(model);
+
+    free(model);
+}
+
+int NE_ModelLoadStaticMeshFAT(NE_Model *model, const char *path)
+{
+    if (!ne_model_system_inited)
+        return 0;
+
+    NE_AssertPointer(model, "NULL model pointer");
+    NE_Assert(model->modeltype == NE_Static, "Not a static model");
+
+    return ne_model_load_filesystem_common(&model->meshindex, path);
+}
+
+int NE_ModelLoadStaticMesh(NE_Model *model, const void *pointer)
+{
+    if (!ne_model_system_inited)
+        return 0;
+
+    NE_AssertPointer(model, "NULL model pointer");
+    NE_Assert(model->modeltype == NE_Static, "Not a static model");
+
+    return ne_model_load_ram_common(&model->meshindex, pointer);
+}
+
+int NE_ModelLoadStaticMeshLODFAT(NE_Model *model, int level, const char *path)
+{
+    if (!ne_model_system_inited)
+        return 0;
+
+    NE_AssertPointer(model, "NULL model pointer");
+    NE_Assert(model->modeltype == NE_Static, "Not a static model");
+
+    int *meshindex = ne_model_lod_get_meshindex(model, level);
+    if (meshindex == NULL)
+        return 0;
+
+    return ne_model_load_filesystem_common(meshindex, path);
+}
+
+int NE_ModelLoadStaticMeshLOD(NE_Model *model, int level, const void *pointer)
+{
+    if (!ne_model_system_inited)
+        return 0;
+
+    NE_AssertPointer(model, "NULL model pointer");
+    NE_Assert(model->modeltype == NE_Static, "Not a static model");
+
+    int *meshindex = ne_model_lod_get_meshindex(model, level);
+    if (meshindex == NULL)
+        return 0;
+
+    return ne_model_load_ram_common(meshindex, pointer);
+}
+
+void NE_ModelSetLODDistanceI(NE_Model *model, int level, int32_t distance)
+{
+    NE_AssertPointer(model, "NULL model pointer");
+    NE_AssertMinMax(1, level, NE_MODEL_MAX_LOD_LEVELS - 1,
+                    "Invalid LOD level: %d", level);
+    NE_Assert(distance >= 0, "Distance must be positive");
+
+    if (ne_model_lod_get_meshindex(model, level) == NULL)
+        return;
+
+    model->lod->distance[level] = distance;
+}
+
+void NE_ModelSetLODHysteresisI(NE_Model *model, int32_t margin)
+{
+    NE_AssertPointer(model, "NULL model pointer");
+    NE_Assert(margin >= 0, "Margin must be positive");
+
+    // Make sure that the LOD information has been allocated
+    if (ne_model_lod_get_meshindex(model, 1) == NULL)
+        return;
+
+    model->lod->hysteresis = margin;
+}
+
+int NE_ModelGetLODLevel(const NE_Model *model)
+{
+    NE_AssertPointer(model, "NULL model pointer");
+
+    if (model->lod == NULL)
+        return 0;
+
+    return model->lod->current;
+}
+
+void NE_ModelLODSetPolygonMargin(int margin)
+{
+    NE_AssertMinMax(0, margin, 2048, "Invalid margin: %d", margin);
+    ne_model_lod_polygon_margin = margin;
+}
+
+void NE_ModelFreeMeshWhenDeleted(NE_Model *model)
+{
+    NE_AssertPointer(model, "NULL model pointer");
+    if (model->meshindex != NE_NO_MESH)
+    {
+        ne_mesh_info_t *mesh = &NE_Mesh[model->meshindex];
+        mesh->has_to_free = true;
+    }
+}
+
+void NE_ModelAnimSetLODI(NE_Model *model, int32_t snap_distance,
+                         int32_t update_distance, int update_period)
+{
+    NE_AssertPointer(model, "NULL model pointer");
+    NE_Assert(model->modeltype == NE_Animated, "Not an animated model");
+    NE_Assert((snap_distance >= 0) && (update_distance >= 0),
+              "Distance must be positive");
+    NE_Assert(update_period >= 1, "Invalid update period");
+
+    if (model->anim_lod == NULL)
+    {
+        model->anim_lod = calloc(1, sizeof(NE_ModelAnimLOD));
+        if (model->anim_lod == NULL)
+        {
+            NE_DebugPrint("Not enough memory");
+            return;
+        }
+    }
+
+    NE_ModelAnimLOD *anim_lod = model->anim_lod;
+
+    anim_lod->snap_distance = snap_distance;
+    anim_lod->update_distance = update_distance;
+    anim_lod->update_period = update_period;
+    anim_lod->frames_left = 0;
+    anim_lod->num_joints = 0;
+    anim_lod->phase = ne_anim_lod_next_phase++;
+}
+
+void NE_ModelAnimGetStats(NE_ModelAnimStats *stats)
+{
+    NE_AssertPointer(stats, "NULL stats pointer");
+
+    *stats = ne_anim_stats;
+    memset(&ne_anim_stats, 0, sizeof(ne_anim_stats));
+}
+
+void NE_ModelSetMaterial(NE_Model *model, NE_Material *material)
+{
+    NE_AssertPointer(model, "NULL model pointer");
+    NE_AssertPointer(material, "NULL material pointer");
+    model->texture = material;
+}
+
+void NE_ModelSetAnimation(NE_Model *model, NE_Animation *anim)
+{
+    NE_AssertPointer(model, "NULL model pointer");
+    NE_AssertPointer(anim, "NULL animation pointer");
+    NE_Assert(model->modeltype == NE_Animated, "Not an animated model");
+    model->animinfo[0]->animation = anim;
+    uint32_t frames = DSMA_GetNumFrames(anim->data);
+    model->animinfo[0]->numframes = frames;
+    ne_model_anim_lod_reset(model);
+}
+
+void NE_ModelSetAnimationSecondary(NE_Model *model, NE_Animation *anim)
+{
+    NE_AssertPointer(model, "NULL model pointer");
+    NE_AssertPointer(anim, "NULL animation pointer");
+    NE_Assert(model->modeltype == NE_Animated, "Not an animated model");
+    model->animinfo[1]->animation = anim;
+    uint32_t frames = DSMA_GetNumFrames(anim->data);
+    model->animinfo[1]->numframes = frames;
+    ne_model_anim_lod_reset(model);
+}
+
+// Cache of skeleton poses. Models that use the same animations at the same
+// frames can share the joint matrices instead of calculating them every time.
+typedef struct {
+    bool valid;
+    const void *dsa[2]; // DSA files (the second one is NULL if not blending)
+    int32_t frame[2];   // Frames of each DSA file
+    int32_t blend;      // Blending factor
+    uint32_t last_used; // Time when the entry was used for the last time
+    int num_joints;
+    int max_joints;     // Size of the matrices buffer in joints
+    int32_t *matrices;
+} ne_pose_cache_entry_t;
+
+static ne_pose_cache_entry_t *ne_pose_cache = NULL;
+static int ne_pose_cache_size = NE_DEFAULT_POSE_CACHE_SIZE;
+static uint32_t ne_pose_cache_time = 0;
+static int ne_pose_cache_hits = 0;
+static int ne_pose_cache_misses = 0;
+
+static void ne_pose_cache_free(void)
+{
+    if (ne_pose_cache == NULL)
+        return;
+
+    for (int i = 0; i < ne_pose_cache_size; i++)
+        free(ne_pose_cache[i].matrices);
+
+    free(ne_pose_cache);
+    ne_pose_cache = NULL;
+}
+
+// Invalidates all entries that use a DSA file. This is called by the animation
+// system when the data of an animation is deleted or replaced.
+void ne_model_pose_cache_invalidate(const void *dsa)
+{
+    if ((ne_pose_cache == NULL) || (dsa == NULL))
+        return;
+
+    for (int i = 0; i < ne_pose_cache_size; i++)
+    {
+        ne_pose_cache_entry_t *entry = &ne_pose_cache[i];
+        if ((entry->dsa[0] == dsa) || (entry->dsa[1] == dsa))
+            entry->valid = false;
+    }
+}
+
+void ne_model_pose_cache_invalidate_all(void)
+{
+    if (ne_pose_cache == NULL)
+        return;
+
+    for (int i = 0; i < ne_pose_cache_size; i++)
+        ne_pose_cache[i].valid = false;
+}
+
+// Returns true if the model uses any of the extra animation layers.
+static bool ne_model_has_extra_layers(const NE_Model *model)
+{
+    for (int i = 2; i < NE_MODEL_MAX_ANIM_LAYERS; i++)
+    {
+        if (model->animinfo[i]->animation != NULL)
+            return true;
+    }
+
+    return false;
+}
+
+// Fills an array of DSMA layers with all the animations of a model at the
+// specified frames. The main and secondary animations are blended with the
+// blending factor of the model, and the extra layers use their own weights. It
+// returns the number of layers.
+static int ne_model_get_layers(const NE_Model *model, const int32_t *frame,
+                               DSMA_Layer *layers)
+{
+    int num_layers = 0;
+    int32_t blend = 0;
+
+    if (model->animinfo[1]->animation != NULL)
+        blend = model->anim_blend;
+
+    for (int i = 0; i < NE_MODEL_MAX_ANIM_LAYERS; i++)
+    {
+        const NE_AnimInfo *animinfo = model->animinfo[i];
+        if (animinfo->animation == NULL)
+            continue;
+
+        DSMA_Layer *layer = &layers[num_layers++];
+
+        layer->dsa_file = animinfo->animation->data;
+        layer->frame_interp = frame[i];
+
+        if (i == 0)
+            layer->weight = inttof32(1) - blend;
+        else if (i == 1)
+            layer->weight = blend;
+        else
+            layer->weight = animinfo->weight;
+
+        layer->additive = (i >= 2) && animinfo->additive;
+    }
+
+    return num_layers;
+}
+
+// Makes sure that a pose buffer can hold the specified number of joints, and
+// enlarges it if it can't. It returns false if there isn't enough memory.
+static bool ne_model_pose_buffer_reserve(int32_t **matrices, int *max_joints,
+                                         int num_joints)
+{
+    if (num_joints <= *max_joints)
+        return true;
+
+    size_t size = num_joints * DSMA_POSE_MATRIX_SIZE * sizeof(int32_t);
+    int32_t *buffer = realloc(*matrices, size);
+    if (buffer == NULL)
+    {
+        NE_DebugPrint("Not enough memory");
+        return false;
+    }
+
+    *matrices = buffer;
+    *max_joints = num_joints;
+    return true;
+}
+
+// Calculates the pose of an animated model with its animations at the
+// specified frames. The pose is stored in a buffer that is enlarged if it is
+// too small for the skeleton. It returns the number of joints, or 0 on error.
+static int ne_model_compute_pose(const NE_Model *model, const int32_t *frame,
+                                 int32_t **matrices, int *max_joints)
+{
+    const void *dsa_0 = model->animinfo[0]->animation->data;
+
+    int num_joints = DSMA_GetNumJoints(dsa_0);
+    if (!ne_model_pose_buffer_reserve(matrices, max_joints, num_joints))
+        return 0;
+
+    int ret;
+    if (ne_model_has_extra_layers(model))
+    {
+        DSMA_Layer layers[NE_MODEL_MAX_ANIM_LAYERS];
+        int num_layers = ne_model_get_layers(model, frame, layers);
+        ret = DSMA_ComputePoseLayers(*matrices, layers, num_layers);
+    }
+    else if (model->animinfo[1]->animation == NULL)
+    {
+        ret = DSMA_ComputePose(dsa_0, frame[0], *matrices);
+    }
+    else
+    {
+        ret = DSMA_ComputePoseBlendAnimation(*matrices,
+                dsa_0, frame[0],
+                model->animinfo[1]->animation->data, frame[1],
+                model->anim_blend);
+    }
+
+    if (ret != DSMA_SUCCESS)
+        return 0;
+
+    ne_anim_stats.joints_evaluated += num_joints;
+
+    return num_joints;
+}
+
+// Returns the pose of an animated model with its animations at the specified
+// frames, calculating it if it isn't in the cache. It returns NULL if the cache
+// is disabled or if there has been an error, so the model must be drawn without
+// the cache.
+static const ne_pose_cache_entry_t *ne_pose_cache_get(const NE_Model *model,
+                                                      const int32_t *frames)
+{
+    if (ne_pose_cache_size == 0)
+        return NULL;
+
+    // Poses with extra animation layers aren't cached
+    if (ne_model_has_extra_layers(model))
+        return NULL;
+
+    if (ne_pose_cache == NULL)
+    {
+        ne_pose_cache = calloc(ne_pose_cache_size,
+                               sizeof(ne_pose_cache_entry_t));
+        if (ne_pose_cache == NULL)
+        {
+            NE_DebugPrint("Not enough memory");
+            return NULL;
+        }
+    }
+
+    const void *dsa[2] = { model->animinfo[0]->animation->data, NULL };
+    int32_t frame[2] = { frames[0], 0 };
+    int32_t blend = 0;
+
+    if (model->animinfo[1]->animation != NULL)
+    {
+        dsa[1] = model->animinfo[1]->animation->data;
+        frame[1] = frames[1];
+        blend = model->anim_blend;
+    }
+
+    // Look for the pose in the cache, and for the least recently used entry in
+    // case it isn't there.
 
-    NE_AssertPointer(model, "NULL pointer");
+    ne_pose_cache_entry_t *lru = &ne_pose_cache[0];
 
-    int i = 0;
-    while (1)
+    for (int i = 0; i < ne_pose_cache_size; i++)
     {
-        if (i == NE_MAX_MODELS)
+        ne_pose_cache_entry_t *entry = &ne_pose_cache[i];
+
+        if (!entry->valid)
         {
-            NE_DebugPrint("Model not found");
-            return;
+            if (lru->valid)
+                lru = entry;
+            continue;
         }
-        if (NE_ModelPointers[i] == model)
+
+        if ((entry->dsa[0] == dsa[0]) && (entry->frame[0] == frame[0]) &&
+            (entry->dsa[1] == dsa[1]) && (entry->frame[1] == frame[1]) &&
+            (entry->blend == blend))
         {
-            NE_ModelPointers[i] = NULL;
-            break;
+            entry->last_used = ne_pose_cache_time++;
+            ne_pose_cache_hits++;
+            return entry;
         }
-        i++;
-    }
 
-    if (model->modeltype == NE_Animated)
-    {
-        for (int i = 0; i < 2; i++)
-            free(model->animinfo[i]);
+        if (lru->valid && (entry->last_used < lru->last_used))
+            lru = entry;
     }
 
-    // If there is an asigned mesh
-    if (model->meshindex != NE_NO_MESH)
-        ne_mesh_delete(model->meshindex);
+    // Calculate the pose in the least recently used entry
 
-    free(model);
+    ne_pose_cache_entry_t *entry = lru;
+    entry->valid = false;
+
+    int num_joints = ne_model_compute_pose(model, frame, &entry->matrices,
+                                           &entry->max_joints);
+    if (num_joints == 0)
+        return NULL;
+
+    entry->valid = true;
+    entry->dsa[0] = dsa[0];
+    entry->dsa[1] = dsa[1];
+    entry->frame[0] = frame[0];
+    entry->frame[1] = frame[1];
+    entry->blend = blend;
+    entry->num_joints = num_joints;
+    entry->last_used = ne_pose_cache_time++;
+
+    ne_pose_cache_misses++;
+
+    return entry;
 }
 
-int NE_ModelLoadStaticMeshFAT(NE_Model *model, const char *path)
+void NE_ModelPoseCacheSetSize(int entries)
 {
-    if (!ne_model_system_inited)
-        return 0;
+    NE_Assert(entries >= 0, "Invalid number of entries");
 
-    NE_Assert(model->modeltype == NE_Static, "Not a static model");
-
-    return ne_model_load_filesystem_common(model, path);
+    ne_pose_cache_free();
+    ne_pose_cache_size = entries;
 }
 
-int NE_ModelLoadStaticMesh(NE_Model *model, const void *pointer)
+void NE_ModelPoseCacheGetStats(int *hits, int *misses)
 {
-    if (!ne_model_system_inited)
-        return 0;
+    NE_AssertPointer(hits, "NULL hits pointer");
+    NE_AssertPointer(misses, "NULL misses pointer");
 
-    NE_Assert(model->modeltype == NE_Static, "Not a static model");
+    *hits = ne_pose_cache_hits;
+    *misses = ne_pose_cache_misses;
 
-    return ne_model_load_ram_common(model, pointer);
+    ne_pose_cache_hits = 0;
+    ne_pose_cache_misses = 0;
 }
 
-void NE_ModelFreeMeshWhenDeleted(NE_Model *model)
+// Returns true if the model is further from the camera than the specified
+// animation LOD distance, taking the scale of the model into account.
+static bool ne_model_anim_lod_far(const NE_Model *model, int32_t distance,
+                                  int64_t dist2)
 {
-    NE_AssertPointer(model, "NULL model pointer");
-    if (model->meshindex != NE_NO_MESH)
-    {
-        ne_mesh_info_t *mesh = &NE_Mesh[model->meshindex];
-        mesh->has_to_free = true;
-    }
+    if ((distance == 0) || (dist2 < 0))
+        return false;
+
+    int32_t scale = abs(model->sx);
+    if (abs(model->sy) > scale)
+        scale = abs(model->sy);
+    if (abs(model->sz) > scale)
+        scale = abs(model->sz);
+
+    int64_t d = ((int64_t)distance * scale) >> 12;
+    return dist2 >= d * d;
 }
 
-void NE_ModelSetMaterial(NE_Model *model, NE_Material *material)
+// Returns the nearest exact frame to the current frame of an animation.
+static int32_t ne_model_anim_nearest_frame(const NE_AnimInfo *animinfo)
 {
-    NE_AssertPointer(model, "NULL model pointer");
-    NE_AssertPointer(material, "NULL material pointer");
-    model->texture = material;
+    int32_t frame = (animinfo->currframe + (inttof32(1) / 2)) >> 12;
+
+    // When looping, the frame after the last one is the first one
+    if (frame >= animinfo->numframes)
+        frame = 0;
+
+    return inttof32(frame);
 }
 
-void NE_ModelSetAnimation(NE_Model *model, NE_Animation *anim)
+// Updates the pose saved by a model that uses animation LOD. The pose is taken
+// from the pose cache if possible, so that models that share animations don't
+// calculate the same pose.
+static void ne_model_anim_lod_update(const NE_Model *model,
+                                     const int32_t *frame)
 {
-    NE_AssertPointer(model, "NULL model pointer");
-    NE_AssertPointer(anim, "NULL animation pointer");
-    NE_Assert(model->modeltype == NE_Animated, "Not an animated model");
-    model->animinfo[0]->animation = anim;
-    uint32_t frames = DSMA_GetNumFrames(anim->data);
-    model->animinfo[0]->numframes = frames;
+    NE_ModelAnimLOD *anim_lod = model->anim_lod;
+
+    const ne_pose_cache_entry_t *pose = ne_pose_cache_get(model, frame);
+    if (pose == NULL)
+    {
+        anim_lod->num_joints = ne_model_compute_pose(model, frame,
+                                                     &anim_lod->matrices,
+                                                     &anim_lod->max_joints);
+        return;
+    }
+
+    if (!ne_model_pose_buffer_reserve(&anim_lod->matrices,
+                                      &anim_lod->max_joints, pose->num_joints))
+    {
+        anim_lod->num_joints = 0;
+        return;
+    }
+
+    memcpy(anim_lod->matrices, pose->matrices,
+           pose->num_joints * DSMA_POSE_MATRIX_SIZE * sizeof(int32_t));
+    anim_lod->num_joints = pose->num_joints;
 }
 
-void NE_ModelSetAnimationSecondary(NE_Model *model, NE_Animation *anim)
+static void ne_model_draw_animated(const NE_Model *model, const void *meshdata)
 {
-    NE_AssertPointer(model, "NULL model pointer");
-    NE_AssertPointer(anim, "NULL animation pointer");
-    NE_Assert(model->modeltype == NE_Animated, "Not an animated model");
-    model->animinfo[1]->animation = anim;
-    uint32_t frames = DSMA_GetNumFrames(anim->data);
-    model->animinfo[1]->numframes = frames;
+    const NE_AnimInfo *anim_0 = model->animinfo[0];
+    const NE_AnimInfo *anim_1 = model->animinfo[1];
+
+    int32_t frame[NE_MODEL_MAX_ANIM_LAYERS];
+    for (int i = 0; i < NE_MODEL_MAX_ANIM_LAYERS; i++)
+        frame[i] = model->animinfo[i]->currframe;
+
+    NE_ModelAnimLOD *anim_lod = model->anim_lod;
+    bool reduced_rate = false;
+
+    if (anim_lod != NULL)
+    {
+        int64_t dist2 = -1;
+        if (NE_CameraLastUsed != NULL)
+            dist2 = ne_model_camera_distance2(model);
+
+        if (ne_model_anim_lod_far(model, anim_lod->snap_distance, dist2))
+        {
+            for (int i = 0; i < NE_MODEL_MAX_ANIM_LAYERS; i++)
+            {
+                const NE_AnimInfo *animinfo = model->animinfo[i];
+                if (animinfo->animation != NULL)
+                    frame[i] = ne_model_anim_nearest_frame(animinfo);
+            }
+            ne_anim_stats.frames_snapped++;
+        }
+
+        if ((anim_lod->update_period > 1) &&
+            ne_model_anim_lod_far(model, anim_lod->update_distance, dist2))
+            reduced_rate = true;
+        else
+        {
+            anim_lod->frames_left = 0;
+            anim_lod->num_joints = 0;
+        }
+    }
+
+    if (reduced_rate)
+    {
+        if (anim_lod->frames_left > 0)
+        {
+            anim_lod->frames_left--;
+            ne_anim_stats.poses_reused++;
+        }
+        else
+        {
+            // The first update happens as soon as the rate is reduced, but the
+            // next one is delayed by the phase of the model. This spreads the
+            // updates of models that start using the reduced rate at the same
+            // time, like clones of the same model.
+            bool first = anim_lod->num_joints == 0;
+
+            ne_model_anim_lod_update(model, frame);
+
+            if (first)
+            {
+                anim_lod->frames_left = anim_lod->phase %
+                                        anim_lod->update_period;
+            }
+            else
+                anim_lod->frames_left = anim_lod->update_period - 1;
+        }
+
+        if (anim_lod->num_joints > 0)
+        {
+            int ret = DSMA_DrawModelPose(meshdata, anim_lod->matrices,
+                                         anim_lod->num_joints);
+            NE_Assert(ret == DSMA_SUCCESS, "Failed to draw animated model");
+            return;
+        }
+
+        // If the pose couldn't be calculated, draw it the regular way
+    }
+
+    const ne_pose_cache_entry_t *pose = ne_pose_cache_get(model, frame);
+    if (pose != NULL)
+    {
+        int ret = DSMA_DrawModelPose(meshdata, pose->matrices,
+                                     pose->num_joints);
+        NE_Assert(ret == DSMA_SUCCESS, "Failed to draw animated model");
+        return;
+    }
+
+    ne_anim_stats.joints_evaluated +=
+            DSMA_GetNumJoints(anim_0->animation->data);
+
+    if (ne_model_has_extra_layers(model))
+    {
+        DSMA_Layer layers[NE_MODEL_MAX_ANIM_LAYERS];
+        int num_layers = ne_model_get_layers(model, frame, layers);
+        int ret = DSMA_DrawModelLayers(meshdata, layers, num_layers);
+        NE_Assert(ret == DSMA_SUCCESS, "Failed to draw animated model");
+    }
+    else if (anim_1->animation != NULL)
+    {
+        int ret = DSMA_DrawModelBlendAnimation(meshdata,
+                anim_0->animation->data, frame[0],
+                anim_1->animation->data, frame[1],
+                model->anim_blend);
+        NE_Assert(ret == DSMA_SUCCESS, "Failed to draw animated model");
+    }
+    else
+    {
+        int ret = DSMA_DrawModel(meshdata, anim_0->animation->data, frame[0]);
+        NE_Assert(ret == DSMA_SUCCESS, "Failed to draw animated model");
+    }
 }
 
 //---------------------------------------------------------
@@ -269,6 +1355,12 @@ void NE_ModelDraw(const NE_Model *model)
             return;
     }
 
+    int level = ne_model_lod_select(model);
+
+    level = ne_model_budget_check(model, level);
+    if (level < 0)
+        return;
+
     MATRIX_PUSH = 0;
 
     MATRIX_TRANSLATE = model->x;
@@ -297,33 +1389,13 @@ void NE_ModelDraw(const NE_Model *model)
         NE_MaterialUse(model->texture);
     }
 
-    ne_mesh_info_t *mesh = &NE_Mesh[model->meshindex];
+    ne_mesh_info_t *mesh = &NE_Mesh[ne_model_lod_get_mesh(model, level)];
     const void *meshdata = mesh->address;
 
     if (model->modeltype == NE_Static)
-    {
         glCallList(meshdata);
-    }
     else // if(model->modeltype == NE_Animated)
-    {
-        if (model->animinfo[0]->animation && model->animinfo[1]->animation)
-        {
-            int ret = DSMA_DrawModelBlendAnimation(meshdata,
-                    model->animinfo[0]->animation->data,
-                    model->animinfo[0]->currframe,
-                    model->animinfo[1]->animation->data,
-                    model->animinfo[1]->currframe,
-                    model->anim_blend);
-            NE_Assert(ret == DSMA_SUCCESS, "Failed to draw animated model");
-        }
-        else // if (model->animinfo[0]->animation)
-        {
-            int ret = DSMA_DrawModel(meshdata,
-                                     model->animinfo[0]->animation->data,
-                                     model->animinfo[0]->currframe);
-            NE_Assert(ret == DSMA_SUCCESS, "Failed to draw animated model");
-        }
-    }
+        ne_model_draw_animated(model, meshdata);
 
     MATRIX_POP = 1;
 }
@@ -337,9 +1409,24 @@ void NE_ModelClone(NE_Model *dest, NE_Model *source)
 
     if (dest->modeltype == NE_Animated)
     {
-        memcpy(dest->animinfo[0], source->animinfo[0], sizeof(NE_AnimInfo));
-        memcpy(dest->animinfo[1], source->animinfo[1], sizeof(NE_AnimInfo));
+        for (int i = 0; i < NE_MODEL_MAX_ANIM_LAYERS; i++)
+        {
+            memcpy(dest->animinfo[i], source->animinfo[i],
+                   sizeof(NE_AnimInfo));
+        }
         dest->anim_blend = source->anim_blend;
+        ne_model_active_update(dest);
+
+        // The saved pose isn't shared, only the settings
+        ne_model_anim_lod_delete(dest);
+
+        NE_ModelAnimLOD *anim_lod = source->anim_lod;
+        if (anim_lod != NULL)
+        {
+            NE_ModelAnimSetLODI(dest, anim_lod->snap_distance,
+                                anim_lod->update_distance,
+                                anim_lod->update_period);
+        }
     }
 
     dest->x = source->x;
@@ -354,6 +1441,7 @@ void NE_ModelClone(NE_Model *dest, NE_Model *source)
 
     dest->texture = source->texture;
     dest->meshindex = source->meshindex;
+    dest->priority = source->priority;
 
     // If the model has a mesh (which is the normal situation), increase the
     // count of users of that mesh.
@@ -362,6 +1450,114 @@ void NE_ModelClone(NE_Model *dest, NE_Model *source)
         ne_mesh_info_t *mesh = &NE_Mesh[dest->meshindex];
         mesh->uses++;
     }
+
+    // Share the LOD meshes as well
+    ne_model_lod_delete(dest);
+
+    if (source->lod != NULL)
+    {
+        dest->lod = malloc(sizeof(NE_ModelLOD));
+        if (dest->lod == NULL)
+        {
+            NE_DebugPrint("Not enough memory");
+            return;
+        }
+
+        memcpy(dest->lod, source->lod, sizeof(NE_ModelLOD));
+
+        for (int i = 1; i < NE_MODEL_MAX_LOD_LEVELS; i++)
+        {
+            if (dest->lod->meshindex[i] != NE_NO_MESH)
+                NE_Mesh[dest->lod->meshindex[i]].uses++;
+        }
+    }
+}
+
+int NE_ModelBatch(NE_Model *dest, NE_Model **models, int num_models)
+{
+    if (!ne_model_system_inited)
+        return 0;
+
+    NE_AssertPointer(dest, "NULL dest pointer");
+    NE_AssertPointer(models, "NULL models pointer");
+    NE_Assert(dest->modeltype == NE_Static, "Not a static model");
+    NE_Assert(num_models > 0, "No models to merge");
+
+    NE_DisplayListInstance *instances =
+            malloc(num_models * sizeof(NE_DisplayListInstance));
+    if (instances == NULL)
+    {
+        NE_DebugPrint("Not enough memory");
+        return 0;
+    }
+
+    NE_Material *material = models[0]->texture;
+
+    for (int i = 0; i < num_models; i++)
+    {
+        const NE_Model *model = models[i];
+
+        NE_AssertPointer(model, "NULL model pointer");
+
+        if ((model->modeltype != NE_Static) || (model->meshindex == NE_NO_MESH))
+        {
+            NE_DebugPrint("Model %d isn't a static model with a mesh", i);
+            free(instances);
+            return 0;
+        }
+
+        if (model->texture != material)
+        {
+            NE_DebugPrint("Model %d uses a different material", i);
+            free(instances);
+            return 0;
+        }
+
+        NE_DisplayListInstance *instance = &instances[i];
+
+        instance->list = NE_Mesh[model->meshindex].address;
+        instance->x = model->x;
+        instance->y = model->y;
+        instance->z = model->z;
+        instance->rx = model->rx;
+        instance->ry = model->ry;
+        instance->rz = model->rz;
+        instance->sx = model->sx;
+        instance->sy = model->sy;
+        instance->sz = model->sz;
+    }
+
+    int32_t position[3];
+    int32_t scale;
+    void *list = NE_DisplayListMerge(instances, num_models, position, &scale);
+
+    free(instances);
+
+    if (list == NULL)
+        return 0;
+
+    if (ne_model_load_ram_common(&dest->meshindex, list) == 0)
+    {
+        free(list);
+        return 0;
+    }
+
+    // The list has been allocated here, free it when the model is deleted
+    NE_Mesh[dest->meshindex].has_to_free = true;
+
+    dest->texture = material;
+
+    dest->x = position[0];
+    dest->y = position[1];
+    dest->z = position[2];
+    dest->rx = 0;
+    dest->ry = 0;
+    dest->rz = 0;
+    dest->sx = scale;
+    dest->sy = scale;
+    dest->sz = scale;
+
+    return 1;
 }
 
 void NE_ModelScaleI(NE_Model *model, int x, int y, int z)
@@ -409,17 +1605,15 @@ void NE_ModelAnimateAll(void)
     if (!ne_model_system_inited)
         return;
 
-    for (int i = 0; i < NE_MAX_MODELS; i++)
+    // Iterate backwards so that models can be removed from the list without
+    // skipping any other model.
+    for (int i = ne_model_active_count - 1; i >= 0; i--)
     {
-        if (NE_ModelPointers[i] == NULL)
-            continue;
-
-        if (NE_ModelPointers[i]->modeltype != NE_Animated)
-            continue;
+        NE_Model *model = ne_model_active[i];
 
-        for (int j = 0; j < 2; j++)
+        for (int j = 0; j < NE_MODEL_MAX_ANIM_LAYERS; j++)
         {
-            NE_AnimInfo *animinfo = NE_ModelPointers[i]->animinfo[j];
+            NE_AnimInfo *animinfo = model->animinfo[j];
 
             animinfo->currframe += animinfo->speed;
 
@@ -446,6 +1640,10 @@ void NE_ModelAnimateAll(void)
                 }
             }
         }
+
+        // One-shot animations that have reached the end stop running
+        if (!ne_model_anim_is_running(model))
+            ne_model_active_remove(model);
     }
 }
 
@@ -456,6 +1654,7 @@ void NE_ModelAnimStart(NE_Model *model, NE_AnimationType type, int32_t speed)
     model->animinfo[0]->type = type;
     model->animinfo[0]->speed = speed;
     model->animinfo[0]->currframe = 0;
+    ne_model_active_update(model);
 }
 
 void NE_ModelAnimSecondaryStart(NE_Model *model, NE_AnimationType type,
@@ -467,6 +1666,7 @@ void NE_ModelAnimSecondaryStart(NE_Model *model, NE_AnimationType type,
     model->animinfo[1]->speed = speed;
     model->animinfo[1]->currframe = 0;
     model->anim_blend = 0;
+    ne_model_active_update(model);
 }
 
 void NE_ModelAnimSetSpeed(NE_Model *model, int32_t speed)
@@ -474,6 +1674,7 @@ void NE_ModelAnimSetSpeed(NE_Model *model, int32_t speed)
     NE_AssertPointer(model, "NULL pointer");
     NE_Assert(model->modeltype == NE_Animated, "Not an animated model");
     model->animinfo[0]->speed = speed;
+    ne_model_active_update(model);
 }
 
 void NE_ModelAnimSecondarySetSpeed(NE_Model *model, int32_t speed)
@@ -481,6 +1682,7 @@ void NE_ModelAnimSecondarySetSpeed(NE_Model *model, int32_t speed)
     NE_AssertPointer(model, "NULL pointer");
     NE_Assert(model->modeltype == NE_Animated, "Not an animated model");
     model->animinfo[1]->speed = speed;
+    ne_model_active_update(model);
 }
 
 int32_t NE_ModelAnimGetFrame(const NE_Model *model)
@@ -537,6 +1739,81 @@ void NE_ModelAnimSecondaryClear(NE_Model *model, bool replace_base_anim)
         memcpy(model->animinfo[0], model->animinfo[1], sizeof(NE_AnimInfo));
 
     memset(model->animinfo[1], 0, sizeof(NE_AnimInfo));
+    ne_model_active_update(model);
+}
+
+// Returns the animation information of an extra animation layer.
+static NE_AnimInfo *ne_model_get_layer(const NE_Model *model, int layer)
+{
+    NE_AssertPointer(model, "NULL model pointer");
+    NE_Assert(model->modeltype == NE_Animated, "Not an animated model");
+    NE_AssertMinMax(2, layer, NE_MODEL_MAX_ANIM_LAYERS - 1,
+                    "Invalid animation layer: %d", layer);
+
+    return model->animinfo[layer];
+}
+
+void NE_ModelSetAnimationLayer(NE_Model *model, int layer, NE_Animation *anim,
+                               bool additive)
+{
+    NE_AssertPointer(anim, "NULL animation pointer");
+
+    NE_AnimInfo *animinfo = ne_model_get_layer(model, layer);
+
+    animinfo->animation = anim;
+    animinfo->numframes = DSMA_GetNumFrames(anim->data);
+    animinfo->additive = additive;
+    animinfo->weight = inttof32(1);
+    ne_model_anim_lod_reset(model);
+}
+
+void NE_ModelAnimLayerStart(NE_Model *model, int layer, NE_AnimationType type,
+                            int32_t speed)
+{
+    NE_AnimInfo *animinfo = ne_model_get_layer(model, layer);
+
+    animinfo->type = type;
+    animinfo->speed = speed;
+    animinfo->currframe = 0;
+    ne_model_active_update(model);
+}
+
+void NE_ModelAnimLayerSetSpeed(NE_Model *model, int layer, int32_t speed)
+{
+    NE_AnimInfo *animinfo = ne_model_get_layer(model, layer);
+
+    animinfo->speed = speed;
+    ne_model_active_update(model);
+}
+
+int32_t NE_ModelAnimLayerGetFrame(const NE_Model *model, int layer)
+{
+    return ne_model_get_layer(model, layer)->currframe;
+}
+
+void NE_ModelAnimLayerSetFrame(NE_Model *model, int layer, int32_t frame)
+{
+    ne_model_get_layer(model, layer)->currframe = frame;
+}
+
+void NE_ModelAnimLayerSetWeight(NE_Model *model, int layer, int32_t weight)
+{
+    NE_AnimInfo *animinfo = ne_model_get_layer(model, layer);
+
+    if (weight < 0)
+        weight = 0;
+    if (weight > inttof32(1))
+        weight = inttof32(1);
+    animinfo->weight = weight;
+}
+
+void NE_ModelAnimLayerClear(NE_Model *model, int layer)
+{
+    NE_AnimInfo *animinfo = ne_model_get_layer(model, layer);
+
+    memset(animinfo, 0, sizeof(NE_AnimInfo));
+    ne_model_active_update(model);
+    ne_model_anim_lod_reset(model);
 }
 
 int NE_ModelLoadDSMFAT(NE_Model *model, const char *path)
@@ -544,9 +1821,10 @@ int NE_ModelLoadDSMFAT(NE_Model *model, const char *path)
     if (!ne_model_system_inited)
         return 0;
 
+    NE_AssertPointer(model, "NULL model pointer");
     NE_Assert(model->modeltype == NE_Animated, "Not an animated model");
 
-    return ne_model_load_filesystem_common(model, path);
+    return ne_model_load_filesystem_common(&model->meshindex, path);
 }
 
 int NE_ModelLoadDSM(NE_Model *model, const void *pointer)
@@ -554,9 +1832,40 @@ int NE_ModelLoadDSM(NE_Model *model, const void *pointer)
     if (!ne_model_system_inited)
         return 0;
 
+    NE_AssertPointer(model, "NULL model pointer");
+    NE_Assert(model->modeltype == NE_Animated, "Not an animated model");
+
+    return ne_model_load_ram_common(&model->meshindex, pointer);
+}
+
+int NE_ModelLoadDSMLODFAT(NE_Model *model, int level, const char *path)
+{
+    if (!ne_model_system_inited)
+        return 0;
+
+    NE_AssertPointer(model, "NULL model pointer");
+    NE_Assert(model->modeltype == NE_Animated, "Not an animated model");
+
+    int *meshindex = ne_model_lod_get_meshindex(model, level);
+    if (meshindex == NULL)
+        return 0;
+
+    return ne_model_load_filesystem_common(meshindex, path);
+}
+
+int NE_ModelLoadDSMLOD(NE_Model *model, int level, const void *pointer)
+{
+    if (!ne_model_system_inited)
+        return 0;
+
+    NE_AssertPointer(model, "NULL model pointer");
     NE_Assert(model->modeltype == NE_Animated, "Not an animated model");
 
-    return ne_model_load_ram_common(model, pointer);
+    int *meshindex = ne_model_lod_get_meshindex(model, level);
+    if (meshindex == NULL)
+        return 0;
+
+    return ne_model_load_ram_common(meshindex, pointer);
 }
 
 void NE_ModelDeleteAll(void)
@@ -583,14 +1892,21 @@ int NE_ModelSystemReset(int max_models)
 
     NE_Mesh = calloc(NE_MAX_MODELS, sizeof(ne_mesh_info_t));
     NE_ModelPointers = calloc(NE_MAX_MODELS, sizeof(NE_ModelPointers));
-    if ((NE_Mesh == NULL) || (NE_ModelPointers == NULL))
+    ne_model_active = calloc(NE_MAX_MODELS, sizeof(ne_model_active));
+    if ((NE_Mesh == NULL) || (NE_ModelPointers == NULL) ||
+        (ne_model_active == NULL))
     {
         free(NE_Mesh);
         free(NE_ModelPointers);
+        free(ne_model_active);
         NE_DebugPrint("Not enough memory");
         return -1;
     }
 
+    ne_model_active_count = 0;
+    ne_mesh_cache_size = 0;
+    ne_mesh_cache_time = 0;
+
     ne_model_system_inited = true;
     return 0;
 }
@@ -601,9 +1917,12 @@ void NE_ModelSystemEnd(void)
         return;
 
     NE_ModelDeleteAll();
+    NE_ModelMeshCacheFlush();
+    ne_pose_cache_free();
 
     free(NE_Mesh);
     free(NE_ModelPointers);
+    free(ne_model_active);
 
     ne_model_system_inited = false;
 }
@@ -13,247 +13,2295 @@ static bool ne_physics_system_inited = false;
 
 static int NE_MAX_PHYSICS;
 
+static NE_PhysicsStats ne_physics_stats;
+
+#ifndef ARM_CODE
+# define ARM_CODE __attribute__((target("arm")))
+#endif
+
+// Internal storage
+// ================
+//
+// At the start of an update, the state needed to test objects against each
+// other is copied to arrays indexed by slot. The collision loop only reads
+// those arrays, so it doesn't need to follow the pointers to the NE_Physics and
+// NE_Model structs of each candidate. At the end of the update the positions
+// and speeds are written back to the models and objects.
+//
+// The state of static objects is only copied when they change.
+//
+// Spheres are stored with a size equal to their diameter, and dots with a size
+// of zero. The bounding box of each shape is used to reject pairs and for the
+// response to collisions, so all shapes share the same response code.
+
+typedef struct {
+    int x, y, z;
+} ne_physics_vec_t;
+
+#define NE_PHYSICS_FLAG_BOX         BIT(0) // Bounding box with a model
+#define NE_PHYSICS_FLAG_SPHERE      BIT(1) // Bounding sphere with a model
+#define NE_PHYSICS_FLAG_DOT         BIT(2) // Dot with a model
+#define NE_PHYSICS_FLAG_SLEEPING    BIT(3) // Sleeping dynamic object
+#define NE_PHYSICS_FLAG_MESH        BIT(4) // Collision mesh with a model
+#define NE_PHYSICS_FLAG_WAKE_QUEUED BIT(5) // Slot is in the wake list
+
+#define NE_PHYSICS_FLAG_SHAPE \
+    (NE_PHYSICS_FLAG_BOX | NE_PHYSICS_FLAG_SPHERE | NE_PHYSICS_FLAG_DOT | \
+     NE_PHYSICS_FLAG_MESH)
+
+// Collision meshes created by obj2col. The header is followed by the nodes of
+// the bounding volume hierarchy and by the triangles.
+
+#define NE_PHYSICS_MESH_MAGIC   0x4C4F434E // "NCOL"
+#define NE_PHYSICS_MESH_VERSION 1
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t num_triangles;
+    uint32_t num_nodes;
+} ne_mesh_header_t;
+
+// If count is 0 the children are the next node and the node "first". If not,
+// it's a leaf with "count" triangles starting at triangle "first".
+typedef struct {
+    int32_t min[3];
+    int32_t max[3];
+    int32_t first;
+    int32_t count;
+} ne_mesh_node_t;
+
+// The normal points to the front face. It's a unit vector.
+typedef struct {
+    int32_t v[3][3];
+    int32_t normal[3];
+} ne_mesh_triangle_t;
+
+static inline const ne_mesh_node_t *ne_mesh_nodes(const ne_mesh_header_t *mesh)
+{
+    return (const ne_mesh_node_t *)(mesh + 1);
+}
+
+static inline const ne_mesh_triangle_t *
+ne_mesh_triangles(const ne_mesh_header_t *mesh)
+{
+    return (const ne_mesh_triangle_t *)(ne_mesh_nodes(mesh) + mesh->num_nodes);
+}
+
+static ne_physics_vec_t *ne_physics_pos;
+static ne_physics_vec_t *ne_physics_size;
+static ne_physics_vec_t *ne_physics_speed;
+static int *ne_physics_group;
+static uint32_t *ne_physics_category;
+static uint32_t *ne_physics_mask;
+static uint8_t *ne_physics_flags;
+
+// True if the state of static objects has to be copied again
+static bool ne_physics_static_dirty;
+
+// Gets the size of the bounding box of the shape of an object.
+static void ne_physics_shape_size(const NE_Physics *pointer,
+                                  ne_physics_vec_t *size)
+{
+    if (pointer->type == NE_BoundingSphere)
+    {
+        size->x = size->y = size->z = pointer->radius << 1;
+    }
+    else if (pointer->type == NE_Dot)
+    {
+        size->x = size->y = size->z = 0;
+    }
+    else if (pointer->type == NE_CollisionMesh)
+    {
+        // The box is centered at the origin of the mesh, so it needs to be big
+        // enough to contain the bounding box of the root node.
+        size->x = size->y = size->z = 0;
+
+        if (pointer->mesh == NULL)
+            return;
+
+        const ne_mesh_node_t *root = ne_mesh_nodes(pointer->mesh);
+        int half[3];
+        for (int i = 0; i < 3; i++)
+        {
+            half[i] = abs(root->min[i]);
+            if (abs(root->max[i]) > half[i])
+                half[i] = abs(root->max[i]);
+        }
+
+        size->x = half[0] << 1;
+        size->y = half[1] << 1;
+        size->z = half[2] << 1;
+    }
+    else
+    {
+        size->x = pointer->xsize;
+        size->y = pointer->ysize;
+        size->z = pointer->zsize;
+    }
+}
+
+static uint8_t ne_physics_shape_flag(const NE_Physics *pointer)
+{
+    if (pointer->type == NE_BoundingSphere)
+        return NE_PHYSICS_FLAG_SPHERE;
+    if (pointer->type == NE_Dot)
+        return NE_PHYSICS_FLAG_DOT;
+    if (pointer->type == NE_CollisionMesh)
+        return (pointer->mesh != NULL) ? NE_PHYSICS_FLAG_MESH : 0;
+    return NE_PHYSICS_FLAG_BOX;
+}
+
+// Returns true if two shapes overlap. Boxes and dots only need the test of the
+// bounding boxes (a dot is a box of size zero). If there is a sphere, the
+// squared distance from its center to the other shape is compared with its
+// squared radius, so no square root is needed.
+static inline bool ne_physics_shapes_overlap(uint8_t flags,
+                                             const ne_physics_vec_t *pos,
+                                             const ne_physics_vec_t *size,
+                                             uint8_t otherflags,
+                                             const ne_physics_vec_t *otherpos,
+                                             const ne_physics_vec_t *othersize)
+{
+    int dx = abs(pos->x - otherpos->x);
+    int dy = abs(pos->y - otherpos->y);
+    int dz = abs(pos->z - otherpos->z);
+
+    if ((dx >= (size->x + othersize->x) >> 1) ||
+        (dy >= (size->y + othersize->y) >> 1) ||
+        (dz >= (size->z + othersize->z) >> 1))
+        return false;
+
+    bool sphere = flags & NE_PHYSICS_FLAG_SPHERE;
+    bool othersphere = otherflags & NE_PHYSICS_FLAG_SPHERE;
+
+    if (!sphere && !othersphere)
+        return true;
+
+    int radius;
+
+    if (sphere && (otherflags & NE_PHYSICS_FLAG_BOX))
+    {
+        // Distance from the center of the sphere to the closest point of the
+        // box. The sizes of the box are divided by two to get half-extents.
+        dx = dx - (othersize->x >> 1);
+        dy = dy - (othersize->y >> 1);
+        dz = dz - (othersize->z >> 1);
+        radius = size->x >> 1;
+    }
+    else if (othersphere && (flags & NE_PHYSICS_FLAG_BOX))
+    {
+        dx = dx - (size->x >> 1);
+        dy = dy - (size->y >> 1);
+        dz = dz - (size->z >> 1);
+        radius = othersize->x >> 1;
+    }
+    else
+    {
+        // Sphere against sphere or dot: distance between the centers. The
+        // size of a dot is zero, so this is the sum of the radii.
+        radius = (size->x + othersize->x) >> 1;
+    }
+
+    if (dx < 0)
+        dx = 0;
+    if (dy < 0)
+        dy = 0;
+    if (dz < 0)
+        dz = 0;
+
+    int64_t dist2 = (int64_t)dx * dx + (int64_t)dy * dy + (int64_t)dz * dz;
+
+    return dist2 < (int64_t)radius * radius;
+}
+
+// Sleeping
+// ========
+//
+// Dynamic objects that have been slow for some frames go to sleep: they aren't
+// moved or tested against other objects until something wakes them up. When an
+// object wakes up, all sleeping objects that touch it wake up too, so that
+// stacks of objects (islands) are woken up together. Objects that wake up are
+// added to a list, and their neighbours are woken up in the next update.
+
+static int ne_physics_sleep_speed;
+static int ne_physics_sleep_frames;
+
+// Slots of the objects that have woken up and whose neighbours haven't been
+// woken up yet.
+static int *ne_physics_wake_list;
+static int ne_physics_wake_count;
+
+// Broadphase
+// ==========
+//
+// Objects are stored in a uniform grid. The grid is infinite, so cells are
+// stored in a spatial hash: each bucket of the hash has a list of entries, and
+// each entry is an object in one cell. Cells of the same bucket share the list.
+// Objects that cover too many cells are stored in a separate set, and they are
+// candidates to collide with any object.
+//
+// Static objects are stored in a different grid than dynamic and kinematic
+// objects. The grid of static objects is only updated when it is marked as
+// dirty, so static objects don't cost anything in the frames in which they
+// don't change. Both grids share the pool of entries.
+//
+// Each bucket also stores the union of the categories of its objects, so that
+// buckets without any object that matters for a query can be skipped.
+
+// Entry of an object in a cell of the grid.
+typedef struct {
+    int16_t slot;   // Slot of the object
+    int16_t bucket; // Bucket of the spatial hash
+    int16_t prev;   // Previous entry of the bucket (-1 if this is the first)
+    int16_t next;   // Next entry of the bucket (also used in the free list)
+} ne_grid_entry_t;
+
+typedef struct {
+    int16_t *buckets;     // First entry of each bucket (-1 if it's empty)
+    uint32_t *categories; // Union of the categories of each bucket
+    uint32_t *large;      // Bit set of large objects
+} ne_grid_t;
+
+// Cells covered by an object.
+typedef struct {
+    ne_grid_t *grid; // Grid that contains the object (NULL if none)
+    bool large;      // True if the object is in the set of large objects
+    int min[3];      // Min cell coordinates
+    int max[3];      // Max cell coordinates
+    int num_entries;
+    int16_t entries[NE_PHYSICS_MAX_CELLS];
+} ne_grid_object_t;
+
+static bool ne_physics_broadphase = true;
+static int ne_grid_cell_shift;
+
+static int ne_grid_num_buckets;
+static ne_grid_t ne_grid_dynamic;
+static ne_grid_t ne_grid_static;
+static ne_grid_entry_t *ne_grid_entries;
+static int16_t ne_grid_free_entry;
+static ne_grid_object_t *ne_grid_objects;
+
+// Bit sets with one bit per slot
+static int ne_grid_bitset_words;
+static uint32_t *ne_grid_candidate_bits;
+static uint32_t *ne_physics_moving; // Objects that aren't static
+
+// Slots of the objects that may collide with the object being updated
+static int *ne_physics_candidates;
+
+// Contacts
+// ========
+//
+// Contacts are recorded in slot order while objects are updated, so the list
+// is sorted by pair of objects. At the end of the update it's merged with the
+// list of the previous update to find which contacts are new, which ones
+// remain and which ones have ended. The result is the list seen by the user,
+// and it's used as previous list in the next update.
+
+static int ne_physics_max_contacts;
+static NE_PhysicsContact *ne_physics_contacts_new; // Recorded in this update
+static int ne_physics_contacts_new_count;
+static NE_PhysicsContact *ne_physics_contacts[2]; // Current and previous lists
+static int ne_physics_contacts_count[2];
+static int ne_physics_contacts_current;
+static bool ne_physics_recording; // True during NE_PhysicsUpdateAll()
+
+// Fixed timestep
+// ==============
+//
+// The time passed to NE_PhysicsAdvanceI() is accumulated, and the physics
+// engine is updated once for each step that fits in it. After that, models are
+// placed between their positions before and after the last step, depending on
+// how much time is left in the accumulator. Before the next step they are moved
+// back to their real position, unless the user has moved them.
+
+static int ne_physics_step; // 0 if there is no fixed timestep
+static int ne_physics_max_steps;
+static int ne_physics_accumulator;
+static int ne_physics_alpha;
+
+static int ne_grid_size_to_shift(int size)
+{
+    int shift = 0;
+    while ((1 << shift) < size)
+        shift++;
+    return shift;
+}
+
+static inline int ne_grid_hash(int x, int y, int z)
+{
+    uint32_t h = ((uint32_t)x * 73856093) ^ ((uint32_t)y * 19349663) ^
+                 ((uint32_t)z * 83492791);
+    return h & (ne_grid_num_buckets - 1);
+}
+
+// Calculates the cells covered by a box of the specified size centered at the
+// specified coordinates. Returns the number of cells.
+static int ne_grid_cell_range(const ne_physics_vec_t *size, int x, int y, int z,
+                              int *min, int *max)
+{
+    int pos[3] = { x, y, z };
+    // Round up so that the range is never smaller than the collision checks
+    int half[3] = {
+        (size->x + 1) >> 1,
+        (size->y + 1) >> 1,
+        (size->z + 1) >> 1
+    };
+
+    int cells = 1;
+    for (int i = 0; i < 3; i++)
+    {
+        min[i] = (pos[i] - half[i]) >> ne_grid_cell_shift;
+        max[i] = (pos[i] + half[i]) >> ne_grid_cell_shift;
+        cells *= max[i] - min[i] + 1;
+    }
+
+    return cells;
+}
+
+// Calculates the union of the categories of the objects of a bucket.
+static void ne_grid_bucket_categories(ne_grid_t *grid, int bucket)
+{
+    uint32_t categories = 0;
+
+    for (int e = grid->buckets[bucket]; e != -1; e = ne_grid_entries[e].next)
+        categories |= ne_physics_category[ne_grid_entries[e].slot];
+
+    grid->categories[bucket] = categories;
+}
+
+static void ne_grid_remove(int slot)
+{
+    ne_grid_object_t *obj = &ne_grid_objects[slot];
+    ne_grid_t *grid = obj->grid;
+
+    if (grid == NULL)
+        return;
+
+    for (int i = 0; i < obj->num_entries; i++)
+    {
+        int16_t e = obj->entries[i];
+        ne_grid_entry_t *entry = &ne_grid_entries[e];
+
+        if (entry->prev == -1)
+            grid->buckets[entry->bucket] = entry->next;
+        else
+            ne_grid_entries[entry->prev].next = entry->next;
+
+        if (entry->next != -1)
+            ne_grid_entries[entry->next].prev = entry->prev;
+
+        entry->next = ne_grid_free_entry;
+        ne_grid_free_entry = e;
+
+        ne_grid_bucket_categories(grid, entry->bucket);
+    }
+
+    if (obj->large)
+        grid->large[slot >> 5] &= ~BIT(slot & 31);
+
+    obj->num_entries = 0;
+    obj->grid = NULL;
+    obj->large = false;
+}
+
+// Moves an object to the cells that it covers now, if they have changed.
+static void ne_grid_update(const NE_Physics *pointer)
+{
+    int slot = pointer->slot;
+    ne_grid_object_t *obj = &ne_grid_objects[slot];
+
+    if (pointer->model == NULL)
+    {
+        ne_grid_remove(slot);
+        return;
+    }
+
+    const ne_physics_vec_t *pos = &ne_physics_pos[slot];
+
+    ne_grid_t *grid = (pointer->bodytype == NE_BodyStatic) ?
+                      &ne_grid_static : &ne_grid_dynamic;
+
+    int min[3], max[3];
+    int cells = ne_grid_cell_range(&ne_physics_size[slot], pos->x, pos->y,
+                                   pos->z, min, max);
+
+    if ((obj->grid == grid) &&
+        (min[0] == obj->min[0]) && (min[1] == obj->min[1]) &&
+        (min[2] == obj->min[2]) && (max[0] == obj->max[0]) &&
+        (max[1] == obj->max[1]) && (max[2] == obj->max[2]))
+    {
+        return;
+    }
+
+    ne_grid_remove(slot);
+
+    obj->grid = grid;
+    for (int i = 0; i < 3; i++)
+    {
+        obj->min[i] = min[i];
+        obj->max[i] = max[i];
+    }
+
+    if (cells > NE_PHYSICS_MAX_CELLS)
+    {
+        obj->large = true;
+        grid->large[slot >> 5] |= BIT(slot & 31);
+        return;
+    }
+
+    for (int z = min[2]; z <= max[2]; z++)
+    {
+        for (int y = min[1]; y <= max[1]; y++)
+        {
+            for (int x = min[0]; x <= max[0]; x++)
+            {
+                // There are enough entries for all objects to be in
+                // NE_PHYSICS_MAX_CELLS cells
+                int16_t e = ne_grid_free_entry;
+                ne_grid_entry_t *entry = &ne_grid_entries[e];
+                ne_grid_free_entry = entry->next;
+
+                int bucket = ne_grid_hash(x, y, z);
+
+                entry->slot = slot;
+                entry->bucket = bucket;
+                entry->prev = -1;
+                entry->next = grid->buckets[bucket];
+                if (entry->next != -1)
+                    ne_grid_entries[entry->next].prev = e;
+                grid->buckets[bucket] = e;
+                grid->categories[bucket] |= ne_physics_category[slot];
+
+                obj->entries[obj->num_entries++] = e;
+            }
+        }
+    }
+}
+
+// Copies the state of an object to the internal arrays.
+static void ne_physics_gather(const NE_Physics *pointer)
+{
+    int slot = pointer->slot;
+    NE_Model *model = pointer->model;
+
+    // The slot may still be in the wake list
+    uint8_t flags = ne_physics_flags[slot] & NE_PHYSICS_FLAG_WAKE_QUEUED;
+
+    if (model != NULL)
+    {
+        ne_physics_pos[slot].x = model->x;
+        ne_physics_pos[slot].y = model->y;
+        ne_physics_pos[slot].z = model->z;
+
+        flags |= ne_physics_shape_flag(pointer);
+    }
+
+    if (pointer->sleeping)
+        flags |= NE_PHYSICS_FLAG_SLEEPING;
+
+    ne_physics_shape_size(pointer, &ne_physics_size[slot]);
+
+    ne_physics_speed[slot].x = pointer->xspeed;
+    ne_physics_speed[slot].y = pointer->yspeed;
+    ne_physics_speed[slot].z = pointer->zspeed;
+
+    ne_physics_group[slot] = pointer->physicsgroup;
+    ne_physics_category[slot] = pointer->category;
+    ne_physics_mask[slot] = pointer->mask;
+    ne_physics_flags[slot] = flags;
+}
+
+// Writes the position and speed of an object back to the object and model.
+static void ne_physics_scatter(NE_Physics *pointer)
+{
+    int slot = pointer->slot;
+    NE_Model *model = pointer->model;
+
+    if (!pointer->enabled || (model == NULL))
+        return;
+
+    model->x = ne_physics_pos[slot].x;
+    model->y = ne_physics_pos[slot].y;
+    model->z = ne_physics_pos[slot].z;
+
+    pointer->xspeed = ne_physics_speed[slot].x;
+    pointer->yspeed = ne_physics_speed[slot].y;
+    pointer->zspeed = ne_physics_speed[slot].z;
+}
+
+// Removes all objects from the grids and resets the list of free entries.
+static void ne_grid_clear(void)
+{
+    for (int i = 0; i < ne_grid_num_buckets; i++)
+    {
+        ne_grid_dynamic.buckets[i] = -1;
+        ne_grid_dynamic.categories[i] = 0;
+        ne_grid_static.buckets[i] = -1;
+        ne_grid_static.categories[i] = 0;
+    }
+
+    int num_entries = NE_MAX_PHYSICS * NE_PHYSICS_MAX_CELLS;
+    for (int i = 0; i < num_entries; i++)
+        ne_grid_entries[i].next = i + 1;
+    ne_grid_entries[num_entries - 1].next = -1;
+    ne_grid_free_entry = 0;
+
+    memset(ne_grid_objects, 0, NE_MAX_PHYSICS * sizeof(ne_grid_object_t));
+    memset(ne_grid_dynamic.large, 0, ne_grid_bitset_words * sizeof(uint32_t));
+    memset(ne_grid_static.large, 0, ne_grid_bitset_words * sizeof(uint32_t));
+
+    ne_physics_static_dirty = true;
+}
+
+static void ne_grid_free(void)
+{
+    free(ne_grid_dynamic.buckets);
+    free(ne_grid_dynamic.categories);
+    free(ne_grid_dynamic.large);
+    free(ne_grid_static.buckets);
+    free(ne_grid_static.categories);
+    free(ne_grid_static.large);
+    free(ne_grid_entries);
+    free(ne_grid_objects);
+    free(ne_grid_candidate_bits);
+    free(ne_physics_moving);
+    free(ne_physics_candidates);
+    free(ne_physics_wake_list);
+    free(ne_physics_pos);
+    free(ne_physics_size);
+    free(ne_physics_speed);
+    free(ne_physics_group);
+    free(ne_physics_category);
+    free(ne_physics_mask);
+    free(ne_physics_flags);
+    free(ne_physics_contacts_new);
+    free(ne_physics_contacts[0]);
+    free(ne_physics_contacts[1]);
+
+    ne_grid_dynamic.buckets = NULL;
+    ne_grid_dynamic.categories = NULL;
+    ne_grid_dynamic.large = NULL;
+    ne_grid_static.buckets = NULL;
+    ne_grid_static.categories = NULL;
+    ne_grid_static.large = NULL;
+    ne_grid_entries = NULL;
+    ne_grid_objects = NULL;
+    ne_grid_candidate_bits = NULL;
+    ne_physics_moving = NULL;
+    ne_physics_candidates = NULL;
+    ne_physics_wake_list = NULL;
+    ne_physics_pos = NULL;
+    ne_physics_size = NULL;
+    ne_physics_speed = NULL;
+    ne_physics_group = NULL;
+    ne_physics_category = NULL;
+    ne_physics_mask = NULL;
+    ne_physics_flags = NULL;
+    ne_physics_contacts_new = NULL;
+    ne_physics_contacts[0] = NULL;
+    ne_physics_contacts[1] = NULL;
+}
+
+static int ne_grid_init(void)
+{
+    ne_grid_num_buckets = 64;
+    while (ne_grid_num_buckets < NE_MAX_PHYSICS * 2)
+        ne_grid_num_buckets <<= 1;
+
+    ne_grid_bitset_words = (NE_MAX_PHYSICS + 31) >> 5;
+
+    int num_entries = NE_MAX_PHYSICS * NE_PHYSICS_MAX_CELLS;
+    size_t bitset_size = ne_grid_bitset_words * sizeof(uint32_t);
+
+    size_t categories_size = ne_grid_num_buckets * sizeof(uint32_t);
+
+    ne_grid_dynamic.buckets = malloc(ne_grid_num_buckets * sizeof(int16_t));
+    ne_grid_dynamic.categories = malloc(categories_size);
+    ne_grid_dynamic.large = malloc(bitset_size);
+    ne_grid_static.buckets = malloc(ne_grid_num_buckets * sizeof(int16_t));
+    ne_grid_static.categories = malloc(categories_size);
+    ne_grid_static.large = malloc(bitset_size);
+    ne_grid_entries = malloc(num_entries * sizeof(ne_grid_entry_t));
+    ne_grid_objects = malloc(NE_MAX_PHYSICS * sizeof(ne_grid_object_t));
+    ne_grid_candidate_bits = calloc(ne_grid_bitset_words, sizeof(uint32_t));
+    ne_physics_moving = calloc(ne_grid_bitset_words, sizeof(uint32_t));
+    ne_physics_candidates = malloc(NE_MAX_PHYSICS * sizeof(int));
+    ne_physics_wake_list = malloc(NE_MAX_PHYSICS * sizeof(int));
+    ne_physics_pos = calloc(NE_MAX_PHYSICS, sizeof(ne_physics_vec_t));
+    ne_physics_size = calloc(NE_MAX_PHYSICS, sizeof(ne_physics_vec_t));
+    ne_physics_speed = calloc(NE_MAX_PHYSICS, sizeof(ne_physics_vec_t));
+    ne_physics_group = calloc(NE_MAX_PHYSICS, sizeof(int));
+    ne_physics_category = calloc(NE_MAX_PHYSICS, sizeof(uint32_t));
+    ne_physics_mask = calloc(NE_MAX_PHYSICS, sizeof(uint32_t));
+    ne_physics_flags = calloc(NE_MAX_PHYSICS, sizeof(uint8_t));
+
+    ne_physics_max_contacts = NE_MAX_PHYSICS * NE_PHYSICS_CONTACTS_PER_OBJECT;
+    size_t contacts_size = ne_physics_max_contacts * sizeof(NE_PhysicsContact);
+
+    ne_physics_contacts_new = malloc(contacts_size);
+    ne_physics_contacts[0] = malloc(contacts_size);
+    ne_physics_contacts[1] = malloc(contacts_size);
+
+    if ((ne_grid_dynamic.buckets == NULL) ||
+        (ne_grid_dynamic.categories == NULL) ||
+        (ne_grid_dynamic.large == NULL) ||
+        (ne_grid_static.buckets == NULL) ||
+        (ne_grid_static.categories == NULL) ||
+        (ne_grid_static.large == NULL) ||
+        (ne_grid_entries == NULL) || (ne_grid_objects == NULL) ||
+        (ne_grid_candidate_bits == NULL) || (ne_physics_moving == NULL) ||
+        (ne_physics_candidates == NULL) || (ne_physics_wake_list == NULL) ||
+        (ne_physics_pos == NULL) || (ne_physics_size == NULL) ||
+        (ne_physics_speed == NULL) || (ne_physics_group == NULL) ||
+        (ne_physics_category == NULL) || (ne_physics_mask == NULL) ||
+        (ne_physics_flags == NULL) || (ne_physics_contacts_new == NULL) ||
+        (ne_physics_contacts[0] == NULL) || (ne_physics_contacts[1] == NULL))
+    {
+        ne_grid_free();
+        return -1;
+    }
+
+    ne_grid_clear();
+
+    ne_physics_contacts_new_count = 0;
+    ne_physics_contacts_count[0] = 0;
+    ne_physics_contacts_count[1] = 0;
+    ne_physics_contacts_current = 0;
+
+    return 0;
+}
+
+// Adds to the candidate bit set the objects of a grid that are in the
+// specified range of cells and whose category is in the mask.
+static void ne_grid_add_candidates(const ne_grid_t *grid, uint32_t *bits,
+                                   const int *min, const int *max,
+                                   uint32_t mask)
+{
+    for (int cz = min[2]; cz <= max[2]; cz++)
+    {
+        for (int cy = min[1]; cy <= max[1]; cy++)
+        {
+            for (int cx = min[0]; cx <= max[0]; cx++)
+            {
+                int bucket = ne_grid_hash(cx, cy, cz);
+                if (!(grid->categories[bucket] & mask))
+                    continue;
+
+                int e = grid->buckets[bucket];
+                while (e != -1)
+                {
+                    int slot = ne_grid_entries[e].slot;
+                    if (ne_physics_category[slot] & mask)
+                        bits[slot >> 5] |= BIT(slot & 31);
+                    e = ne_grid_entries[e].next;
+                }
+            }
+        }
+    }
+}
+
+// Fills the list of candidates with the slots of the objects that may collide
+// with a box of the specified size centered at (x, y, z). They are sorted by
+// slot so that the result doesn't depend on the broadphase. Objects whose
+// category isn't in the mask may be skipped, but large objects are always
+// added. Returns the number of candidates.
+static int ne_physics_get_candidates(const ne_physics_vec_t *size,
+                                     int x, int y, int z, uint32_t mask)
+{
+    int count = 0;
+
+    int min[3], max[3];
+    int cells = ne_grid_cell_range(size, x, y, z, min, max);
+
+    if (!ne_physics_broadphase || (cells > NE_PHYSICS_MAX_CELLS))
+    {
+        for (int i = 0; i < NE_MAX_PHYSICS; i++)
+        {
+            if (NE_PhysicsPointers[i] != NULL)
+                ne_physics_candidates[count++] = i;
+        }
+        return count;
+    }
+
+    uint32_t *bits = ne_grid_candidate_bits;
+
+    for (int i = 0; i < ne_grid_bitset_words; i++)
+        bits[i] = ne_grid_dynamic.large[i] | ne_grid_static.large[i];
+
+    ne_grid_add_candidates(&ne_grid_dynamic, bits, min, max, mask);
+    ne_grid_add_candidates(&ne_grid_static, bits, min, max, mask);
+
+    for (int i = 0; i < ne_grid_bitset_words; i++)
+    {
+        uint32_t word = bits[i];
+        while (word != 0)
+        {
+            int bit = __builtin_ctz(word);
+            word &= word - 1;
+            ne_physics_candidates[count++] = (i << 5) + bit;
+        }
+    }
+
+    return count;
+}
+
+static bool ne_physics_is_slow(const ne_physics_vec_t *speed)
+{
+    return (abs(speed->x) < ne_physics_sleep_speed) &&
+           (abs(speed->y) < ne_physics_sleep_speed) &&
+           (abs(speed->z) < ne_physics_sleep_speed);
+}
+
+static void ne_physics_wake(NE_Physics *pointer)
+{
+    if (!pointer->sleeping)
+        return;
+
+    pointer->sleeping = false;
+    pointer->sleepframes = 0;
+    ne_physics_flags[pointer->slot] &= ~NE_PHYSICS_FLAG_SLEEPING;
+
+    // An object can go back to sleep and wake up again before the list is
+    // emptied, but each slot only needs to be in the list once. This also
+    // means that the list can never have more than NE_MAX_PHYSICS entries.
+    if (ne_physics_flags[pointer->slot] & NE_PHYSICS_FLAG_WAKE_QUEUED)
+        return;
+
+    ne_physics_flags[pointer->slot] |= NE_PHYSICS_FLAG_WAKE_QUEUED;
+    ne_physics_wake_list[ne_physics_wake_count++] = pointer->slot;
+}
+
+// Wakes up the sleeping objects that touch a box of the specified size centered
+// at pos. Only objects in the specified group whose mask includes the specified
+// category are woken up. Objects that are exactly next to each other (like a
+// box resting on top of another one) are touching.
+static void ne_physics_wake_box(const ne_physics_vec_t *pos,
+                                const ne_physics_vec_t *size, int group,
+                                uint32_t category)
+{
+    // Sleeping objects are woken up if they collide with this box, which
+    // depends on their masks, not on the mask of the object of the box. The
+    // grid only keeps track of categories, so it can't be used to skip them.
+    int num_candidates = ne_physics_get_candidates(size, pos->x, pos->y,
+                                                   pos->z, NE_PHYSICS_MASK_ALL);
+
+    for (int c = 0; c < num_candidates; c++)
+    {
+        int i = ne_physics_candidates[c];
+
+        if (!(ne_physics_mask[i] & category) ||
+            !(ne_physics_flags[i] & NE_PHYSICS_FLAG_SLEEPING) ||
+            (ne_physics_group[i] != group))
+            continue;
+
+        const ne_physics_vec_t *otherpos = &ne_physics_pos[i];
+        const ne_physics_vec_t *othersize = &ne_physics_size[i];
+
+        if ((abs(pos->x - otherpos->x) <= (size->x + othersize->x) >> 1) &&
+            (abs(pos->y - otherpos->y) <= (size->y + othersize->y) >> 1) &&
+            (abs(pos->z - otherpos->z) <= (size->z + othersize->z) >> 1))
+        {
+            ne_physics_wake(NE_PhysicsPointers[i]);
+        }
+    }
+}
+
+// Calculates the center and size of the box covered by an object along one
+// axis when it moves from pos to pos + speed. The size is rounded up so that
+// the box always covers the start and end positions.
+static void ne_physics_swept_axis(int pos, int speed, int size, int *sweptpos,
+                                  int *sweptsize)
+{
+    int dist = abs(speed);
+    int start = (speed < 0) ? pos + speed : pos;
+
+    *sweptpos = start + (dist >> 1);
+    *sweptsize = size + dist + (dist & 1);
+}
+
+// Wakes up the sleeping objects that touch the specified object.
+static void ne_physics_wake_touching(int slot)
+{
+    ne_physics_wake_box(&ne_physics_pos[slot], &ne_physics_size[slot],
+                        ne_physics_group[slot], ne_physics_category[slot]);
+}
+
+// Wakes up the islands of the objects that have woken up since the last call.
+static void ne_physics_wake_islands(void)
+{
+    while (ne_physics_wake_count > 0)
+    {
+        int slot = ne_physics_wake_list[--ne_physics_wake_count];
+        NE_Physics *pointer = NE_PhysicsPointers[slot];
+
+        ne_physics_flags[slot] &= ~NE_PHYSICS_FLAG_WAKE_QUEUED;
+
+        // The object may have been deleted after waking up
+        if ((pointer == NULL) || (pointer->model == NULL))
+            continue;
+
+        ne_physics_wake_touching(slot);
+    }
+}
+
+// Wakes up the sleeping objects that may be resting on an object that is going
+// to be deleted. The model of the object may have been deleted already, so the
+// cells that the object was in are used instead of its position.
+static void ne_physics_wake_deleted(const NE_Physics *pointer)
+{
+    ne_grid_object_t *obj = &ne_grid_objects[pointer->slot];
+
+    if (!ne_physics_broadphase || (obj->grid == NULL) || obj->large)
+    {
+        for (int i = 0; i < NE_MAX_PHYSICS; i++)
+        {
+            NE_Physics *other = NE_PhysicsPointers[i];
+            if ((other != NULL) &&
+                (other->physicsgroup == pointer->physicsgroup))
+                ne_physics_wake(other);
+        }
+        return;
+    }
+
+    // Sleeping objects are dynamic, so they are in the grid of dynamic objects
+    for (int cz = obj->min[2]; cz <= obj->max[2]; cz++)
+    {
+        for (int cy = obj->min[1]; cy <= obj->max[1]; cy++)
+        {
+            for (int cx = obj->min[0]; cx <= obj->max[0]; cx++)
+            {
+                int e = ne_grid_dynamic.buckets[ne_grid_hash(cx, cy, cz)];
+                while (e != -1)
+                {
+                    NE_Physics *other =
+                        NE_PhysicsPointers[ne_grid_entries[e].slot];
+                    if (other->physicsgroup == pointer->physicsgroup)
+                        ne_physics_wake(other);
+                    e = ne_grid_entries[e].next;
+                }
+            }
+        }
+    }
+}
+
+// Copies the state of a static object to the internal arrays and updates its
+// cells in the grid. If the object has changed, the sleeping objects that
+// touched it before the change and the ones that touch it now are woken up, or
+// they could be left floating in the air or inside of the object.
+static void ne_physics_refresh_static(NE_Physics *pointer)
+{
+    int slot = pointer->slot;
+
+    // Objects only have a shape if they had a model when they were gathered
+    uint8_t shape = ne_physics_flags[slot] & NE_PHYSICS_FLAG_SHAPE;
+    ne_physics_vec_t pos = ne_physics_pos[slot];
+    ne_physics_vec_t size = ne_physics_size[slot];
+    int group = ne_physics_group[slot];
+    uint32_t category = ne_physics_category[slot];
+
+    ne_physics_gather(pointer);
+    if (ne_physics_broadphase)
+        ne_grid_update(pointer);
+
+    uint8_t newshape = ne_physics_flags[slot] & NE_PHYSICS_FLAG_SHAPE;
+
+    if ((shape == newshape) &&
+        (memcmp(&pos, &ne_physics_pos[slot], sizeof(pos)) == 0) &&
+        (memcmp(&size, &ne_physics_size[slot], sizeof(size)) == 0) &&
+        (group == ne_physics_group[slot]) &&
+        (category == ne_physics_category[slot]))
+        return;
+
+    if (shape != 0)
+        ne_physics_wake_box(&pos, &size, group, category);
+    if (newshape != 0)
+        ne_physics_wake_touching(slot);
+}
+
+// Copies the state of all objects that aren't static to the internal arrays,
+// and the state of the static objects if they have changed. Then, it updates
+// the cells of the objects in the grid. This is needed because objects can be
+// moved, resized or created outside of the physics engine.
+static void ne_physics_refresh(void)
+{
+    for (int i = 0; i < ne_grid_bitset_words; i++)
+    {
+        uint32_t word = ne_physics_moving[i];
+        while (word != 0)
+        {
+            int bit = __builtin_ctz(word);
+            word &= word - 1;
+
+            NE_Physics *pointer = NE_PhysicsPointers[(i << 5) + bit];
+
+            ne_physics_gather(pointer);
+            if (ne_physics_broadphase)
+                ne_grid_update(pointer);
+        }
+    }
+
+    // Static objects are refreshed after the other objects because they may
+    // need to wake them up.
+    if (ne_physics_static_dirty)
+    {
+        for (int i = 0; i < NE_MAX_PHYSICS; i++)
+        {
+            NE_Physics *pointer = NE_PhysicsPointers[i];
+            if ((pointer == NULL) || (pointer->bodytype != NE_BodyStatic))
+                continue;
+
+            ne_physics_refresh_static(pointer);
+        }
+
+        ne_physics_static_dirty = false;
+    }
+}
+
+// Adds a contact between the objects in slots a and b.
+static void ne_physics_contact_add(int a, int b, int axis, int penetration)
+{
+    if (ne_physics_contacts_new_count == ne_physics_max_contacts)
+    {
+        ne_physics_stats.contacts_dropped++;
+        return;
+    }
+
+    NE_PhysicsContact *contact =
+            &ne_physics_contacts_new[ne_physics_contacts_new_count++];
+
+    contact->a = NE_PhysicsPointers[a];
+    contact->b = NE_PhysicsPointers[b];
+    contact->event = NE_ContactBegin;
+    contact->axis = axis;
+    contact->penetration = penetration;
+}
+
+// Adds a contact between the object in slot a, at the specified position, and
+// the object in slot b, calculated with their bounding boxes.
+static void ne_physics_contact_add_box(int a, int b,
+                                       const ne_physics_vec_t *pos)
+{
+    const ne_physics_vec_t *size = &ne_physics_size[a];
+    const ne_physics_vec_t *otherpos = &ne_physics_pos[b];
+    const ne_physics_vec_t *othersize = &ne_physics_size[b];
+
+    int penetration[3] = {
+        ((size->x + othersize->x) >> 1) - abs(pos->x - otherpos->x),
+        ((size->y + othersize->y) >> 1) - abs(pos->y - otherpos->y),
+        ((size->z + othersize->z) >> 1) - abs(pos->z - otherpos->z),
+    };
+
+    int axis = NE_AxisX;
+    if (penetration[NE_AxisY] < penetration[axis])
+        axis = NE_AxisY;
+    if (penetration[NE_AxisZ] < penetration[axis])
+        axis = NE_AxisZ;
+
+    ne_physics_contact_add(a, b, axis, penetration[axis]);
+}
+
+static inline int ne_physics_contact_key(const NE_PhysicsContact *contact)
+{
+    return contact->a->slot * NE_MAX_PHYSICS + contact->b->slot;
+}
+
+// Appends a contact to the current list with the specified event.
+static void ne_physics_contact_emit(const NE_PhysicsContact *contact,
+                                    NE_PhysicsContactEvent event)
+{
+    int current = ne_physics_contacts_current;
+
+    if (ne_physics_contacts_count[current] == ne_physics_max_contacts)
+    {
+        ne_physics_stats.contacts_dropped++;
+        return;
+    }
+
+    NE_PhysicsContact *out =
+            &ne_physics_contacts[current][ne_physics_contacts_count[current]++];
+
+    *out = *contact;
+    out->event = event;
+}
+
+// Merges the contacts recorded in this update with the ones of the previous
+// update. Both lists are sorted by pair of objects.
+static void ne_physics_contacts_merge(void)
+{
+    int previous = ne_physics_contacts_current;
+    ne_physics_contacts_current ^= 1;
+    ne_physics_contacts_count[ne_physics_contacts_current] = 0;
+
+    const NE_PhysicsContact *old = ne_physics_contacts[previous];
+    int old_count = ne_physics_contacts_count[previous];
+    const NE_PhysicsContact *new = ne_physics_contacts_new;
+    int new_count = ne_physics_contacts_new_count;
+
+    int i = 0, j = 0;
+    while ((i < new_count) || (j < old_count))
+    {
+        // Contacts that have ended or with deleted objects are forgotten
+        if ((j < old_count) && ((old[j].event == NE_ContactEnd) ||
+            (old[j].a == NULL) || (old[j].b == NULL)))
+        {
+            j++;
+            continue;
+        }
+
+        int new_key = (i < new_count) ? ne_physics_contact_key(&new[i])
+                                       : INT32_MAX;
+        int old_key = (j < old_count) ? ne_physics_contact_key(&old[j])
+                                       : INT32_MAX;
+
+        if (new_key == old_key)
+        {
+            ne_physics_contact_emit(&new[i++], NE_ContactStay);
+            j++;
+        }
+        else if (new_key < old_key)
+        {
+            ne_physics_contact_emit(&new[i++], NE_ContactBegin);
+        }
+        else
+        {
+            // Sleeping objects aren't tested against other objects, but they
+            // are still touching them.
+            if (old[j].a->sleeping)
+                ne_physics_contact_emit(&old[j], NE_ContactStay);
+            else
+                ne_physics_contact_emit(&old[j], NE_ContactEnd);
+            j++;
+        }
+    }
+
+    ne_physics_contacts_new_count = 0;
+}
+
+// Removes the pointers to an object that is going to be deleted from the
+// current list of contacts.
+static void ne_physics_contacts_deleted(const NE_Physics *pointer)
+{
+    int current = ne_physics_contacts_current;
+    NE_PhysicsContact *contacts = ne_physics_contacts[current];
+
+    for (int i = 0; i < ne_physics_contacts_count[current]; i++)
+    {
+        if (contacts[i].a == pointer)
+            contacts[i].a = NULL;
+        if (contacts[i].b == pointer)
+            contacts[i].b = NULL;
+    }
+}
+
 NE_Physics *NE_PhysicsCreate(NE_PhysicsTypes type)
 {
     if (!ne_physics_system_inited)
     {
-        NE_DebugPrint("System not initialized");
-        return NULL;
+        NE_DebugPrint("System not initialized");
+        return NULL;
+    }
+
+    NE_Physics *temp = calloc(1, sizeof(NE_Physics));
+    if (temp == NULL)
+    {
+        NE_DebugPrint("Not enough memory");
+        return NULL;
+    }
+
+    int i = 0;
+    while (1)
+    {
+        if (i == NE_MAX_PHYSICS)
+        {
+            free(temp);
+            NE_DebugPrint("No free slots");
+            return NULL;
+        }
+        if (NE_PhysicsPointers[i] == NULL)
+        {
+            NE_PhysicsPointers[i] = temp;
+            break;
+        }
+        i++;
+    }
+
+    temp->slot = i;
+    temp->type = type;
+    temp->bodytype = NE_BodyDynamic;
+    temp->keptpercent = 50;
+    temp->enabled = true;
+    temp->physicsgroup = 0;
+    temp->category = NE_PHYSICS_CATEGORY_DEFAULT;
+    temp->mask = NE_PHYSICS_MASK_ALL;
+    temp->oncollision = NE_ColNothing;
+
+    // Collision meshes can't be moved
+    if (type == NE_CollisionMesh)
+        temp->bodytype = NE_BodyStatic;
+    else
+        ne_physics_moving[i >> 5] |= BIT(i & 31);
+
+    return temp;
+}
+
+void NE_PhysicsDelete(NE_Physics *pointer)
+{
+    if (!ne_physics_system_inited)
+        return;
+
+    NE_AssertPointer(pointer, "NULL pointer");
+
+    int i = 0;
+    while (1)
+    {
+        if (i == NE_MAX_PHYSICS)
+        {
+            NE_DebugPrint("Object not found");
+            return;
+        }
+
+        if (NE_PhysicsPointers[i] == pointer)
+        {
+            ne_physics_contacts_deleted(pointer);
+            ne_physics_wake_deleted(pointer);
+            ne_grid_remove(i);
+            ne_physics_moving[i >> 5] &= ~BIT(i & 31);
+            // Keep the slot marked if it is in the wake list, or an object
+            // created in this slot could be added to the list a second time.
+            ne_physics_flags[i] &= NE_PHYSICS_FLAG_WAKE_QUEUED;
+            NE_PhysicsPointers[i] = NULL;
+            free(pointer);
+            return;
+        }
+        i++;
+    }
+}
+
+void NE_PhysicsDeleteAll(void)
+{
+    if (!ne_physics_system_inited)
+        return;
+
+    for (int i = 0; i < NE_MAX_PHYSICS; i++)
+    {
+        if (NE_PhysicsPointers[i] != NULL)
+            NE_PhysicsDelete(NE_PhysicsPointers[i]);
+    }
+}
+
+int NE_PhysicsSystemReset(int max_objects)
+{
+    if (ne_physics_system_inited)
+        NE_PhysicsSystemEnd();
+
+    if (max_objects < 1)
+        NE_MAX_PHYSICS = NE_DEFAULT_PHYSICS;
+    else
+        NE_MAX_PHYSICS = max_objects;
+
+    // Entries of the grid are indexed with 16-bit values
+    if (NE_MAX_PHYSICS * NE_PHYSICS_MAX_CELLS > INT16_MAX)
+    {
+        NE_DebugPrint("Too many objects");
+        return -1;
+    }
+
+    NE_PhysicsPointers = calloc(NE_MAX_PHYSICS, sizeof(NE_PhysicsPointers));
+    if (NE_PhysicsPointers == NULL)
+    {
+        NE_DebugPrint("Not enough memory");
+        return -1;
+    }
+
+    if (ne_grid_init() != 0)
+    {
+        free(NE_PhysicsPointers);
+        NE_DebugPrint("Not enough memory");
+        return -1;
+    }
+
+    ne_grid_cell_shift = ne_grid_size_to_shift(NE_DEFAULT_PHYSICS_CELL_SIZE);
+    ne_physics_sleep_speed = NE_DEFAULT_PHYSICS_SLEEP_SPEED;
+    ne_physics_sleep_frames = NE_DEFAULT_PHYSICS_SLEEP_FRAMES;
+    ne_physics_wake_count = 0;
+    ne_physics_step = 0;
+    ne_physics_accumulator = 0;
+    ne_physics_alpha = 0;
+    memset(&ne_physics_stats, 0, sizeof(ne_physics_stats));
+
+    ne_physics_system_inited = true;
+    return 0;
+}
+
+void NE_PhysicsSystemEnd(void)
+{
+    if (!ne_physics_system_inited)
+        return;
+
+    NE_PhysicsDeleteAll();
+
+    free(NE_PhysicsPointers);
+    ne_grid_free();
+
+    ne_physics_system_inited = false;
+}
+
+void NE_PhysicsSetRadiusI(NE_Physics *pointer, int radius)
+{
+    NE_AssertPointer(pointer, "NULL pointer");
+    NE_Assert(pointer->type == NE_BoundingSphere, "Not a bounding shpere");
+    NE_Assert(radius >= 0, "Radius must be positive");
+    ne_physics_wake(pointer);
+    pointer->radius = radius;
+
+    if (pointer->bodytype == NE_BodyStatic)
+        ne_physics_static_dirty = true;
+}
+
+int NE_PhysicsSetMesh(NE_Physics *pointer, const void *data)
+{
+    NE_AssertPointer(pointer, "NULL pointer");
+    NE_AssertPointer(data, "NULL data pointer");
+    NE_Assert(pointer->type == NE_CollisionMesh, "Not a collision mesh");
+
+    const ne_mesh_header_t *mesh = data;
+
+    if ((mesh->magic != NE_PHYSICS_MESH_MAGIC) ||
+        (mesh->version != NE_PHYSICS_MESH_VERSION) || (mesh->num_nodes == 0))
+    {
+        NE_DebugPrint("Invalid collision mesh");
+        return 0;
+    }
+
+    pointer->mesh = data;
+    ne_physics_static_dirty = true;
+
+    return 1;
+}
+
+void NE_PhysicsSetSpeedI(NE_Physics *pointer, int x, int y, int z)
+{
+    NE_AssertPointer(pointer, "NULL pointer");
+    ne_physics_wake(pointer);
+    pointer->xspeed = x;
+    pointer->yspeed = y;
+    pointer->zspeed = z;
+}
+
+void NE_PhysicsSetSizeI(NE_Physics *pointer, int x, int y, int z)
+{
+    NE_AssertPointer(pointer, "NULL pointer");
+    NE_Assert(pointer->type == NE_BoundingBox, "Not a bounding box");
+    NE_Assert(x >= 0 && y >= 0 && z >= 0, "Size must be positive!!");
+    ne_physics_wake(pointer);
+    pointer->xsize = x;
+    pointer->ysize = y;
+    pointer->zsize = z;
+
+    if (pointer->bodytype == NE_BodyStatic)
+        ne_physics_static_dirty = true;
+}
+
+void NE_PhysicsSetGravityI(NE_Physics *pointer, int gravity)
+{
+    NE_AssertPointer(pointer, "NULL pointer");
+    ne_physics_wake(pointer);
+    pointer->gravity = gravity;
+}
+
+void NE_PhysicsSetFrictionI(NE_Physics *pointer, int friction)
+{
+    NE_AssertPointer(pointer, "NULL pointer");
+    NE_Assert(friction >= 0, "Friction must be positive");
+    pointer->friction = friction;
+}
+
+void NE_PhysicsSetBounceEnergy(NE_Physics *pointer, int percent)
+{
+    NE_AssertPointer(pointer, "NULL pointer");
+    NE_Assert(percent >= 0, "Percentage must be positive");
+    pointer->keptpercent = percent;
+}
+
+void NE_PhysicsEnable(NE_Physics *pointer, bool value)
+{
+    NE_AssertPointer(pointer, "NULL pointer");
+    ne_physics_wake(pointer);
+    pointer->enabled = value;
+
+    if (pointer->bodytype == NE_BodyStatic)
+        ne_physics_static_dirty = true;
+}
+
+void NE_PhysicsSetBodyType(NE_Physics *pointer, NE_PhysicsBodyType type)
+{
+    NE_AssertPointer(pointer, "NULL pointer");
+
+    if (pointer->bodytype == type)
+        return;
+
+    if (pointer->type == NE_CollisionMesh)
+    {
+        NE_DebugPrint("Collision meshes must be static");
+        return;
+    }
+
+    // Only dynamic objects can sleep
+    ne_physics_wake(pointer);
+
+    int slot = pointer->slot;
+
+    // Objects that become static or stop being static change of grid
+    if ((pointer->bodytype == NE_BodyStatic) || (type == NE_BodyStatic))
+    {
+        ne_grid_remove(slot);
+        ne_physics_static_dirty = true;
+    }
+
+    pointer->bodytype = type;
+
+    if (type == NE_BodyStatic)
+        ne_physics_moving[slot >> 5] &= ~BIT(slot & 31);
+    else
+        ne_physics_moving[slot >> 5] |= BIT(slot & 31);
+}
+
+void NE_PhysicsSetContinuous(NE_Physics *pointer, bool enabled)
+{
+    NE_AssertPointer(pointer, "NULL pointer");
+    pointer->continuous = enabled;
+}
+
+void NE_PhysicsStaticChanged(void)
+{
+    ne_physics_static_dirty = true;
+}
+
+void NE_PhysicsSetModel(NE_Physics *physics, NE_Model *modelpointer)
+{
+    NE_AssertPointer(physics, "NULL physics pointer");
+    NE_AssertPointer(modelpointer, "NULL model pointer");
+    ne_physics_wake(physics);
+    physics->model = modelpointer;
+
+    if (physics->bodytype == NE_BodyStatic)
+        ne_physics_static_dirty = true;
+}
+
+void NE_PhysicsSetGroup(NE_Physics *physics, int group)
+{
+    NE_AssertPointer(physics, "NULL pointer");
+    physics->physicsgroup = group;
+
+    if (physics->bodytype == NE_BodyStatic)
+        ne_physics_static_dirty = true;
+}
+
+void NE_PhysicsSetCategory(NE_Physics *physics, uint32_t category)
+{
+    NE_AssertPointer(physics, "NULL pointer");
+
+    physics->category = category;
+
+    // The categories of the buckets of the grid only grow when objects are
+    // added, so the object needs to be added again.
+    ne_grid_remove(physics->slot);
+
+    if (physics->bodytype == NE_BodyStatic)
+        ne_physics_static_dirty = true;
+}
+
+void NE_PhysicsSetMask(NE_Physics *physics, uint32_t mask)
+{
+    NE_AssertPointer(physics, "NULL pointer");
+    ne_physics_wake(physics);
+    physics->mask = mask;
+}
+
+void NE_PhysicsOnCollision(NE_Physics *physics, NE_OnCollision action)
+{
+    NE_AssertPointer(physics, "NULL pointer");
+    physics->oncollision = action;
+}
+
+bool NE_PhysicsIsColliding(const NE_Physics *pointer)
+{
+    NE_AssertPointer(pointer, "NULL pointer");
+    return pointer->iscolliding;
+}
+
+int NE_PhysicsGetContactCount(void)
+{
+    if (!ne_physics_system_inited)
+        return 0;
+
+    return ne_physics_contacts_count[ne_physics_contacts_current];
+}
+
+const NE_PhysicsContact *NE_PhysicsGetContact(int index)
+{
+    NE_AssertMinMax(0, index, NE_PhysicsGetContactCount() - 1,
+                    "Invalid contact index: %d", index);
+
+    return &ne_physics_contacts[ne_physics_contacts_current][index];
+}
+
+void NE_PhysicsWake(NE_Physics *pointer)
+{
+    NE_AssertPointer(pointer, "NULL pointer");
+    ne_physics_wake(pointer);
+}
+
+bool NE_PhysicsIsSleeping(const NE_Physics *pointer)
+{
+    NE_AssertPointer(pointer, "NULL pointer");
+    return pointer->sleeping;
+}
+
+void NE_PhysicsSetSleepI(int speed, int frames)
+{
+    NE_Assert(speed >= 0, "Speed must be positive");
+
+    ne_physics_sleep_speed = speed;
+    ne_physics_sleep_frames = frames;
+
+    if (!ne_physics_system_inited || (frames > 0))
+        return;
+
+    for (int i = 0; i < NE_MAX_PHYSICS; i++)
+    {
+        if (NE_PhysicsPointers[i] != NULL)
+            ne_physics_wake(NE_PhysicsPointers[i]);
+        ne_physics_flags[i] &= ~NE_PHYSICS_FLAG_WAKE_QUEUED;
     }
+    ne_physics_wake_count = 0;
+}
+
+int NE_PhysicsGetAwakeCount(void)
+{
+    if (!ne_physics_system_inited)
+        return 0;
 
-    // TODO
-    if (type == NE_BoundingSphere)
+    int count = 0;
+
+    for (int i = 0; i < NE_MAX_PHYSICS; i++)
     {
-        NE_DebugPrint("Bounding spheres not supported");
-        return NULL;
+        NE_Physics *pointer = NE_PhysicsPointers[i];
+        if ((pointer == NULL) || (pointer->bodytype == NE_BodyStatic))
+            continue;
+
+        if (pointer->enabled && !pointer->sleeping)
+            count++;
     }
-    if (type == NE_Dot)
+
+    return count;
+}
+
+void NE_PhysicsSetBroadphase(bool enabled)
+{
+    // Static objects may have changed while the broadphase was disabled
+    if (enabled && !ne_physics_broadphase)
+        ne_physics_static_dirty = true;
+
+    ne_physics_broadphase = enabled;
+}
+
+void NE_PhysicsSetCellSizeI(int size)
+{
+    NE_Assert(size > 0, "Size must be positive");
+
+    ne_grid_cell_shift = ne_grid_size_to_shift(size);
+
+    // Objects are added to the grid again in the next update
+    if (ne_physics_system_inited)
+        ne_grid_clear();
+}
+
+void NE_PhysicsGetStats(NE_PhysicsStats *stats)
+{
+    NE_AssertPointer(stats, "NULL stats pointer");
+
+    *stats = ne_physics_stats;
+    memset(&ne_physics_stats, 0, sizeof(ne_physics_stats));
+}
+
+// Continuous collisions
+// =====================
+//
+// Objects that move fast can go through thin objects in one update. Objects
+// with continuous collisions look for the first object in their way, treating
+// both shapes as their bounding boxes. The time of impact is the time at which
+// the moving box enters the other box expanded by the size of the moving box
+// in all axes. If there is an impact, the moving object is placed at the point
+// of contact, one unit inside the other object along the axis of the impact.
+// This way, the regular collision checks detect the collision and the response
+// places the object at the contact.
+
+// Calculates the time at which a box that starts at "start" and moves "delta"
+// enters and exits the slab [lo, hi] along one axis, as a fraction of the
+// movement (f32). Returns false if the box doesn't touch the slab during the
+// movement. If it is already inside the slab, the enter time is -1.
+static bool ne_physics_sweep_axis(int start, int delta, int lo, int hi,
+                                  int *tenter, int *texit)
+{
+    lo -= start;
+    hi -= start;
+
+    // Mirror the axis so that the movement is always positive
+    if (delta < 0)
     {
-        NE_DebugPrint("Dots not supported");
-        return NULL;
+        int temp = lo;
+        lo = -hi;
+        hi = -temp;
+        delta = -delta;
     }
 
-    NE_Physics *temp = calloc(1, sizeof(NE_Physics));
-    if (temp == NULL)
+    if (delta == 0)
     {
-        NE_DebugPrint("Not enough memory");
-        return NULL;
+        if ((lo >= 0) || (hi <= 0))
+            return false;
+
+        *tenter = -1;
+        *texit = inttof32(1);
+        return true;
     }
 
-    int i = 0;
-    while (1)
+    if ((lo >= delta) || (hi <= 0))
+        return false;
+
+    // The checks above ensure that the divisions don't overflow
+    *tenter = (lo < 0) ? -1 : divf32(lo, delta);
+    *texit = (hi >= delta) ? inttof32(1) : divf32(hi, delta);
+    return true;
+}
+
+// Moves an object from the position before the movement to the point of
+// contact with the first object in its way, if any.
+static void ne_physics_sweep(int slot, int bposx, int bposy, int bposz)
+{
+    ne_physics_vec_t *pos = &ne_physics_pos[slot];
+    const ne_physics_vec_t *size = &ne_physics_size[slot];
+
+    int start[3] = { bposx, bposy, bposz };
+    int delta[3] = { pos->x - bposx, pos->y - bposy, pos->z - bposz };
+    int sizes[3] = { size->x, size->y, size->z };
+
+    if ((delta[0] == 0) && (delta[1] == 0) && (delta[2] == 0))
+        return;
+
+    if (!(ne_physics_flags[slot] & NE_PHYSICS_FLAG_SHAPE))
+        return;
+
+    // Box that contains the object during all the movement
+    ne_physics_vec_t sweptsize = {
+        size->x + abs(delta[0]) + 1,
+        size->y + abs(delta[1]) + 1,
+        size->z + abs(delta[2]) + 1
+    };
+
+    uint32_t mask = ne_physics_mask[slot];
+
+    int num_candidates = ne_physics_get_candidates(&sweptsize,
+                                                   bposx + (delta[0] >> 1),
+                                                   bposy + (delta[1] >> 1),
+                                                   bposz + (delta[2] >> 1),
+                                                   mask);
+
+    int group = ne_physics_group[slot];
+
+    int best_time = inttof32(1);
+    int best_slot = -1;
+    int best_axis = 0;
+
+    for (int c = 0; c < num_candidates; c++)
     {
-        if (i == NE_MAX_PHYSICS)
+        int i = ne_physics_candidates[c];
+
+        // Collision meshes are checked with the regular test only
+        uint8_t otherflags = ne_physics_flags[i];
+        if (!(ne_physics_category[i] & mask) || (i == slot) ||
+            (ne_physics_group[i] != group) ||
+            !(otherflags & NE_PHYSICS_FLAG_SHAPE) ||
+            (otherflags & NE_PHYSICS_FLAG_MESH))
+            continue;
+
+        ne_physics_stats.pair_tests++;
+
+        const ne_physics_vec_t *otherpos = &ne_physics_pos[i];
+        const ne_physics_vec_t *othersize = &ne_physics_size[i];
+
+        int other[3] = { otherpos->x, otherpos->y, otherpos->z };
+        int othersizes[3] = { othersize->x, othersize->y, othersize->z };
+
+        int tenter = -1, texit = inttof32(1), axis = 0;
+        bool hit = true;
+
+        for (int k = 0; k < 3; k++)
         {
-            free(temp);
-            NE_DebugPrint("No free slots");
-            return NULL;
+            int dist = (sizes[k] + othersizes[k]) >> 1;
+            int enter, exit;
+
+            if (!ne_physics_sweep_axis(start[k], delta[k], other[k] - dist,
+                                       other[k] + dist, &enter, &exit))
+            {
+                hit = false;
+                break;
+            }
+
+            if (enter > tenter)
+            {
+                tenter = enter;
+                axis = k;
+            }
+            if (exit < texit)
+                texit = exit;
         }
-        if (NE_PhysicsPointers[i] == NULL)
+
+        // Objects that overlap at the start are left to the regular checks
+        if (!hit || (tenter < 0) || (tenter >= texit))
+            continue;
+
+        if (tenter < best_time)
         {
-            NE_PhysicsPointers[i] = temp;
-            break;
+            best_time = tenter;
+            best_slot = i;
+            best_axis = axis;
         }
-        i++;
     }
 
-    temp->type = type;
-    temp->keptpercent = 50;
-    temp->enabled = true;
-    temp->physicsgroup = 0;
-    temp->oncollision = NE_ColNothing;
+    if (best_slot == -1)
+        return;
 
-    return temp;
+    int result[3];
+    for (int k = 0; k < 3; k++)
+        result[k] = start[k] + mulf32(delta[k], best_time);
+
+    const ne_physics_vec_t *otherpos = &ne_physics_pos[best_slot];
+    const ne_physics_vec_t *othersize = &ne_physics_size[best_slot];
+    int other[3] = { otherpos->x, otherpos->y, otherpos->z };
+    int othersizes[3] = { othersize->x, othersize->y, othersize->z };
+
+    int k = best_axis;
+    int dist = (sizes[k] + othersizes[k]) >> 1;
+    if (delta[k] > 0)
+        result[k] = other[k] - dist + 1;
+    else
+        result[k] = other[k] + dist - 1;
+
+    pos->x = result[0];
+    pos->y = result[1];
+    pos->z = result[2];
 }
 
-void NE_PhysicsDelete(NE_Physics *pointer)
+// Collision meshes
+// ================
+//
+// Spheres and boxes are tested against the triangles in the leaves of the
+// bounding volume hierarchy that their bounding box overlaps. Triangles are
+// one-sided: objects whose center is behind the plane of a triangle don't
+// collide with it. Objects are pushed out of each triangle they overlap, one
+// triangle after another, along the normal of the contact.
+//
+// All tests use coordinates relative to the origin of the mesh.
+
+static inline int64_t ne_mesh_dot(const int32_t *a, const int32_t *b)
 {
-    if (!ne_physics_system_inited)
-        return;
+    return (int64_t)a[0] * b[0] + (int64_t)a[1] * b[1] + (int64_t)a[2] * b[2];
+}
 
-    NE_AssertPointer(pointer, "NULL pointer");
+// Tests a sphere against a triangle. If they overlap, it returns the normal of
+// the contact and the penetration along it.
+static bool ne_mesh_sphere_triangle(const ne_mesh_triangle_t *tri,
+                                    const int32_t *center, int radius,
+                                    int32_t *normal, int *penetration)
+{
+    const int32_t *n = tri->normal;
 
-    int i = 0;
-    while (1)
+    int32_t rel[3];
+    for (int i = 0; i < 3; i++)
+        rel[i] = center[i] - tri->v[0][i];
+
+    // Distance from the center to the plane of the triangle
+    int dist = ne_mesh_dot(n, rel) >> 12;
+    if ((dist < 0) || (dist >= radius))
+        return false;
+
+    // If the projection of the center is inside the triangle, the closest
+    // point is the projection.
+    bool inside = true;
+    for (int e = 0; e < 3; e++)
     {
-        if (i == NE_MAX_PHYSICS)
+        const int32_t *a = tri->v[e];
+        const int32_t *b = tri->v[(e + 1) % 3];
+
+        int32_t edge[3], to_center[3];
+        for (int i = 0; i < 3; i++)
         {
-            NE_DebugPrint("Object not found");
-            return;
+            edge[i] = b[i] - a[i];
+            to_center[i] = center[i] - a[i];
         }
 
-        if (NE_PhysicsPointers[i] == pointer)
+        int64_t cross[3] = {
+            ((int64_t)edge[1] * to_center[2] - (int64_t)edge[2] * to_center[1])
+                >> 12,
+            ((int64_t)edge[2] * to_center[0] - (int64_t)edge[0] * to_center[2])
+                >> 12,
+            ((int64_t)edge[0] * to_center[1] - (int64_t)edge[1] * to_center[0])
+                >> 12,
+        };
+
+        if (cross[0] * n[0] + cross[1] * n[1] + cross[2] * n[2] < 0)
         {
-            NE_PhysicsPointers[i] = NULL;
-            free(pointer);
-            return;
+            inside = false;
+            break;
+        }
+    }
+
+    if (inside)
+    {
+        for (int i = 0; i < 3; i++)
+            normal[i] = n[i];
+        *penetration = radius - dist;
+        return true;
+    }
+
+    // If not, the closest point is in one of the edges
+    int64_t best_dist2 = INT64_MAX;
+    int32_t best_diff[3] = { 0, 0, 0 };
+
+    for (int e = 0; e < 3; e++)
+    {
+        const int32_t *a = tri->v[e];
+        const int32_t *b = tri->v[(e + 1) % 3];
+
+        int32_t edge[3], to_center[3];
+        for (int i = 0; i < 3; i++)
+        {
+            edge[i] = b[i] - a[i];
+            to_center[i] = center[i] - a[i];
+        }
+
+        // Position of the closest point along the edge (f32, 0 to 1)
+        int64_t len2 = ne_mesh_dot(edge, edge);
+        int64_t proj = ne_mesh_dot(to_center, edge);
+        int t;
+        if (proj <= 0)
+            t = 0;
+        else if (proj >= len2)
+            t = inttof32(1);
+        else
+            t = (proj << 12) / len2;
+
+        int32_t diff[3];
+        for (int i = 0; i < 3; i++)
+            diff[i] = to_center[i] - (((int64_t)edge[i] * t) >> 12);
+
+        int64_t dist2 = ne_mesh_dot(diff, diff);
+        if (dist2 < best_dist2)
+        {
+            best_dist2 = dist2;
+            for (int i = 0; i < 3; i++)
+                best_diff[i] = diff[i];
         }
-        i++;
     }
+
+    if (best_dist2 >= (int64_t)radius * radius)
+        return false;
+
+    int len = sqrtf32(best_dist2 >> 12);
+    if (len == 0)
+    {
+        for (int i = 0; i < 3; i++)
+            normal[i] = n[i];
+        *penetration = radius;
+        return true;
+    }
+
+    for (int i = 0; i < 3; i++)
+        normal[i] = ((int64_t)best_diff[i] << 12) / len;
+    *penetration = radius - len;
+    return true;
 }
 
-void NE_PhysicsDeleteAll(void)
+// Tests a box against a triangle with the separating axis theorem. The axes are
+// the normal of the triangle, the axes of the box, and the cross products of
+// the edges of the triangle and the axes of the box. If they overlap, it
+// returns the normal of the triangle and the penetration along it.
+static bool ne_mesh_box_triangle(const ne_mesh_triangle_t *tri,
+                                 const int32_t *center, const int32_t *half,
+                                 int32_t *normal, int *penetration)
 {
-    if (!ne_physics_system_inited)
-        return;
+    int32_t v[3][3];
+    for (int j = 0; j < 3; j++)
+    {
+        for (int i = 0; i < 3; i++)
+            v[j][i] = tri->v[j][i] - center[i];
+    }
 
-    for (int i = 0; i < NE_MAX_PHYSICS; i++)
-        NE_PhysicsDelete(NE_PhysicsPointers[i]);
+    // Axes of the box
+    for (int i = 0; i < 3; i++)
+    {
+        int32_t min = v[0][i], max = v[0][i];
+        for (int j = 1; j < 3; j++)
+        {
+            if (v[j][i] < min)
+                min = v[j][i];
+            if (v[j][i] > max)
+                max = v[j][i];
+        }
+
+        if ((min >= half[i]) || (max <= -half[i]))
+            return false;
+    }
+
+    // Normal of the triangle. The distance is negative if the center of the box
+    // is behind the triangle.
+    const int32_t *n = tri->normal;
+
+    int dist = -ne_mesh_dot(n, v[0]) >> 12;
+    int extent = ((int64_t)abs(n[0]) * half[0] + (int64_t)abs(n[1]) * half[1] +
+                  (int64_t)abs(n[2]) * half[2]) >> 12;
+
+    if ((dist < 0) || (dist >= extent))
+        return false;
+
+    // Cross products of the edges and the axes of the box. The axis for edge e
+    // and box axis i has a 0 in component i, so only the other two are used.
+    for (int e = 0; e < 3; e++)
+    {
+        int32_t edge[3];
+        for (int i = 0; i < 3; i++)
+            edge[i] = v[(e + 1) % 3][i] - v[e][i];
+
+        for (int i = 0; i < 3; i++)
+        {
+            int j = (i + 1) % 3;
+            int k = (i + 2) % 3;
+
+            // Axis = box axis i x edge = (0, -edge[k], edge[j]) for i = X
+            if ((edge[j] == 0) && (edge[k] == 0))
+                continue;
+
+            int64_t r = (int64_t)half[j] * abs(edge[k]) +
+                        (int64_t)half[k] * abs(edge[j]);
+
+            int64_t min = INT64_MAX, max = INT64_MIN;
+            for (int p = 0; p < 3; p++)
+            {
+                int64_t d = (int64_t)edge[j] * v[p][k] -
+                            (int64_t)edge[k] * v[p][j];
+                if (d < min)
+                    min = d;
+                if (d > max)
+                    max = d;
+            }
+
+            if ((min >= r) || (max <= -r))
+                return false;
+        }
+    }
+
+    for (int i = 0; i < 3; i++)
+        normal[i] = n[i];
+    *penetration = extent - dist;
+    return true;
 }
 
-int NE_PhysicsSystemReset(int max_objects)
+// Collides a sphere or a box at the specified position with a collision mesh.
+// If "pointer" isn't NULL, the shape is pushed out of the triangles according
+// to the action of the object, and its speed is changed. If it is NULL, it
+// returns as soon as a triangle overlaps the shape. The axis and penetration
+// of the deepest contact are returned in "axis" and "penetration".
+static bool ne_physics_mesh_collide(const ne_mesh_header_t *mesh,
+                                    const ne_physics_vec_t *meshpos,
+                                    const NE_Physics *pointer, uint8_t shape,
+                                    ne_physics_vec_t *pos,
+                                    const ne_physics_vec_t *size,
+                                    ne_physics_vec_t *speed,
+                                    int *axis, int *penetration)
 {
-    if (ne_physics_system_inited)
-        NE_PhysicsSystemEnd();
+    // Dots are too small to collide with triangles
+    if (!(shape & (NE_PHYSICS_FLAG_BOX | NE_PHYSICS_FLAG_SPHERE)))
+        return false;
 
-    if (max_objects < 1)
-        NE_MAX_PHYSICS = NE_DEFAULT_PHYSICS;
-    else
-        NE_MAX_PHYSICS = max_objects;
+    const ne_mesh_node_t *nodes = ne_mesh_nodes(mesh);
+    const ne_mesh_triangle_t *triangles = ne_mesh_triangles(mesh);
 
-    NE_PhysicsPointers = calloc(NE_MAX_PHYSICS, sizeof(NE_PhysicsPointers));
-    if (NE_PhysicsPointers == NULL)
+    int32_t center[3] = {
+        pos->x - meshpos->x, pos->y - meshpos->y, pos->z - meshpos->z
+    };
+    int32_t half[3] = { size->x >> 1, size->y >> 1, size->z >> 1 };
+
+    NE_OnCollision action = NE_ColNothing;
+    int kept = 0;
+    if (pointer != NULL)
     {
-        NE_DebugPrint("Not enough memory");
-        return -1;
+        action = pointer->oncollision;
+        if (action == NE_ColBounce)
+            kept = divf32(inttof32(pointer->keptpercent), inttof32(100));
     }
 
-    ne_physics_system_inited = true;
-    return 0;
+    bool collided = false;
+    *penetration = -1;
+
+    int stack[NE_PHYSICS_MESH_MAX_DEPTH + 1];
+    int top = 0;
+    stack[top++] = 0;
+
+    while (top > 0)
+    {
+        int index = stack[--top];
+        const ne_mesh_node_t *node = &nodes[index];
+
+        if ((center[0] + half[0] < node->min[0]) ||
+            (center[0] - half[0] > node->max[0]) ||
+            (center[1] + half[1] < node->min[1]) ||
+            (center[1] - half[1] > node->max[1]) ||
+            (center[2] + half[2] < node->min[2]) ||
+            (center[2] - half[2] > node->max[2]))
+            continue;
+
+        if (node->count == 0)
+        {
+            NE_Assert(top + 2 <= NE_PHYSICS_MESH_MAX_DEPTH + 1,
+                      "Collision mesh too deep");
+            stack[top++] = node->first;
+            stack[top++] = index + 1;
+            continue;
+        }
+
+        for (int t = node->first; t < node->first + node->count; t++)
+        {
+            int32_t normal[3];
+            int pen;
+
+            bool hit;
+            if (shape & NE_PHYSICS_FLAG_SPHERE)
+                hit = ne_mesh_sphere_triangle(&triangles[t], center, half[0],
+                                              normal, &pen);
+            else
+                hit = ne_mesh_box_triangle(&triangles[t], center, half,
+                                           normal, &pen);
+            if (!hit)
+                continue;
+
+            collided = true;
+
+            if (pen > *penetration)
+            {
+                *penetration = pen;
+                *axis = NE_AxisX;
+                if (abs(normal[1]) > abs(normal[*axis]))
+                    *axis = NE_AxisY;
+                if (abs(normal[2]) > abs(normal[*axis]))
+                    *axis = NE_AxisZ;
+            }
+
+            if (pointer == NULL)
+                return true;
+
+            if (action == NE_ColNothing)
+                continue;
+
+            for (int i = 0; i < 3; i++)
+                center[i] += mulf32(normal[i], pen);
+
+            if (action == NE_ColStop)
+            {
+                speed->x = speed->y = speed->z = 0;
+                continue;
+            }
+
+            // Remove the speed towards the triangle, and bounce with the part
+            // of it that is kept.
+            int vn = (int)(((int64_t)speed->x * normal[0] +
+                            (int64_t)speed->y * normal[1] +
+                            (int64_t)speed->z * normal[2]) >> 12);
+            if (vn >= 0)
+                continue;
+
+            int change = vn;
+            if (-vn > NE_MIN_BOUNCE_SPEED)
+                change += mulf32(kept, vn);
+
+            speed->x -= mulf32(normal[0], change);
+            speed->y -= mulf32(normal[1], change);
+            speed->z -= mulf32(normal[2], change);
+        }
+    }
+
+    pos->x = center[0] + meshpos->x;
+    pos->y = center[1] + meshpos->y;
+    pos->z = center[2] + meshpos->z;
+
+    return collided;
 }
 
-void NE_PhysicsSystemEnd(void)
+static void ne_physics_update(NE_Physics *pointer);
+
+void NE_PhysicsUpdateAll(void)
 {
     if (!ne_physics_system_inited)
         return;
 
-    NE_PhysicsDeleteAll();
+    ne_physics_refresh();
+    ne_physics_wake_islands();
 
-    free(NE_PhysicsPointers);
+    ne_physics_recording = true;
 
-    ne_physics_system_inited = false;
-}
+    // Static objects are never updated, so only the others are checked
+    for (int i = 0; i < ne_grid_bitset_words; i++)
+    {
+        uint32_t word = ne_physics_moving[i];
+        while (word != 0)
+        {
+            int bit = __builtin_ctz(word);
+            word &= word - 1;
+            ne_physics_update(NE_PhysicsPointers[(i << 5) + bit]);
+        }
+    }
 
-void NE_PhysicsSetRadiusI(NE_Physics *pointer, int radius)
-{
-    NE_AssertPointer(pointer, "NULL pointer");
-    NE_Assert(pointer->type == NE_BoundingSphere, "Not a bounding shpere");
-    NE_Assert(radius >= 0, "Radius must be positive");
-    pointer->radius = radius;
-}
+    ne_physics_recording = false;
+    ne_physics_contacts_merge();
 
-void NE_PhysicsSetSpeedI(NE_Physics *pointer, int x, int y, int z)
-{
-    NE_AssertPointer(pointer, "NULL pointer");
-    pointer->xspeed = x;
-    pointer->yspeed = y;
-    pointer->zspeed = z;
+    for (int i = 0; i < ne_grid_bitset_words; i++)
+    {
+        uint32_t word = ne_physics_moving[i];
+        while (word != 0)
+        {
+            int bit = __builtin_ctz(word);
+            word &= word - 1;
+            ne_physics_scatter(NE_PhysicsPointers[(i << 5) + bit]);
+        }
+    }
 }
 
-void NE_PhysicsSetSizeI(NE_Physics *pointer, int x, int y, int z)
+void NE_PhysicsUpdate(NE_Physics *pointer)
 {
-    NE_AssertPointer(pointer, "NULL pointer");
-    NE_Assert(pointer->type == NE_BoundingBox, "Not a bounding box");
-    NE_Assert(x >= 0 && y >= 0 && z >= 0, "Size must be positive!!");
-    pointer->xsize = x;
-    pointer->ysize = y;
-    pointer->zsize = z;
-}
+    if (!ne_physics_system_inited)
+        return;
 
-void NE_PhysicsSetGravityI(NE_Physics *pointer, int gravity)
-{
-    NE_AssertPointer(pointer, "NULL pointer");
-    pointer->gravity = gravity;
-}
+    ne_physics_refresh();
+    ne_physics_wake_islands();
 
-void NE_PhysicsSetFrictionI(NE_Physics *pointer, int friction)
-{
-    NE_AssertPointer(pointer, "NULL pointer");
-    NE_Assert(friction >= 0, "Friction must be positive");
-    pointer->friction = friction;
+    ne_physics_update(pointer);
+    ne_physics_scatter(pointer);
 }
 
-void NE_PhysicsSetBounceEnergy(NE_Physics *pointer, int percent)
+// Returns true if the object is moved by the physics engine.
+static inline bool ne_physics_is_interpolated(const NE_Physics *pointer)
 {
-    NE_AssertPointer(pointer, "NULL pointer");
-    NE_Assert(percent >= 0, "Percentage must be positive");
-    pointer->keptpercent = percent;
+    return (pointer != NULL) && pointer->enabled && (pointer->model != NULL) &&
+           (pointer->bodytype != NE_BodyStatic);
 }
 
-void NE_PhysicsEnable(NE_Physics *pointer, bool value)
+// Moves a model that has been interpolated back to its real position along one
+// axis. If the model has been moved by the user since it was interpolated, its
+// position is the real one, and it isn't interpolated in the next step.
+static inline void ne_physics_uninterpolate(int *model, int *prev, int curr)
 {
-    NE_AssertPointer(pointer, "NULL pointer");
-    pointer->enabled = value;
+    if (*model == *prev + mulf32(curr - *prev, ne_physics_alpha))
+        *model = curr;
+    else
+        *prev = *model;
 }
 
-void NE_PhysicsSetModel(NE_Physics *physics, NE_Model *modelpointer)
+void NE_PhysicsSetFixedStepI(int step, int max_steps)
 {
-    NE_AssertPointer(physics, "NULL physics pointer");
-    NE_AssertPointer(modelpointer, "NULL model pointer");
-    physics->model = modelpointer;
-}
+    if (!ne_physics_system_inited)
+        return;
 
-void NE_PhysicsSetGroup(NE_Physics *physics, int group)
-{
-    NE_AssertPointer(physics, "NULL pointer");
-    physics->physicsgroup = group;
-}
+    NE_Assert((step <= 0) || (max_steps > 0),
+              "The max number of steps must be positive");
 
-void NE_PhysicsOnCollision(NE_Physics *physics, NE_OnCollision action)
-{
-    NE_AssertPointer(physics, "NULL pointer");
-    physics->oncollision = action;
-}
+    ne_physics_step = (step > 0) ? step : 0;
+    ne_physics_max_steps = max_steps;
+    ne_physics_accumulator = 0;
+    ne_physics_alpha = 0;
 
-bool NE_PhysicsIsColliding(const NE_Physics *pointer)
-{
-    NE_AssertPointer(pointer, "NULL pointer");
-    return pointer->iscolliding;
+    // Objects start at the position of their models
+    for (int i = 0; i < NE_MAX_PHYSICS; i++)
+    {
+        NE_Physics *pointer = NE_PhysicsPointers[i];
+        if (!ne_physics_is_interpolated(pointer))
+            continue;
+
+        pointer->prevx = pointer->currx = pointer->model->x;
+        pointer->prevy = pointer->curry = pointer->model->y;
+        pointer->prevz = pointer->currz = pointer->model->z;
+    }
 }
 
-void NE_PhysicsUpdateAll(void)
+int NE_PhysicsAdvanceI(int time)
 {
     if (!ne_physics_system_inited)
-        return;
+        return 0;
 
+    if (ne_physics_step == 0)
+    {
+        NE_PhysicsUpdateAll();
+        return 1;
+    }
+
+    // Move the models back to their real positions
     for (int i = 0; i < NE_MAX_PHYSICS; i++)
     {
-        if (NE_PhysicsPointers[i] != NULL)
-            NE_PhysicsUpdate(NE_PhysicsPointers[i]);
+        NE_Physics *pointer = NE_PhysicsPointers[i];
+        if (!ne_physics_is_interpolated(pointer))
+            continue;
+
+        NE_Model *model = pointer->model;
+
+        ne_physics_uninterpolate(&model->x, &pointer->prevx, pointer->currx);
+        ne_physics_uninterpolate(&model->y, &pointer->prevy, pointer->curry);
+        ne_physics_uninterpolate(&model->z, &pointer->prevz, pointer->currz);
+    }
+
+    // The time that doesn't fit in the max number of steps is dropped, so it
+    // can be limited before adding it to the accumulator to prevent overflows.
+    int max_time = ne_physics_step * ne_physics_max_steps;
+    if (time > max_time)
+        time = max_time;
+
+    ne_physics_accumulator += time;
+
+    int steps = 0;
+    while ((ne_physics_accumulator >= ne_physics_step) &&
+           (steps < ne_physics_max_steps))
+    {
+        for (int i = 0; i < NE_MAX_PHYSICS; i++)
+        {
+            NE_Physics *pointer = NE_PhysicsPointers[i];
+            if (!ne_physics_is_interpolated(pointer))
+                continue;
+
+            pointer->prevx = pointer->model->x;
+            pointer->prevy = pointer->model->y;
+            pointer->prevz = pointer->model->z;
+        }
+
+        NE_PhysicsUpdateAll();
+
+        ne_physics_accumulator -= ne_physics_step;
+        steps++;
+    }
+
+    // Drop the time that couldn't be simulated
+    if (ne_physics_accumulator >= ne_physics_step)
+        ne_physics_accumulator %= ne_physics_step;
+
+    ne_physics_alpha = divf32(ne_physics_accumulator, ne_physics_step);
+
+    // Place the models between their last two positions
+    for (int i = 0; i < NE_MAX_PHYSICS; i++)
+    {
+        NE_Physics *pointer = NE_PhysicsPointers[i];
+        if (!ne_physics_is_interpolated(pointer))
+            continue;
+
+        NE_Model *model = pointer->model;
+
+        pointer->currx = model->x;
+        pointer->curry = model->y;
+        pointer->currz = model->z;
+
+        model->x = pointer->prevx + mulf32(model->x - pointer->prevx,
+                                           ne_physics_alpha);
+        model->y = pointer->prevy + mulf32(model->y - pointer->prevy,
+                                           ne_physics_alpha);
+        model->z = pointer->prevz + mulf32(model->z - pointer->prevz,
+                                           ne_physics_alpha);
     }
+
+    return steps;
 }
 
-void NE_PhysicsUpdate(NE_Physics *pointer)
+int NE_PhysicsGetInterpolation(void)
 {
-    if (!ne_physics_system_inited)
-        return;
+    return ne_physics_alpha;
+}
 
+ITCM_CODE ARM_CODE
+static void ne_physics_update(NE_Physics *pointer)
+{
     NE_AssertPointer(pointer, "NULL pointer");
     NE_AssertPointer(pointer->model, "NULL model pointer");
     NE_Assert(pointer->type != 0, "Object has no type");
 
-    if (pointer->enabled == false)
+    if ((pointer->enabled == false) || (pointer->bodytype == NE_BodyStatic))
         return;
 
+    int slot = pointer->slot;
+    ne_physics_vec_t *pos = &ne_physics_pos[slot];
+    ne_physics_vec_t *speed = &ne_physics_speed[slot];
+    const ne_physics_vec_t *size = &ne_physics_size[slot];
+
+    // Sleeping objects are only woken up if their model has been moved
+    if (pointer->sleeping)
+    {
+        if ((pos->x == pointer->sleepx) && (pos->y == pointer->sleepy) &&
+            (pos->z == pointer->sleepz))
+            return;
+
+        ne_physics_wake(pointer);
+    }
+
     pointer->iscolliding = false;
 
+    // Kinematic objects move with their speed, but they aren't affected by
+    // gravity, friction or collisions.
+    if (pointer->bodytype == NE_BodyKinematic)
+    {
+        if ((speed->x != 0) || (speed->y != 0) || (speed->z != 0))
+        {
+            // Wake up the objects that touch the object anywhere between its
+            // previous and new positions. This includes the objects that
+            // rest on it, which would be left floating in the air otherwise.
+            ne_physics_vec_t sweptpos, sweptsize;
+            ne_physics_swept_axis(pos->x, speed->x, size->x,
+                                  &sweptpos.x, &sweptsize.x);
+            ne_physics_swept_axis(pos->y, speed->y, size->y,
+                                  &sweptpos.y, &sweptsize.y);
+            ne_physics_swept_axis(pos->z, speed->z, size->z,
+                                  &sweptpos.z, &sweptsize.z);
+
+            ne_physics_wake_box(&sweptpos, &sweptsize, ne_physics_group[slot],
+                                ne_physics_category[slot]);
+        }
+
+        pos->x += speed->x;
+        pos->y += speed->y;
+        pos->z += speed->z;
+
+        if (ne_physics_broadphase)
+            ne_grid_update(pointer);
+        return;
+    }
+
     // We change Y speed depending on gravity.
-    pointer->yspeed -= pointer->gravity;
+    speed->y -= pointer->gravity;
 
     // Now, let's move the object
 
-    // Used in collision checking to simplify the code
-    int posx = 0, posy = 0, posz = 0;
     // Position before movement
-    int bposx = 0, bposy = 0, bposz = 0;
+    int bposx = pos->x;
+    int bposy = pos->y;
+    int bposz = pos->z;
 
-    NE_Model *model = pointer->model;
-    bposx = model->x;
-    bposy = model->y;
-    bposz = model->z;
-    posx = model->x = model->x + pointer->xspeed;
-    posy = model->y = model->y + pointer->yspeed;
-    posz = model->z = model->z + pointer->zspeed;
+    pos->x += speed->x;
+    pos->y += speed->y;
+    pos->z += speed->z;
+
+    if (pointer->continuous)
+        ne_physics_sweep(slot, bposx, bposy, bposz);
+
+    // Used in collision checking to simplify the code
+    int posx = pos->x;
+    int posy = pos->y;
+    int posz = pos->z;
 
     // Gravity and movement have been applied, time to check collisions...
     bool xenabled = true, yenabled = true, zenabled = true;
@@ -264,144 +2312,186 @@ void NE_PhysicsUpdate(NE_Physics *pointer)
     if (bposz == posz)
         zenabled = false;
 
-    for (int i = 0; i < NE_MAX_PHYSICS; i++)
+    // Sleeping objects are only woken up by objects that aren't slow, not by
+    // objects that are resting on them.
+    bool moving = !ne_physics_is_slow(speed);
+
+    int group = ne_physics_group[slot];
+    uint32_t mask = ne_physics_mask[slot];
+    uint8_t shape = ne_physics_flags[slot] & NE_PHYSICS_FLAG_SHAPE;
+
+    // Used to reduce speed after a bounce
+    int kept = 0;
+    if (pointer->oncollision == NE_ColBounce)
+        kept = divf32(inttof32(pointer->keptpercent), inttof32(100));
+
+    // The position may be corrected by the collisions, but all tests use the
+    // position after the movement.
+    const ne_physics_vec_t moved = { posx, posy, posz };
+
+    int num_candidates = ne_physics_get_candidates(size, posx, posy, posz,
+                                                   mask);
+
+    for (int c = 0; c < num_candidates; c++)
     {
-        if (NE_PhysicsPointers[i] == NULL)
+        int i = ne_physics_candidates[c];
+
+        // Check that the object collides with objects of the other category
+        if (!(ne_physics_category[i] & mask))
             continue;
 
         // Check that we aren't checking an object with itself
-        if (NE_PhysicsPointers[i] == pointer)
+        if (i == slot)
             continue;
 
         // Check that both objects are in the same group
-        if (NE_PhysicsPointers[i]->physicsgroup != pointer->physicsgroup)
+        if (ne_physics_group[i] != group)
             continue;
 
-        NE_Physics *otherpointer = NE_PhysicsPointers[i];
-        //Get coordinates
-        int otherposx = 0, otherposy = 0, otherposz = 0;
+        // Check that both objects have a shape
+        uint8_t otherflags = ne_physics_flags[i];
+        if ((shape == 0) || !(otherflags & NE_PHYSICS_FLAG_SHAPE))
+            continue;
 
-        model = otherpointer->model;
-        otherposx = model->x;
-        otherposy = model->y;
-        otherposz = model->z;
+        ne_physics_stats.pair_tests++;
 
-        // Both are boxes
-        if (pointer->type == NE_BoundingBox && otherpointer->type == NE_BoundingBox)
-        {
-            bool collision =
-                ((abs(posx - otherposx) < (pointer->xsize + otherpointer->xsize) >> 1) &&
-                (abs(posy - otherposy) < (pointer->ysize + otherpointer->ysize) >> 1) &&
-                (abs(posz - otherposz) < (pointer->zsize + otherpointer->zsize) >> 1));
+        const ne_physics_vec_t *otherpos = &ne_physics_pos[i];
+        const ne_physics_vec_t *othersize = &ne_physics_size[i];
 
-            if (!collision)
+        if (otherflags & NE_PHYSICS_FLAG_MESH)
+        {
+            int axis, penetration;
+            if (!ne_physics_mesh_collide(NE_PhysicsPointers[i]->mesh, otherpos,
+                                         pointer, shape, pos, size, speed,
+                                         &axis, &penetration))
                 continue;
 
             pointer->iscolliding = true;
 
-            if (pointer->oncollision == NE_ColBounce)
+            if (ne_physics_recording)
+                ne_physics_contact_add(slot, i, axis, penetration);
+            continue;
+        }
+
+        if (!ne_physics_shapes_overlap(shape, &moved, size,
+                                       otherflags, otherpos, othersize))
+            continue;
+
+        int otherposx = otherpos->x;
+        int otherposy = otherpos->y;
+        int otherposz = otherpos->z;
+
+        // Distance between the centers of the bounding boxes when they touch
+        int distx = (size->x + othersize->x) >> 1;
+        int disty = (size->y + othersize->y) >> 1;
+        int distz = (size->z + othersize->z) >> 1;
+
+        pointer->iscolliding = true;
+
+        if (ne_physics_recording)
+            ne_physics_contact_add_box(slot, i, &moved);
+
+        if (moving && (ne_physics_flags[i] & NE_PHYSICS_FLAG_SLEEPING))
+            ne_physics_wake(NE_PhysicsPointers[i]);
+
+        if (pointer->oncollision == NE_ColBounce)
+        {
+            if ((yenabled) && (abs(bposy - otherposy) >= disty))
             {
-                // Used to reduce speed:
-                int temp = divf32(inttof32(pointer->keptpercent), inttof32(100));
-                if ((yenabled) && ((abs(bposy - otherposy) >= (pointer->ysize + otherpointer->ysize) >> 1)))
+                yenabled = false;
+                speed->y += pointer->gravity;
+
+                if (posy > otherposy)
+                    pos->y = otherposy + disty;
+                if (posy < otherposy)
+                    pos->y = otherposy - disty;
+
+                if (pointer->gravity == 0)
                 {
-                    yenabled = false;
-                    pointer->yspeed += pointer->gravity;
-
-                    if (posy > otherposy)
-                        (pointer->model)->y = otherposy + ((pointer->ysize + otherpointer->ysize) >> 1);
-                    if (posy < otherposy)
-                        (pointer->model)->y = otherposy - ((pointer->ysize + otherpointer->ysize) >> 1);
-
-                    if (pointer->gravity == 0)
-                    {
-                        pointer->yspeed =
-                            -mulf32(temp, pointer->yspeed);
-                    }
-                    else
-                    {
-                        if (abs(pointer->yspeed) > NE_MIN_BOUNCE_SPEED)
-                        {
-                            pointer->yspeed = -mulf32(temp, pointer->yspeed - pointer->gravity);
-                        }
-                        else
-                        {
-                            pointer->yspeed = 0;
-                        }
-                    }
+                    speed->y = -mulf32(kept, speed->y);
                 }
-                else if ((xenabled) && ((abs(bposx - otherposx) >= (pointer->xsize + otherpointer->xsize) >> 1)))
+                else
                 {
-                    xenabled = false;
+                    if (abs(speed->y) > NE_MIN_BOUNCE_SPEED)
+                        speed->y = -mulf32(kept, speed->y - pointer->gravity);
+                    else
+                        speed->y = 0;
+                }
+            }
+            else if ((xenabled) && (abs(bposx - otherposx) >= distx))
+            {
+                xenabled = false;
 
-                    if (posx > otherposx)
-                        (pointer->model)->x = otherposx + ((pointer->xsize + otherpointer->xsize) >> 1);
-                    if (posx < otherposx)
-                        (pointer->model)->x = otherposx - ((pointer->xsize + otherpointer->xsize) >> 1);
+                if (posx > otherposx)
+                    pos->x = otherposx + distx;
+                if (posx < otherposx)
+                    pos->x = otherposx - distx;
 
-                    pointer->xspeed = -mulf32(temp, pointer->xspeed);
-                }
-                else if ((zenabled) && ((abs(bposz - otherposz) >= (pointer->zsize + otherpointer->zsize) >> 1)))
-                {
-                    zenabled = false;
+                speed->x = -mulf32(kept, speed->x);
+            }
+            else if ((zenabled) && (abs(bposz - otherposz) >= distz))
+            {
+                zenabled = false;
 
-                    if (posz > otherposz)
-                        (pointer->model)->z = otherposz + ((pointer->zsize + otherpointer->zsize) >> 1);
-                    if (posz < otherposz)
-                        (pointer->model)->z = otherposz - ((pointer->zsize + otherpointer->zsize) >> 1);
+                if (posz > otherposz)
+                    pos->z = otherposz + distz;
+                if (posz < otherposz)
+                    pos->z = otherposz - distz;
 
-                    pointer->zspeed = -mulf32(temp, pointer->zspeed);
-                }
+                speed->z = -mulf32(kept, speed->z);
             }
-            else if (pointer->oncollision == NE_ColStop)
+        }
+        else if (pointer->oncollision == NE_ColStop)
+        {
+            if ((yenabled) && (abs(bposy - otherposy) >= disty))
             {
-                if ((yenabled) && ((abs(bposy - otherposy) >= (pointer->ysize + otherpointer->ysize) >> 1)))
-                {
-                    yenabled = false;
+                yenabled = false;
 
-                    if (posy > otherposy)
-                        (pointer->model)->y = otherposy + ((pointer->ysize + otherpointer->ysize) >> 1);
-                    if (posy < otherposy)
-                        (pointer->model)->y = otherposy - ((pointer->ysize + otherpointer->ysize) >> 1);
-                }
-                if ((xenabled) && ((abs(bposx - otherposx) >= (pointer->xsize + otherpointer->xsize) >> 1)))
-                {
-                    xenabled = false;
+                if (posy > otherposy)
+                    pos->y = otherposy + disty;
+                if (posy < otherposy)
+                    pos->y = otherposy - disty;
+            }
+            if ((xenabled) && (abs(bposx - otherposx) >= distx))
+            {
+                xenabled = false;
 
-                    if (posx > otherposx)
-                        (pointer->model)->x = otherposx + ((pointer->xsize + otherpointer->xsize) >> 1);
-                    if (posx < otherposx)
-                        (pointer->model)->x = otherposx - ((pointer->xsize + otherpointer->xsize) >> 1);
-                }
-                if ((zenabled) && ((abs(bposz - otherposz) >= (pointer->zsize + otherpointer->zsize) >> 1)))
-                {
-                    zenabled = false;
+                if (posx > otherposx)
+                    pos->x = otherposx + distx;
+                if (posx < otherposx)
+                    pos->x = otherposx - distx;
+            }
+            if ((zenabled) && (abs(bposz - otherposz) >= distz))
+            {
+                zenabled = false;
 
-                    if (posz > otherposz)
-                        (pointer->model)->z = otherposz + ((pointer->zsize + otherpointer->zsize) >> 1);
-                    if (posz < otherposz)
-                        (pointer->model)->z = otherposz - ((pointer->zsize + otherpointer->zsize) >> 1);
-                }
-                pointer->xspeed = pointer->yspeed = pointer->zspeed = 0;
+                if (posz > otherposz)
+                    pos->z = otherposz + distz;
+                if (posz < otherposz)
+                    pos->z = otherposz - distz;
             }
+            speed->x = speed->y = speed->z = 0;
         }
     }
 
+    if (ne_physics_broadphase)
+        ne_grid_update(pointer);
+
     // Now, we get the module of speed in order to apply friction.
     if (pointer->friction != 0)
     {
-        pointer->xspeed <<= 10;
-        pointer->yspeed <<= 10;
-        pointer->zspeed <<= 10;
-        int _mod_ = mulf32(pointer->xspeed, pointer->xspeed);
-        _mod_ += mulf32(pointer->yspeed, pointer->yspeed);
-        _mod_ += mulf32(pointer->zspeed, pointer->zspeed);
+        speed->x <<= 10;
+        speed->y <<= 10;
+        speed->z <<= 10;
+        int _mod_ = mulf32(speed->x, speed->x);
+        _mod_ += mulf32(speed->y, speed->y);
+        _mod_ += mulf32(speed->z, speed->z);
         _mod_ = sqrtf32(_mod_);
 
         // Check if module is very small -> speed = 0
         if (_mod_ < pointer->friction)
         {
-            pointer->xspeed = pointer->yspeed = pointer->zspeed = 0;
+            speed->x = speed->y = speed->z = 0;
         }
         else
         {
@@ -409,16 +2499,176 @@ void NE_PhysicsUpdate(NE_Physics *pointer)
             // mod   --  newmod    ->  newspeed = speed * newmod / mod
             // speed --  newspeed
             int number = divf32(newmod, _mod_);
-            pointer->xspeed = mulf32(pointer->xspeed, number);
-            pointer->yspeed = mulf32(pointer->yspeed, number);
-            pointer->zspeed = mulf32(pointer->zspeed, number);
-            pointer->xspeed >>= 10;
-            pointer->yspeed >>= 10;
-            pointer->zspeed >>= 10;
+            speed->x = mulf32(speed->x, number);
+            speed->y = mulf32(speed->y, number);
+            speed->z = mulf32(speed->z, number);
+            speed->x >>= 10;
+            speed->y >>= 10;
+            speed->z >>= 10;
+        }
+    }
+
+    if (ne_physics_sleep_frames > 0)
+    {
+        if (!ne_physics_is_slow(speed))
+        {
+            pointer->sleepframes = 0;
+        }
+        else if (++pointer->sleepframes >= ne_physics_sleep_frames)
+        {
+            pointer->sleeping = true;
+            pointer->sleepx = pos->x;
+            pointer->sleepy = pos->y;
+            pointer->sleepz = pos->z;
+            ne_physics_flags[slot] |= NE_PHYSICS_FLAG_SLEEPING;
         }
     }
 }
 
+// Draws the edges of the triangles of a collision mesh. Vertices are sent as
+// v16 values, so the coordinates are divided by a power of two that makes the
+// biggest one fit, and the matrix is scaled by the same value.
+static void ne_physics_debug_draw_mesh(const NE_Physics *pointer, u32 color)
+{
+    const ne_mesh_header_t *mesh = pointer->mesh;
+    const ne_mesh_node_t *root = ne_mesh_nodes(mesh);
+    const ne_mesh_triangle_t *triangles = ne_mesh_triangles(mesh);
+
+    int32_t biggest = 0;
+    for (int i = 0; i < 3; i++)
+    {
+        if (abs(root->min[i]) > biggest)
+            biggest = abs(root->min[i]);
+        if (abs(root->max[i]) > biggest)
+            biggest = abs(root->max[i]);
+    }
+
+    int shift = 0;
+    while ((biggest >> shift) > INT16_MAX)
+        shift++;
+
+    NE_Model *model = pointer->model;
+
+    MATRIX_PUSH = 0;
+
+    MATRIX_TRANSLATE = model->x;
+    MATRIX_TRANSLATE = model->y;
+    MATRIX_TRANSLATE = model->z;
+
+    MATRIX_SCALE = inttof32(1 << shift);
+    MATRIX_SCALE = inttof32(1 << shift);
+    MATRIX_SCALE = inttof32(1 << shift);
+
+    NE_PolyBegin(GL_TRIANGLES);
+    NE_PolyColor(color);
+
+    for (uint32_t t = 0; t < mesh->num_triangles; t++)
+    {
+        const ne_mesh_triangle_t *tri = &triangles[t];
+
+        for (int e = 0; e < 3; e++)
+        {
+            const int32_t *a = tri->v[e];
+            const int32_t *b = tri->v[(e + 1) % 3];
+
+            NE_PolyVertexI(a[0] >> shift, a[1] >> shift, a[2] >> shift);
+            NE_PolyVertexI(b[0] >> shift, b[1] >> shift, b[2] >> shift);
+            NE_PolyVertexI(b[0] >> shift, b[1] >> shift, b[2] >> shift);
+        }
+    }
+
+    NE_PolyEnd();
+
+    MATRIX_POP = 1;
+}
+
+void NE_PhysicsDebugDraw(void)
+{
+    if (!ne_physics_system_inited)
+        return;
+
+    NE_PolyFormat(31, 0, 0, NE_CULL_NONE, 0);
+    GFX_TEX_FORMAT = 0;
+
+    for (int i = 0; i < NE_MAX_PHYSICS; i++)
+    {
+        NE_Physics *pointer = NE_PhysicsPointers[i];
+        if ((pointer == NULL) || (pointer->model == NULL))
+            continue;
+
+        u32 color;
+        if ((pointer->bodytype == NE_BodyStatic) || !pointer->enabled)
+            color = NE_PHYSICS_DEBUG_COLOR_STATIC;
+        else if (pointer->bodytype == NE_BodyKinematic)
+            color = NE_PHYSICS_DEBUG_COLOR_KINEMATIC;
+        else if (pointer->sleeping)
+            color = NE_PHYSICS_DEBUG_COLOR_SLEEPING;
+        else
+            color = NE_PHYSICS_DEBUG_COLOR_AWAKE;
+
+        if (pointer->type == NE_CollisionMesh)
+        {
+            if (pointer->mesh != NULL)
+                ne_physics_debug_draw_mesh(pointer, color);
+            continue;
+        }
+
+        NE_Model *model = pointer->model;
+
+        // Spheres are drawn as their bounding box, and dots as small boxes
+        ne_physics_vec_t size;
+        ne_physics_shape_size(pointer, &size);
+        if (pointer->type == NE_Dot)
+            size.x = size.y = size.z = NE_PHYSICS_DEBUG_DOT_SIZE;
+
+        MATRIX_PUSH = 0;
+
+        MATRIX_TRANSLATE = model->x;
+        MATRIX_TRANSLATE = model->y;
+        MATRIX_TRANSLATE = model->z;
+
+        // The box is drawn as a cube of size 2, so scale it by half the size
+        MATRIX_SCALE = size.x >> 1;
+        MATRIX_SCALE = size.y >> 1;
+        MATRIX_SCALE = size.z >> 1;
+
+        NE_PolyBegin(GL_TRIANGLES);
+        NE_PolyColor(color);
+
+        // Each edge connects two corners that differ in one coordinate. It is
+        // drawn as a triangle with two equal vertices, which is drawn as a line.
+        for (int corner = 0; corner < 8; corner++)
+        {
+            int x = (corner & 1) ? inttov16(1) : inttov16(-1);
+            int y = (corner & 2) ? inttov16(1) : inttov16(-1);
+            int z = (corner & 4) ? inttov16(1) : inttov16(-1);
+
+            if (!(corner & 1))
+            {
+                NE_PolyVertexI(x, y, z);
+                NE_PolyVertexI(-x, y, z);
+                NE_PolyVertexI(-x, y, z);
+            }
+            if (!(corner & 2))
+            {
+                NE_PolyVertexI(x, y, z);
+                NE_PolyVertexI(x, -y, z);
+                NE_PolyVertexI(x, -y, z);
+            }
+            if (!(corner & 4))
+            {
+                NE_PolyVertexI(x, y, z);
+                NE_PolyVertexI(x, y, -z);
+                NE_PolyVertexI(x, y, -z);
+            }
+        }
+
+        NE_PolyEnd();
+
+        MATRIX_POP = 1;
+    }
+}
+
 bool NE_PhysicsCheckCollision(const NE_Physics *pointer1,
                               const NE_Physics *pointer2)
 {
@@ -426,31 +2676,39 @@ bool NE_PhysicsCheckCollision(const NE_Physics *pointer1,
     NE_AssertPointer(pointer2, "NULL pointer 2");
     NE_Assert(pointer1 != pointer2, "Both objects are the same one");
 
-    // Get coordinates
-    int posx = 0, posy = 0, posz = 0;
+    ne_physics_vec_t pos1, pos2, size1, size2;
 
     NE_Model *model = pointer1->model;
-    posx = model->x;
-    posy = model->y;
-    posz = model->z;
-
-    int otherposx = 0, otherposy = 0, otherposz = 0;
+    pos1.x = model->x;
+    pos1.y = model->y;
+    pos1.z = model->z;
 
     model = pointer2->model;
-    otherposx = model->x;
-    otherposy = model->y;
-    otherposz = model->z;
+    pos2.x = model->x;
+    pos2.y = model->y;
+    pos2.z = model->z;
+
+    ne_physics_shape_size(pointer1, &size1);
+    ne_physics_shape_size(pointer2, &size2);
+
+    uint8_t flags1 = ne_physics_shape_flag(pointer1);
+    uint8_t flags2 = ne_physics_shape_flag(pointer2);
 
-    // Both are boxes
-    //if(pointer->type == NE_BoundingBox && otherpointer->type == NE_BoundingBox)
-    //{
-    if ((abs(posx - otherposx) < (pointer1->xsize + pointer2->xsize) >> 1) &&
-        (abs(posy - otherposy) < (pointer1->ysize + pointer2->ysize) >> 1) &&
-        (abs(posz - otherposz) < (pointer1->zsize + pointer2->zsize) >> 1))
+    int axis, penetration;
+
+    if (flags1 & NE_PHYSICS_FLAG_MESH)
     {
-        return true;
+        return ne_physics_mesh_collide(pointer1->mesh, &pos1, NULL, flags2,
+                                       &pos2, &size2, NULL,
+                                       &axis, &penetration);
+    }
+    if (flags2 & NE_PHYSICS_FLAG_MESH)
+    {
+        return ne_physics_mesh_collide(pointer2->mesh, &pos2, NULL, flags1,
+                                       &pos1, &size1, NULL,
+                                       &axis, &penetration);
     }
-    // else if (...) TODO: Spheres and dots
 
-    return false;
+    return ne_physics_shapes_overlap(flags1, &pos1, &size1,
+                                     flags2, &pos2, &size2);
 }
@@ -8,8 +8,17 @@
 
 /// @file NEPolygon.c
 
+// From NEDisplayList.c
+extern bool NE_DisplayListRecording;
+
 void NE_PolyColor(u32 color)
 {
+    if (NE_DisplayListRecording)
+    {
+        NE_DisplayListAddCommand(FIFO_COLOR, &color, 1);
+        return;
+    }
+
     GFX_COLOR = color;
 }
 
@@ -89,27 +98,60 @@ void NE_ShininessTableGenerate(NE_ShininessFunction function)
 
 void NE_PolyBegin(int mode)
 {
+    if (NE_DisplayListRecording)
+    {
+        u32 param = mode;
+        NE_DisplayListAddCommand(FIFO_BEGIN, &param, 1);
+        return;
+    }
+
     GFX_BEGIN = mode;
 }
 
 void NE_PolyEnd(void)
 {
+    if (NE_DisplayListRecording)
+    {
+        NE_DisplayListAddCommand(FIFO_END, NULL, 0);
+        return;
+    }
+
     GFX_END = 0;
 }
 
 void NE_PolyNormalI(int x, int y, int z)
 {
+    if (NE_DisplayListRecording)
+    {
+        u32 param = NORMAL_PACK(x, y, z);
+        NE_DisplayListAddCommand(FIFO_NORMAL, &param, 1);
+        return;
+    }
+
     GFX_NORMAL = NORMAL_PACK(x, y, z);
 }
 
 void NE_PolyVertexI(int x, int y, int z)
 {
+    if (NE_DisplayListRecording)
+    {
+        NE_DisplayListAddVertexI(x, y, z);
+        return;
+    }
+
     GFX_VERTEX16 = (y << 16) | (x & 0xFFFF);
     GFX_VERTEX16 = (uint32) (uint16) (z);
 }
 
 void NE_PolyTexCoord(int u, int v)
 {
+    if (NE_DisplayListRecording)
+    {
+        u32 param = TEXTURE_PACK(inttot16(u), inttot16(v));
+        NE_DisplayListAddCommand(FIFO_TEX_COORD, &param, 1);
+        return;
+    }
+
     GFX_TEX_COORD = TEXTURE_PACK(inttot16(u), inttot16(v));
 }
 
@@ -119,8 +161,15 @@ void NE_PolyFormat(u32 alpha, u32 id, NE_LightEnum lights,
     NE_AssertMinMax(0, alpha, 31, "Invalid alpha value %lu", alpha);
     NE_AssertMinMax(0, id, 63, "Invalid polygon ID %lu", id);
 
-    GFX_POLY_FORMAT = POLY_ALPHA(alpha) | POLY_ID(id)
-                    | lights | culling | other;
+    u32 format = POLY_ALPHA(alpha) | POLY_ID(id) | lights | culling | other;
+
+    if (NE_DisplayListRecording)
+    {
+        NE_DisplayListAddCommand(FIFO_POLY_FORMAT, &format, 1);
+        return;
+    }
+
+    GFX_POLY_FORMAT = format;
 }
 
 void NE_OutliningEnable(bool value)
@@ -4,9 +4,10 @@
 
 // DS Model Animation Library v0.2.0
 
-#include <nds.h>
+#include <stdlib.h>
 
 #include "dsma.h"
+#include "dsma_gx.h"
 
 // Format of a joint in a DSA file.
 typedef struct {
@@ -14,121 +15,1244 @@ typedef struct {
     int32_t orient[4]; // Orientation (w, x, y, z)
 } dsa_joint_t;
 
+// Format of a joint in a DSA file with baked matrices. The values are stored in
+// the order expected by MATRIX_MULT4x3.
+typedef struct {
+    int32_t m[12];
+} dsa_matrix_t;
+
+// Format of a key of a joint in a compressed DSA file. Positions are stored as
+// 16-bit values that need to be shifted left by the shift in the header to get
+// the 20.12 values. Orientations are stored with the "smallest three" method:
+// the biggest component of the quaternion isn't stored (it is calculated from
+// the other three), and the other three are stored as 15-bit values. The index
+// of the missing component is stored in the top bits of rot[0] and rot[1].
+typedef struct {
+    uint16_t frame;    // Frame of this key
+    uint16_t inv_span; // 65536 / (frames until the next key), saturated
+    int16_t pos[3];    // Translation (x, y, z)
+    uint16_t rot[3];   // Orientation (three smallest components)
+} dsa_key_t;
+
+// Keys of one joint in a compressed DSA file. The first key is at frame 0 and
+// the last one is at the last frame of the animation. Keys of all joints are
+// stored one after the other after the array of tracks.
+typedef struct {
+    uint32_t first_key; // Index of the first key of this joint
+    uint32_t num_keys;  // Number of keys of this joint
+} dsa_track_t;
+
 #define DSA_VERSION_NUMBER 1
+#define DSA_VERSION_MATRICES 2
+#define DSA_VERSION_COMPRESSED 3
+
+// Format of a DSA file.
+typedef struct {
+    uint32_t version;      // Version number
+    uint32_t num_frames;   // Frames in the file
+    uint32_t num_joints;   // Joints per frame
+    union {
+        dsa_joint_t joints[0];     // Array of joints (version 1)
+        dsa_matrix_t matrices[0];  // Array of joint matrices (version 2)
+    };
+} dsa_t;
+
+// Format of a compressed DSA file (version 3).
+typedef struct {
+    uint32_t version;      // Version number
+    uint32_t num_frames;   // Frames in the file
+    uint32_t num_joints;   // Joints per frame
+    uint32_t pos_shift;    // Shift to apply to positions
+    dsa_track_t tracks[0]; // Array of tracks, followed by the array of keys
+} dsa_compressed_t;
+
+// Magic number of a DSM file split in sub-meshes ("DSMP"). Regular DSM files
+// start with the size of the display list, which is never this big.
+#define DSM_PARTITIONED_MAGIC 0x504D5344
+
+// Format of a DSM file split in sub-meshes. Each sub-mesh is stored as the
+// number of joints it uses, followed by the indices of those joints in the
+// skeleton, followed by its display list (with the size in the first word).
+// The display list of a sub-mesh uses matrix 30 - max_joints + 1 + i of the
+// stack for the joint at index i of its table.
+typedef struct {
+    uint32_t magic;         // DSM_PARTITIONED_MAGIC
+    uint32_t num_submeshes; // Number of sub-meshes
+    uint32_t max_joints;    // Max number of joints used by one sub-mesh
+    uint32_t data[0];       // Sub-meshes
+} dsm_partitioned_t;
+
+// Private functions
+// =================
+
+// If true, quaternions are normalized after interpolating them.
+static bool dsma_normalize_quaternions = false;
+
+// Table of 1 / sqrt(x) for x between 0.25 and 1.0 in steps of 1 / 64. Each
+// entry is the value at the center of the step, in 20.12 format.
+static const uint16_t dsma_rsqrt_lut[48] = {
+    8067, 7833, 7618, 7420, 7237, 7067, 6908, 6760,
+    6620, 6489, 6365, 6249, 6138, 6033, 5933, 5838,
+    5748, 5661, 5579, 5500, 5424, 5351, 5281, 5214,
+    5149, 5087, 5026, 4968, 4912, 4858, 4805, 4754,
+    4705, 4657, 4611, 4566, 4522, 4480, 4439, 4398,
+    4359, 4321, 4284, 4248, 4213, 4178, 4145, 4112,
+};
+
+// Calculates 1 / sqrt(x) of a positive value in 20.12 format. It doesn't use
+// the hardware divider or square root units, only a lookup table and one step
+// of the Newton-Raphson method.
+ITCM_CODE ARM_CODE static inline
+int32_t rsqrtf32(int32_t x)
+{
+    // Move the value to the range of the table. Dividing x by 4 multiplies
+    // the result by 2.
+    int shift = 0;
+
+    while (x < inttof32(1) / 4)
+    {
+        x <<= 2;
+        shift--;
+    }
+    while (x >= inttof32(1))
+    {
+        x >>= 2;
+        shift++;
+    }
+
+    int32_t y = dsma_rsqrt_lut[(x >> 6) - 16];
+
+    // y = y * (3 - x * y * y) / 2
+    int32_t y2 = (y * y) >> 12;
+    y = (y * (inttof32(3) - ((x * y2) >> 12))) >> 13;
+
+    if (shift > 0)
+        return y >> shift;
+    else
+        return y << -shift;
+}
+
+// Normalizes a quaternion in place.
+ITCM_CODE ARM_CODE static inline
+void q_normalize(int32_t *q)
+{
+    int32_t len2 = (q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]) >> 12;
+    if (len2 <= 0)
+        return;
+
+    int32_t inv_len = rsqrtf32(len2);
+
+    q[0] = (q[0] * inv_len) >> 12;
+    q[1] = (q[1] * inv_len) >> 12;
+    q[2] = (q[2] * inv_len) >> 12;
+    q[3] = (q[3] * inv_len) >> 12;
+}
+
+// Helper that multiplies two fixed point values in 20.12 format and multiplies
+// the result again by 2.
+ITCM_CODE ARM_CODE static inline
+int32_t mulf32_by_2(int32_t a, int32_t b)
+{
+    return (a * b) >> (12 - 1);
+}
+
+// Generates a 4x3 matrix from the orientation in the provided quaternion and
+// the translation in the provided vector. Then, it multiplies the matrix that
+// is currently active in the geometry engine by the generated matrix.
+ITCM_CODE ARM_CODE static inline
+void matrix_mult_by_joint(const int32_t *v, const int32_t *q)
+{
+    int32_t wx = mulf32_by_2(q[0], q[1]);
+    int32_t wy = mulf32_by_2(q[0], q[2]);
+    int32_t wz = mulf32_by_2(q[0], q[3]);
+    int32_t x2 = mulf32_by_2(q[1], q[1]);
+    int32_t xy = mulf32_by_2(q[1], q[2]);
+    int32_t xz = mulf32_by_2(q[1], q[3]);
+    int32_t y2 = mulf32_by_2(q[2], q[2]);
+    int32_t yz = mulf32_by_2(q[2], q[3]);
+    int32_t z2 = mulf32_by_2(q[3], q[3]);
+
+    dsma_gx_mult4x3(inttof32(1) - y2 - z2);
+    dsma_gx_mult4x3(xy + wz);
+    dsma_gx_mult4x3(xz - wy);
+
+    dsma_gx_mult4x3(xy - wz);
+    dsma_gx_mult4x3(inttof32(1) - x2 - z2);
+    dsma_gx_mult4x3(yz + wx);
+
+    dsma_gx_mult4x3(xz + wy);
+    dsma_gx_mult4x3(yz - wx);
+    dsma_gx_mult4x3(inttof32(1) - x2 - y2);
+
+    dsma_gx_mult4x3(v[0]);
+    dsma_gx_mult4x3(v[1]);
+    dsma_gx_mult4x3(v[2]);
+}
+
+// Generates a 4x3 matrix from the orientation in the provided quaternion and
+// the translation in the provided vector, and stores it in 'm' in the same
+// order as it would be sent to MATRIX_MULT4x3.
+ITCM_CODE ARM_CODE static inline
+void joint_to_matrix(const int32_t *v, const int32_t *q, int32_t *m)
+{
+    int32_t wx = mulf32_by_2(q[0], q[1]);
+    int32_t wy = mulf32_by_2(q[0], q[2]);
+    int32_t wz = mulf32_by_2(q[0], q[3]);
+    int32_t x2 = mulf32_by_2(q[1], q[1]);
+    int32_t xy = mulf32_by_2(q[1], q[2]);
+    int32_t xz = mulf32_by_2(q[1], q[3]);
+    int32_t y2 = mulf32_by_2(q[2], q[2]);
+    int32_t yz = mulf32_by_2(q[2], q[3]);
+    int32_t z2 = mulf32_by_2(q[3], q[3]);
+
+    m[0] = inttof32(1) - y2 - z2;
+    m[1] = xy + wz;
+    m[2] = xz - wy;
+
+    m[3] = xy - wz;
+    m[4] = inttof32(1) - x2 - z2;
+    m[5] = yz + wx;
+
+    m[6] = xz + wy;
+    m[7] = yz - wx;
+    m[8] = inttof32(1) - x2 - y2;
+
+    m[9] = v[0];
+    m[10] = v[1];
+    m[11] = v[2];
+}
+
+// Gets a pointer to the list of joints of the specified frame.
+ITCM_CODE ARM_CODE static inline
+const dsa_joint_t *dsa_get_frame(const dsa_t *dsa, uint32_t frame)
+{
+    return &dsa->joints[frame * dsa->num_joints];
+}
+
+// Gets a pointer to the list of joint matrices of the specified frame.
+ITCM_CODE ARM_CODE static inline
+const dsa_matrix_t *dsa_get_frame_matrices(const dsa_t *dsa, uint32_t frame)
+{
+    return &dsa->matrices[frame * dsa->num_joints];
+}
+
+ITCM_CODE ARM_CODE static inline
+bool dsa_version_is_valid(const dsa_t *dsa)
+{
+    return (dsa->version == DSA_VERSION_NUMBER) ||
+           (dsa->version == DSA_VERSION_MATRICES) ||
+           (dsa->version == DSA_VERSION_COMPRESSED);
+}
+
+// Interpolates linearly between 'start' and 'end'. The position is a floating
+// point number in 20.12 format, and it should be between 0.0 and 1.0 (the
+// function doesn't check bounds).
+ITCM_CODE ARM_CODE static inline
+int32_t lerp(int32_t start, int32_t end, int32_t pos)
+{
+    int32_t diff = end - start;
+    return start + ((diff * pos) >> 12);
+}
+
+// Interpolates between quaternions 'q1' and 'q2. The position is a floating
+// point number in 20.12 format, and it should be between 0.0 and 1.0 (the
+// function doesn't check bounds). It stores the result in 'qdest'.
+ITCM_CODE ARM_CODE static inline
+void q_nlerp(const int32_t *q1, const int32_t *q2, int32_t pos, int32_t *qdest)
+{
+    qdest[0] = lerp(q1[0], q2[0], pos);
+    qdest[1] = lerp(q1[1], q2[1], pos);
+    qdest[2] = lerp(q1[2], q2[2], pos);
+    qdest[3] = lerp(q1[3], q2[3], pos);
+
+    // The interpolated quaternion is shorter than the original ones, which
+    // makes the model shrink. Normalizing it is optional because it needs CPU
+    // time, and the difference is small when the two frames are close.
+    if (dsma_normalize_quaternions)
+        q_normalize(qdest);
+}
+
+// Interpolates between two joint matrices. The result isn't orthonormal, but it
+// is close enough when the frames are close, like with q_nlerp().
+ITCM_CODE ARM_CODE static inline
+void matrix_lerp(const int32_t *m1, const int32_t *m2, int32_t pos,
+                 int32_t *mdest)
+{
+    for (int i = 0; i < 12; i++)
+        mdest[i] = lerp(m1[i], m2[i], pos);
+}
+
+// Interpolate between two positions and two orientations.
+ITCM_CODE ARM_CODE static inline
+void dsa_interpolate_frames(const int32_t *v_pos_1, const int32_t *q_orient_1,
+                            const int32_t *v_pos_2, const int32_t *q_orient_2,
+                            uint32_t interp, int32_t *v_pos, int32_t *q_orient)
+{
+    v_pos[0] = lerp(v_pos_1[0], v_pos_2[0], interp);
+    v_pos[1] = lerp(v_pos_1[1], v_pos_2[1], interp);
+    v_pos[2] = lerp(v_pos_1[2], v_pos_2[2], interp);
+
+    q_nlerp(q_orient_1, q_orient_2, interp, q_orient);
+}
+
+// Decodes the position and orientation stored in a key of a compressed DSA
+// file.
+ITCM_CODE ARM_CODE static inline
+void dsa_decode_key(const dsa_key_t *key, uint32_t pos_shift,
+                    int32_t *v_pos, int32_t *q_orient)
+{
+    v_pos[0] = (int32_t)key->pos[0] << pos_shift;
+    v_pos[1] = (int32_t)key->pos[1] << pos_shift;
+    v_pos[2] = (int32_t)key->pos[2] << pos_shift;
+
+    // The components are stored in the range [-1/sqrt(2), 1/sqrt(2)] mapped to
+    // [0, 32767]. 181 / 1024 is roughly 4096 / (16384 * sqrt(2)).
+    int32_t a = ((int32_t)(key->rot[0] & 0x7FFF) - 16384) * 181 >> 10;
+    int32_t b = ((int32_t)(key->rot[1] & 0x7FFF) - 16384) * 181 >> 10;
+    int32_t c = ((int32_t)(key->rot[2] & 0x7FFF) - 16384) * 181 >> 10;
+
+    uint32_t index = (key->rot[0] >> 15) | ((key->rot[1] >> 15) << 1);
+
+    // The missing component is always positive
+    int32_t d2 = inttof32(1) - ((a * a + b * b + c * c) >> 12);
+    int32_t d = (d2 > 0) ? sqrtf32(d2) : 0;
+
+    switch (index)
+    {
+        case 0:
+            q_orient[0] = d; q_orient[1] = a; q_orient[2] = b; q_orient[3] = c;
+            break;
+        case 1:
+            q_orient[0] = a; q_orient[1] = d; q_orient[2] = b; q_orient[3] = c;
+            break;
+        case 2:
+            q_orient[0] = a; q_orient[1] = b; q_orient[2] = d; q_orient[3] = c;
+            break;
+        default:
+            q_orient[0] = a; q_orient[1] = b; q_orient[2] = c; q_orient[3] = d;
+            break;
+    }
+}
+
+// Calculates the position and orientation of a joint of a compressed DSA file
+// at the specified frame, interpolating between the two keys around it.
+ITCM_CODE ARM_CODE static inline
+void dsa_compressed_sample(const dsa_compressed_t *dsa, uint32_t frame,
+                           uint32_t interp, uint32_t joint,
+                           int32_t *v_pos, int32_t *q_orient)
+{
+    const dsa_track_t *track = &dsa->tracks[joint];
+    const dsa_key_t *keys = (const dsa_key_t *)&dsa->tracks[dsa->num_joints];
+    keys += track->first_key;
+
+    uint32_t last = track->num_keys - 1;
+
+    // Look for the last key that starts at or before the requested frame
+    uint32_t lo = 0;
+    uint32_t hi = last;
+    while (lo < hi)
+    {
+        uint32_t mid = (lo + hi + 1) >> 1;
+        if (keys[mid].frame <= frame)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+
+    const dsa_key_t *k1 = &keys[lo];
+    const dsa_key_t *k2;
+    int32_t pos;
+
+    if (lo == last)
+    {
+        // This is the last frame, it wraps around to frame 0
+        if (interp == 0)
+        {
+            dsa_decode_key(k1, dsa->pos_shift, v_pos, q_orient);
+            return;
+        }
+        k2 = &keys[0];
+        pos = interp;
+    }
+    else
+    {
+        k2 = &keys[lo + 1];
+        int32_t elapsed = ((frame - k1->frame) << 12) + interp;
+        pos = (elapsed * k1->inv_span) >> 16;
+    }
+
+    int32_t v_pos_1[3], q_orient_1[4];
+    int32_t v_pos_2[3], q_orient_2[4];
+
+    dsa_decode_key(k1, dsa->pos_shift, v_pos_1, q_orient_1);
+    dsa_decode_key(k2, dsa->pos_shift, v_pos_2, q_orient_2);
+
+    // The stored quaternions may be in opposite hemispheres because the missing
+    // component is always positive. Flip one of them to interpolate along the
+    // shortest path.
+    int32_t dot = q_orient_1[0] * q_orient_2[0] + q_orient_1[1] * q_orient_2[1]
+                + q_orient_1[2] * q_orient_2[2] + q_orient_1[3] * q_orient_2[3];
+    if (dot < 0)
+    {
+        for (int i = 0; i < 4; i++)
+            q_orient_2[i] = -q_orient_2[i];
+    }
+
+    dsa_interpolate_frames(v_pos_1, q_orient_1, v_pos_2, q_orient_2, pos,
+                           v_pos, q_orient);
+}
+
+// Calculates the matrix of a joint of a DSA file of any version, interpolating
+// between two frames.
+ITCM_CODE ARM_CODE static inline
+void dsa_get_joint_matrix(const dsa_t *dsa, uint32_t frame, uint32_t next_frame,
+                          uint32_t interp, uint32_t joint, int32_t *m)
+{
+    if (dsa->version == DSA_VERSION_COMPRESSED)
+    {
+        int32_t v_pos[3];
+        int32_t q_orient[4];
+
+        dsa_compressed_sample((const dsa_compressed_t *)dsa, frame, interp,
+                              joint, v_pos, q_orient);
+        joint_to_matrix(v_pos, q_orient, m);
+    }
+    else if (dsa->version == DSA_VERSION_MATRICES)
+    {
+        const int32_t *m1 = dsa_get_frame_matrices(dsa, frame)[joint].m;
+
+        if (interp == 0)
+        {
+            for (int i = 0; i < 12; i++)
+                m[i] = m1[i];
+        }
+        else
+        {
+            const dsa_matrix_t *f2 = dsa_get_frame_matrices(dsa, next_frame);
+            const int32_t *m2 = f2[joint].m;
+            matrix_lerp(m1, m2, interp, m);
+        }
+    }
+    else
+    {
+        const dsa_joint_t *j1 = &dsa_get_frame(dsa, frame)[joint];
+
+        if (interp == 0)
+        {
+            joint_to_matrix(j1->pos, j1->orient, m);
+        }
+        else
+        {
+            const dsa_joint_t *j2 = &dsa_get_frame(dsa, next_frame)[joint];
+
+            int32_t v_pos[3];
+            int32_t q_orient[4];
+
+            dsa_interpolate_frames(j1->pos, j1->orient, j2->pos, j2->orient,
+                                   interp, v_pos, q_orient);
+            joint_to_matrix(v_pos, q_orient, m);
+        }
+    }
+}
+
+// Multiplies two 4x3 matrices stored in the order of MATRIX_MULT4x3 (column by
+// column) and stores the result in 'd' ('d' can't be 'a' or 'b').
+ITCM_CODE ARM_CODE static inline
+void matrix_mult(const int32_t *a, const int32_t *b, int32_t *d)
+{
+    for (int c = 0; c < 3; c++)
+    {
+        for (int r = 0; r < 3; r++)
+        {
+            d[c * 3 + r] = (a[0 * 3 + r] * b[c * 3 + 0] +
+                            a[1 * 3 + r] * b[c * 3 + 1] +
+                            a[2 * 3 + r] * b[c * 3 + 2]) >> 12;
+        }
+    }
+
+    for (int r = 0; r < 3; r++)
+    {
+        d[9 + r] = a[9 + r] + (int32_t)(((int64_t)a[0 * 3 + r] * b[9] +
+                                         (int64_t)a[1 * 3 + r] * b[10] +
+                                         (int64_t)a[2 * 3 + r] * b[11]) >> 12);
+    }
+}
+
+// Calculates the inverse of a joint matrix. The matrix must be a rotation and a
+// translation, so that the inverse of the rotation is its transpose.
+ITCM_CODE ARM_CODE static inline
+void matrix_inverse(const int32_t *m, int32_t *d)
+{
+    for (int c = 0; c < 3; c++)
+    {
+        for (int r = 0; r < 3; r++)
+            d[c * 3 + r] = m[r * 3 + c];
+    }
+
+    for (int r = 0; r < 3; r++)
+    {
+        d[9 + r] = -(int32_t)(((int64_t)d[0 * 3 + r] * m[9] +
+                               (int64_t)d[1 * 3 + r] * m[10] +
+                               (int64_t)d[2 * 3 + r] * m[11]) >> 12);
+    }
+}
+
+// State of an animation layer, calculated once per pose.
+typedef struct {
+    const dsa_t *dsa;
+    uint32_t frame;
+    uint32_t next_frame;
+    uint32_t interp;
+    // Additive layers: weight of the layer. Other layers: blending factor
+    // between the result of the previous layers and this one.
+    int32_t weight;
+    bool additive;
+    // Additive layers: inverse of the matrices of frame 0 of all joints, or
+    // NULL if they have to be calculated for each joint.
+    const int32_t *inv_ref;
+} dsa_layer_state_t;
+
+// State of all the animation layers, calculated once per pose.
+typedef struct {
+    dsa_layer_state_t layer[DSMA_MAX_LAYERS];
+    uint32_t num_layers;
+    uint32_t num_joints;
+    uint32_t num_blended; // Number of layers that aren't additive
+    // True if all the layers that aren't additive are version 1 files, so they
+    // can be blended as positions and quaternions instead of matrices.
+    bool quaternions;
+} dsa_layers_t;
+
+// Buffer used to store the inverse of the reference pose of additive layers. It
+// is enlarged when needed, and it is never freed.
+static int32_t *dsa_ref_buffer = NULL;
+static size_t dsa_ref_buffer_size = 0;
+
+// Checks the layers and calculates the state of each one. The weights of the
+// layers that aren't additive are converted to blending factors so that the
+// layers can be blended one after the other: the first layer is used as it is,
+// and the factor of each of the other layers is its weight divided by the sum
+// of its weight and the weights of the previous layers. The inverse of the
+// reference pose of additive layers is calculated here, once per pose.
+static int dsa_layers_prepare(const DSMA_Layer *layers, uint32_t num_layers,
+                              dsa_layers_t *state)
+{
+    if ((num_layers == 0) || (num_layers > DSMA_MAX_LAYERS))
+        return DSMA_INVALID_BLENDING;
+
+    int32_t total_weight = 0;
+    uint32_t num_additive = 0;
+    uint32_t num_joints = 0;
+
+    state->num_blended = 0;
+    state->quaternions = true;
+
+    for (uint32_t i = 0; i < num_layers; i++)
+    {
+        const dsa_t *dsa = layers[i].dsa_file;
+        dsa_layer_state_t *layer = &state->layer[i];
+
+        if (!dsa_version_is_valid(dsa))
+            return DSMA_INVALID_VERSION;
+
+        if (i == 0)
+            num_joints = dsa->num_joints;
+        else if (dsa->num_joints != num_joints)
+            return DSMA_INCOMPATIBLE_ANIMATIONS;
+
+        uint32_t frame = layers[i].frame_interp >> 12;
+        if (frame >= dsa->num_frames)
+            return DSMA_INVALID_FRAME;
+
+        int32_t weight = layers[i].weight;
+        if ((weight < 0) || (weight > inttof32(1)))
+            return DSMA_INVALID_BLENDING;
+
+        uint32_t next_frame = frame + 1;
+        if (next_frame == dsa->num_frames)
+            next_frame = 0;
+
+        layer->dsa = dsa;
+        layer->frame = frame;
+        layer->next_frame = next_frame;
+        layer->interp = layers[i].frame_interp & 0xFFF;
+        layer->weight = weight;
+        layer->additive = layers[i].additive;
+        layer->inv_ref = NULL;
+
+        if (layer->additive)
+        {
+            if (weight != 0)
+                num_additive++;
+            continue;
+        }
+
+        if (dsa->version != DSA_VERSION_NUMBER)
+            state->quaternions = false;
+
+        state->num_blended++;
+
+        total_weight += weight;
+        if (total_weight != 0)
+            layer->weight = divf32(weight, total_weight);
+    }
+
+    if (total_weight == 0)
+        return DSMA_INVALID_BLENDING;
+
+    state->num_layers = num_layers;
+    state->num_joints = num_joints;
+
+    if (num_additive == 0)
+        return DSMA_SUCCESS;
+
+    // If the buffer can't be enlarged the reference pose is calculated for each
+    // joint when it is needed.
+    size_t size = num_additive * num_joints * 12;
+    if (size > dsa_ref_buffer_size)
+    {
+        int32_t *buffer = realloc(dsa_ref_buffer, size * sizeof(int32_t));
+        if (buffer == NULL)
+            return DSMA_SUCCESS;
+
+        dsa_ref_buffer = buffer;
+        dsa_ref_buffer_size = size;
+    }
+
+    int32_t *inv_ref = dsa_ref_buffer;
+
+    for (uint32_t i = 0; i < num_layers; i++)
+    {
+        dsa_layer_state_t *layer = &state->layer[i];
+
+        if (!layer->additive || (layer->weight == 0))
+            continue;
+
+        layer->inv_ref = inv_ref;
+
+        for (uint32_t j = 0; j < num_joints; j++)
+        {
+            int32_t ref[12];
+
+            dsa_get_joint_matrix(layer->dsa, 0, 0, 0, j, ref);
+            matrix_inverse(ref, inv_ref);
+            inv_ref += 12;
+        }
+    }
+
+    return DSMA_SUCCESS;
+}
+
+// Calculates the matrix of a joint by blending all the layers. First, the
+// layers that aren't additive are blended using their weights. Version 1 files
+// are blended as positions and quaternions, like in
+// DSMA_ComputePoseBlendAnimation(), other versions are blended as matrices.
+// Then, the difference between the current frame and frame 0 of each additive
+// layer is applied on top of the result, scaled by its weight.
+ITCM_CODE ARM_CODE static inline
+void dsa_layers_joint_matrix(const dsa_layers_t *state, uint32_t joint,
+                             int32_t *m)
+{
+    int32_t tmp[12];
+
+    if (state->quaternions)
+    {
+        int32_t v_pos[3];
+        int32_t q_orient[4];
+        bool first = true;
+
+        for (uint32_t l = 0; l < state->num_layers; l++)
+        {
+            const dsa_layer_state_t *layer = &state->layer[l];
+
+            if (layer->additive)
+                continue;
+
+            const dsa_joint_t *j1 =
+                    &dsa_get_frame(layer->dsa, layer->frame)[joint];
+
+            int32_t v_pos_layer[3];
+            int32_t q_orient_layer[4];
+
+            // A single layer gives the same result as DSMA_ComputePose(), and
+            // several layers the same result as blending them one after the
+            // other with DSMA_ComputePoseBlendAnimation(). The interpolated
+            // quaternions are normalized in the same cases as in those
+            // functions.
+            if ((layer->interp == 0) && (state->num_blended == 1))
+            {
+                for (int i = 0; i < 3; i++)
+                    v_pos_layer[i] = j1->pos[i];
+                for (int i = 0; i < 4; i++)
+                    q_orient_layer[i] = j1->orient[i];
+            }
+            else
+            {
+                const dsa_joint_t *j2 =
+                        &dsa_get_frame(layer->dsa, layer->next_frame)[joint];
+
+                dsa_interpolate_frames(j1->pos, j1->orient,
+                                       j2->pos, j2->orient, layer->interp,
+                                       v_pos_layer, q_orient_layer);
+            }
+
+            if (first)
+            {
+                for (int i = 0; i < 3; i++)
+                    v_pos[i] = v_pos_layer[i];
+                for (int i = 0; i < 4; i++)
+                    q_orient[i] = q_orient_layer[i];
+                first = false;
+            }
+            else
+            {
+                dsa_interpolate_frames(v_pos, q_orient,
+                                       v_pos_layer, q_orient_layer,
+                                       layer->weight, v_pos, q_orient);
+            }
+        }
+
+        joint_to_matrix(v_pos, q_orient, m);
+    }
+    else
+    {
+        bool first = true;
+
+        for (uint32_t l = 0; l < state->num_layers; l++)
+        {
+            const dsa_layer_state_t *layer = &state->layer[l];
+
+            if (layer->additive)
+                continue;
+
+            dsa_get_joint_matrix(layer->dsa, layer->frame, layer->next_frame,
+                                 layer->interp, joint, tmp);
+
+            if (first)
+            {
+                for (int i = 0; i < 12; i++)
+                    m[i] = tmp[i];
+                first = false;
+            }
+            else
+            {
+                matrix_lerp(m, tmp, layer->weight, m);
+            }
+        }
+    }
+
+    for (uint32_t l = 0; l < state->num_layers; l++)
+    {
+        const dsa_layer_state_t *layer = &state->layer[l];
+
+        if (!layer->additive || (layer->weight == 0))
+            continue;
+
+        int32_t inv_ref_joint[12];
+        const int32_t *inv_ref;
+        int32_t delta[12];
+
+        if (layer->inv_ref != NULL)
+        {
+            inv_ref = &layer->inv_ref[joint * 12];
+        }
+        else
+        {
+            dsa_get_joint_matrix(layer->dsa, 0, 0, 0, joint, tmp);
+            matrix_inverse(tmp, inv_ref_joint);
+            inv_ref = inv_ref_joint;
+        }
+
+        dsa_get_joint_matrix(layer->dsa, layer->frame, layer->next_frame,
+                             layer->interp, joint, tmp);
+
+        matrix_mult(tmp, inv_ref, delta);
+
+        // Interpolate between the identity matrix and the difference
+        if (layer->weight != inttof32(1))
+        {
+            for (int i = 0; i < 12; i++)
+            {
+                int32_t identity = ((i == 0) || (i == 4) || (i == 8)) ?
+                                   inttof32(1) : 0;
+                delta[i] = lerp(identity, delta[i], layer->weight);
+            }
+        }
+
+        for (int i = 0; i < 12; i++)
+            tmp[i] = m[i];
+
+        matrix_mult(delta, tmp, m);
+    }
+}
+
+static inline bool dsm_is_partitioned(const void *dsm_file)
+{
+    return ((const uint32_t *)dsm_file)[0] == DSM_PARTITIONED_MAGIC;
+}
+
+// Checks that all the sub-meshes of a partitioned DSM file fit in the matrix
+// stack and only use joints that exist in the skeleton.
+static int dsm_partitioned_check(const dsm_partitioned_t *dsm,
+                                 uint32_t num_joints)
+{
+    if ((dsm->max_joints == 0) || (dsm->max_joints > 30))
+        return DSMA_INVALID_MODEL;
+
+    const uint32_t *data = dsm->data;
+
+    for (uint32_t s = 0; s < dsm->num_submeshes; s++)
+    {
+        uint32_t submesh_joints = *data++;
+        if (submesh_joints > dsm->max_joints)
+            return DSMA_INVALID_MODEL;
+
+        for (uint32_t i = 0; i < submesh_joints; i++)
+        {
+            if (data[i] >= num_joints)
+                return DSMA_INVALID_MODEL;
+        }
+
+        data += submesh_joints;
+        data += data[0] + 1;
+    }
+
+    return DSMA_SUCCESS;
+}
+
+// Callback that calculates the matrix of a joint of the skeleton.
+typedef void (*dsm_joint_matrix_fn)(const void *arg, uint32_t joint,
+                                    int32_t *m);
+
+ITCM_CODE ARM_CODE
+static void dsm_pose_joint_matrix(const void *arg, uint32_t joint, int32_t *m)
+{
+    const int32_t *pose = arg;
+    pose += joint * DSMA_POSE_MATRIX_SIZE;
+
+    for (int i = 0; i < DSMA_POSE_MATRIX_SIZE; i++)
+        m[i] = pose[i];
+}
+
+ITCM_CODE ARM_CODE
+static void dsm_layers_joint_matrix(const void *arg, uint32_t joint,
+                                    int32_t *m)
+{
+    dsa_layers_joint_matrix(arg, joint, m);
+}
+
+typedef struct {
+    const dsa_t *dsa[2];
+    uint32_t frame[2];
+    uint32_t next_frame[2];
+    uint32_t interp[2];
+    uint32_t blend;
+} dsm_blend_arg_t;
+
+// Calculates the matrix of a joint by blending two animations in the same way
+// as DSMA_DrawModelBlendAnimation() does with regular DSM files. Version 1
+// files are blended as positions and quaternions, other versions as matrices.
+ITCM_CODE ARM_CODE
+static void dsm_blend_joint_matrix(const void *arg, uint32_t joint, int32_t *m)
+{
+    const dsm_blend_arg_t *b = arg;
+
+    if ((b->dsa[0]->version != DSA_VERSION_NUMBER) ||
+        (b->dsa[1]->version != DSA_VERSION_NUMBER))
+    {
+        int32_t m_1[12];
+        int32_t m_2[12];
+
+        dsa_get_joint_matrix(b->dsa[0], b->frame[0], b->next_frame[0],
+                             b->interp[0], joint, m_1);
+        dsa_get_joint_matrix(b->dsa[1], b->frame[1], b->next_frame[1],
+                             b->interp[1], joint, m_2);
+
+        matrix_lerp(m_1, m_2, b->blend, m);
+        return;
+    }
+
+    int32_t v_pos[2][3];
+    int32_t q_orient[2][4];
+
+    for (int a = 0; a < 2; a++)
+    {
+        const dsa_joint_t *j1 = &dsa_get_frame(b->dsa[a], b->frame[a])[joint];
+        const dsa_joint_t *j2 =
+                &dsa_get_frame(b->dsa[a], b->next_frame[a])[joint];
+
+        dsa_interpolate_frames(j1->pos, j1->orient, j2->pos, j2->orient,
+                               b->interp[a], v_pos[a], q_orient[a]);
+    }
+
+    int32_t v_pos_blend[3];
+    int32_t q_orient_blend[4];
+
+    dsa_interpolate_frames(v_pos[0], q_orient[0], v_pos[1], q_orient[1],
+                           b->blend, v_pos_blend, q_orient_blend);
+
+    joint_to_matrix(v_pos_blend, q_orient_blend, m);
+}
+
+// Draws a DSM file split in sub-meshes. Before drawing each sub-mesh, only the
+// matrices of the joints it uses are calculated and stored in the stack. Joints
+// shared by several sub-meshes are calculated once per sub-mesh.
+ITCM_CODE ARM_CODE
+static int dsm_draw_partitioned(const dsm_partitioned_t *dsm,
+                                uint32_t num_joints,
+                                dsm_joint_matrix_fn get_joint_matrix,
+                                const void *arg)
+{
+    int ret = dsm_partitioned_check(dsm, num_joints);
+    if (ret != DSMA_SUCCESS)
+        return ret;
+
+    // Make sure that there is enough space in the matrix stack
+    // --------------------------------------------------------
+
+    uint32_t base_matrix = 30 - dsm->max_joints + 1;
+
+    uint32_t curr_stack_level = dsma_gx_stack_level();
+    if (curr_stack_level >= base_matrix)
+        return DSMA_MATRIX_STACK_FULL;
+
+    dsma_gx_push();
+
+    // Draw sub-meshes
+    // ---------------
+
+    const uint32_t *data = dsm->data;
+
+    for (uint32_t s = 0; s < dsm->num_submeshes; s++)
+    {
+        uint32_t submesh_joints = *data++;
+
+        for (uint32_t i = 0; i < submesh_joints; i++)
+        {
+            int32_t m[12];
+
+            get_joint_matrix(arg, data[i], m);
+
+            // Generate new matrix
+            dsma_gx_restore(curr_stack_level);
+            for (int j = 0; j < 12; j++)
+                dsma_gx_mult4x3(m[j]);
+
+            // Store it in the right position in the stack
+            dsma_gx_store(base_matrix + i);
+        }
+
+        data += submesh_joints;
+
+        dsma_gx_call_list(data);
+
+        data += data[0] + 1;
+    }
+
+    dsma_gx_pop();
+
+    return DSMA_SUCCESS;
+}
+
+// Public functions
+// ================
+
+void DSMA_SetQuaternionNormalization(bool enabled)
+{
+    dsma_normalize_quaternions = enabled;
+}
+
+bool DSMA_GetQuaternionNormalization(void)
+{
+    return dsma_normalize_quaternions;
+}
+
+void DSMA_QuaternionNormalize(int32_t *q)
+{
+    q_normalize(q);
+}
+
+uint32_t DSMA_GetNumFrames(const void *dsa_file)
+{
+    const dsa_t *dsa = dsa_file;
+    return dsa->num_frames;
+}
+
+uint32_t DSMA_GetNumJoints(const void *dsa_file)
+{
+    const dsa_t *dsa = dsa_file;
+    return dsa->num_joints;
+}
+
+uint32_t DSMA_GetNumSubmeshes(const void *dsm_file)
+{
+    if (!dsm_is_partitioned(dsm_file))
+        return 1;
+
+    const dsm_partitioned_t *dsm = dsm_file;
+    return dsm->num_submeshes;
+}
+
+const void *DSMA_GetSubmeshDisplayList(const void *dsm_file, uint32_t index)
+{
+    if (!dsm_is_partitioned(dsm_file))
+        return index == 0 ? dsm_file : NULL;
+
+    const dsm_partitioned_t *dsm = dsm_file;
+    if (index >= dsm->num_submeshes)
+        return NULL;
+
+    const uint32_t *data = dsm->data;
+
+    for (uint32_t s = 0; s < index; s++)
+    {
+        data += data[0] + 1; // Skip table of joints
+        data += data[0] + 1; // Skip display list
+    }
+
+    // Skip table of joints
+    return data + data[0] + 1;
+}
+
+ITCM_CODE ARM_CODE
+int DSMA_ComputePose(const void *dsa_file, uint32_t frame_interp, int32_t *pose)
+{
+    const dsa_t *dsa = dsa_file;
+
+    if (!dsa_version_is_valid(dsa))
+        return DSMA_INVALID_VERSION;
+
+    uint32_t num_joints = dsa->num_joints;
+    uint32_t num_frames = dsa->num_frames;
+
+    uint32_t frame = frame_interp >> 12;
+    uint32_t interp = frame_interp & 0xFFF;
+
+    if (frame >= num_frames)
+        return DSMA_INVALID_FRAME;
+
+    if (dsa->version != DSA_VERSION_NUMBER)
+    {
+        uint32_t next_frame = frame + 1;
+        if (next_frame == num_frames)
+            next_frame = 0;
+
+        for (uint32_t i = 0; i < num_joints; i++)
+        {
+            dsa_get_joint_matrix(dsa, frame, next_frame, interp, i, pose);
+            pose += DSMA_POSE_MATRIX_SIZE;
+        }
+    }
+    else if (interp != 0)
+    {
+        uint32_t next_frame = frame + 1;
+        if (next_frame == num_frames)
+            next_frame = 0;
+
+        const dsa_joint_t *frame_ptr_1 = dsa_get_frame(dsa, frame);
+        const dsa_joint_t *frame_ptr_2 = dsa_get_frame(dsa, next_frame);
+
+        for (uint32_t i = 0; i < num_joints; i++)
+        {
+            int32_t v_pos[3];
+            int32_t q_orient[4];
+
+            dsa_interpolate_frames(&frame_ptr_1->pos[0],
+                                   &frame_ptr_1->orient[0],
+                                   &frame_ptr_2->pos[0],
+                                   &frame_ptr_2->orient[0],
+                                   interp, &v_pos[0], &q_orient[0]);
+            frame_ptr_1++;
+            frame_ptr_2++;
+
+            joint_to_matrix(v_pos, q_orient, pose);
+            pose += DSMA_POSE_MATRIX_SIZE;
+        }
+    }
+    else
+    {
+        const dsa_joint_t *frame_ptr = dsa_get_frame(dsa, frame);
+
+        for (uint32_t i = 0; i < num_joints; i++)
+        {
+            joint_to_matrix(frame_ptr->pos, frame_ptr->orient, pose);
+            frame_ptr++;
+            pose += DSMA_POSE_MATRIX_SIZE;
+        }
+    }
+
+    return DSMA_SUCCESS;
+}
+
+ITCM_CODE ARM_CODE
+int DSMA_ComputePoseBlendAnimation(int32_t *pose,
+        const void *dsa_file_1, uint32_t frame_interp_1,
+        const void *dsa_file_2, uint32_t frame_interp_2,
+        uint32_t blend)
+{
+    const dsa_t *dsa_1 = dsa_file_1;
+    const dsa_t *dsa_2 = dsa_file_2;
+
+    if (!dsa_version_is_valid(dsa_1))
+        return DSMA_INVALID_VERSION;
+
+    if (!dsa_version_is_valid(dsa_2))
+        return DSMA_INVALID_VERSION;
+
+    uint32_t num_joints = dsa_1->num_joints;
+
+    if (num_joints != dsa_2->num_joints)
+        return DSMA_INCOMPATIBLE_ANIMATIONS;
+
+    uint32_t num_frames_1 = dsa_1->num_frames;
+    uint32_t num_frames_2 = dsa_2->num_frames;
+
+    uint32_t frame_1 = frame_interp_1 >> 12;
+    uint32_t interp_1 = frame_interp_1 & 0xFFF;
+
+    if (frame_1 >= num_frames_1)
+        return DSMA_INVALID_FRAME;
+
+    uint32_t frame_2 = frame_interp_2 >> 12;
+    uint32_t interp_2 = frame_interp_2 & 0xFFF;
+
+    if (frame_2 >= num_frames_2)
+        return DSMA_INVALID_FRAME;
+
+    if (blend > inttof32(1))
+        return DSMA_INVALID_BLENDING;
+
+    uint32_t next_frame_1 = frame_1 + 1;
+    if (next_frame_1 == num_frames_1)
+        next_frame_1 = 0;
+
+    uint32_t next_frame_2 = frame_2 + 1;
+    if (next_frame_2 == num_frames_2)
+        next_frame_2 = 0;
+
+    if ((dsa_1->version != DSA_VERSION_NUMBER) ||
+        (dsa_2->version != DSA_VERSION_NUMBER))
+    {
+        for (uint32_t i = 0; i < num_joints; i++)
+        {
+            int32_t m_1[12];
+            int32_t m_2[12];
+
+            dsa_get_joint_matrix(dsa_1, frame_1, next_frame_1, interp_1, i,
+                                 m_1);
+            dsa_get_joint_matrix(dsa_2, frame_2, next_frame_2, interp_2, i,
+                                 m_2);
+
+            matrix_lerp(m_1, m_2, blend, pose);
+            pose += DSMA_POSE_MATRIX_SIZE;
+        }
+
+        return DSMA_SUCCESS;
+    }
+
+    const dsa_joint_t *frame_1_ptr_1 = dsa_get_frame(dsa_1, frame_1);
+    const dsa_joint_t *frame_1_ptr_2 = dsa_get_frame(dsa_1, next_frame_1);
+
+    const dsa_joint_t *frame_2_ptr_1 = dsa_get_frame(dsa_2, frame_2);
+    const dsa_joint_t *frame_2_ptr_2 = dsa_get_frame(dsa_2, next_frame_2);
 
-// Format of a DSA file.
-typedef struct {
-    uint32_t version;      // Version number
-    uint32_t num_frames;   // Frames in the file
-    uint32_t num_joints;   // Joints per frame
-    dsa_joint_t joints[0]; // Array of joints
-} dsa_t;
+    for (uint32_t i = 0; i < num_joints; i++)
+    {
+        int32_t v_pos_1[3];
+        int32_t q_orient_1[4];
 
-// Private functions
-// =================
+        dsa_interpolate_frames(&frame_1_ptr_1->pos[0],
+                               &frame_1_ptr_1->orient[0],
+                               &frame_1_ptr_2->pos[0],
+                               &frame_1_ptr_2->orient[0],
+                               interp_1, &v_pos_1[0], &q_orient_1[0]);
+        frame_1_ptr_1++;
+        frame_1_ptr_2++;
 
-// Helper that multiplies two fixed point values in 20.12 format and multiplies
-// the result again by 2.
-ITCM_CODE ARM_CODE static inline
-int32_t mulf32_by_2(int32_t a, int32_t b)
-{
-    return (a * b) >> (12 - 1);
-}
+        int32_t v_pos_2[3];
+        int32_t q_orient_2[4];
 
-// Generates a 4x3 matrix from the orientation in the provided quaternion and
-// the translation in the provided vector. Then, it multiplies the matrix that
-// is currently active in the geometry engine by the generated matrix.
-ITCM_CODE ARM_CODE static inline
-void matrix_mult_by_joint(const int32_t *v, const int32_t *q)
-{
-    int32_t wx = mulf32_by_2(q[0], q[1]);
-    int32_t wy = mulf32_by_2(q[0], q[2]);
-    int32_t wz = mulf32_by_2(q[0], q[3]);
-    int32_t x2 = mulf32_by_2(q[1], q[1]);
-    int32_t xy = mulf32_by_2(q[1], q[2]);
-    int32_t xz = mulf32_by_2(q[1], q[3]);
-    int32_t y2 = mulf32_by_2(q[2], q[2]);
-    int32_t yz = mulf32_by_2(q[2], q[3]);
-    int32_t z2 = mulf32_by_2(q[3], q[3]);
+        dsa_interpolate_frames(&frame_2_ptr_1->pos[0],
+                               &frame_2_ptr_1->orient[0],
+                               &frame_2_ptr_2->pos[0],
+                               &frame_2_ptr_2->orient[0],
+                               interp_2, &v_pos_2[0], &q_orient_2[0]);
+        frame_2_ptr_1++;
+        frame_2_ptr_2++;
 
-    MATRIX_MULT4x3 = inttof32(1) - y2 - z2;
-    MATRIX_MULT4x3 = xy + wz;
-    MATRIX_MULT4x3 = xz - wy;
+        int32_t v_pos[3];
+        int32_t q_orient[4];
 
-    MATRIX_MULT4x3 = xy - wz;
-    MATRIX_MULT4x3 = inttof32(1) - x2 - z2;
-    MATRIX_MULT4x3 = yz + wx;
+        dsa_interpolate_frames(&v_pos_1[0], &q_orient_1[0],
+                               &v_pos_2[0], &q_orient_2[0],
+                               blend, &v_pos[0], &q_orient[0]);
 
-    MATRIX_MULT4x3 = xz + wy;
-    MATRIX_MULT4x3 = yz - wx;
-    MATRIX_MULT4x3 = inttof32(1) - x2 - y2;
+        joint_to_matrix(v_pos, q_orient, pose);
+        pose += DSMA_POSE_MATRIX_SIZE;
+    }
 
-    MATRIX_MULT4x3 = v[0];
-    MATRIX_MULT4x3 = v[1];
-    MATRIX_MULT4x3 = v[2];
+    return DSMA_SUCCESS;
 }
 
-// Gets a pointer to the list of joints of the specified frame.
-ITCM_CODE ARM_CODE static inline
-const dsa_joint_t *dsa_get_frame(const dsa_t *dsa, uint32_t frame)
+ITCM_CODE ARM_CODE
+int DSMA_DrawModelPose(const void *dsm_file, const int32_t *pose,
+                       uint32_t num_joints)
 {
-    return &dsa->joints[frame * dsa->num_joints];
-}
+    if (dsm_is_partitioned(dsm_file))
+    {
+        return dsm_draw_partitioned(dsm_file, num_joints,
+                                    dsm_pose_joint_matrix, pose);
+    }
 
-// Interpolates linearly between 'start' and 'end'. The position is a floating
-// point number in 20.12 format, and it should be between 0.0 and 1.0 (the
-// function doesn't check bounds).
-ITCM_CODE ARM_CODE static inline
-int32_t lerp(int32_t start, int32_t end, int32_t pos)
-{
-    int32_t diff = end - start;
-    return start + ((diff * pos) >> 12);
-}
+    // Make sure that there is enough space in the matrix stack
+    // --------------------------------------------------------
 
-// Interpolates between quaternions 'q1' and 'q2. The position is a floating
-// point number in 20.12 format, and it should be between 0.0 and 1.0 (the
-// function doesn't check bounds). It stores the result in 'qdest'.
-ITCM_CODE ARM_CODE static inline
-void q_nlerp(const int32_t *q1, const int32_t *q2, int32_t pos, int32_t *qdest)
-{
-    qdest[0] = lerp(q1[0], q2[0], pos);
-    qdest[1] = lerp(q1[1], q2[1], pos);
-    qdest[2] = lerp(q1[2], q2[2], pos);
-    qdest[3] = lerp(q1[3], q2[3], pos);
+    uint32_t base_matrix = 30 - num_joints + 1;
 
-    // TODO: Normalize? It needs way too much CPU time (at least we need one
-    // square root and one division), but it may be needed in the future if the
-    // animations look bad. Maybe it can be optional.
-}
+    uint32_t curr_stack_level = dsma_gx_stack_level();
+    if (curr_stack_level >= base_matrix)
+        return DSMA_MATRIX_STACK_FULL;
 
-// Interpolate between two positions and two orientations.
-ITCM_CODE ARM_CODE static inline
-void dsa_interpolate_frames(const int32_t *v_pos_1, const int32_t *q_orient_1,
-                            const int32_t *v_pos_2, const int32_t *q_orient_2,
-                            uint32_t interp, int32_t *v_pos, int32_t *q_orient)
-{
-    v_pos[0] = lerp(v_pos_1[0], v_pos_2[0], interp);
-    v_pos[1] = lerp(v_pos_1[1], v_pos_2[1], interp);
-    v_pos[2] = lerp(v_pos_1[2], v_pos_2[2], interp);
+    dsma_gx_push();
 
-    q_nlerp(q_orient_1, q_orient_2, interp, q_orient);
-}
+    // Generate matrices with bone transformations
+    // -------------------------------------------
 
-// Public functions
-// ================
+    for (uint32_t i = 0; i < num_joints; i++)
+    {
+        // Generate new matrix
+        dsma_gx_restore(curr_stack_level);
 
-uint32_t DSMA_GetNumFrames(const void *dsa_file)
-{
-    const dsa_t *dsa = dsa_file;
-    return dsa->num_frames;
+        for (int j = 0; j < DSMA_POSE_MATRIX_SIZE; j++)
+            dsma_gx_mult4x3(pose[j]);
+        pose += DSMA_POSE_MATRIX_SIZE;
+
+        // Store it in the right position in the stack
+        dsma_gx_store(base_matrix + i);
+    }
+
+    // Draw model
+    // ----------
+
+    dsma_gx_call_list(dsm_file);
+
+    dsma_gx_pop();
+
+    return DSMA_SUCCESS;
 }
 
 ITCM_CODE ARM_CODE
 int DSMA_DrawModel(const void *dsm_file, const void *dsa_file, uint32_t frame_interp)
 {
+    if (dsm_is_partitioned(dsm_file))
+    {
+        DSMA_Layer layer = { dsa_file, frame_interp, inttof32(1), false };
+        return DSMA_DrawModelLayers(dsm_file, &layer, 1);
+    }
+
     const dsa_t *dsa = dsa_file;
 
-    if (dsa->version != DSA_VERSION_NUMBER)
+    if (!dsa_version_is_valid(dsa))
         return DSMA_INVALID_VERSION;
 
     uint32_t num_joints = dsa->num_joints;
@@ -145,19 +1269,78 @@ int DSMA_DrawModel(const void *dsm_file, const void *dsa_file, uint32_t frame_in
 
     uint32_t base_matrix = 30 - num_joints + 1;
 
-    // Wait for matrix push/pop operations to end
-    while (GFX_STATUS & BIT(14));
-
-    uint32_t curr_stack_level = (GFX_STATUS >> 8) & 0x1F;
+    uint32_t curr_stack_level = dsma_gx_stack_level();
     if (curr_stack_level >= base_matrix)
         return DSMA_MATRIX_STACK_FULL;
 
-    MATRIX_PUSH = 0;
+    dsma_gx_push();
 
     // Generate matrices with bone transformations
     // -------------------------------------------
 
-    if (interp != 0)
+    if (dsa->version == DSA_VERSION_COMPRESSED)
+    {
+        const dsa_compressed_t *dsa_c = dsa_file;
+
+        for (uint32_t i = 0; i < num_joints; i++)
+        {
+            int32_t v_pos[3];
+            int32_t q_orient[4];
+
+            dsa_compressed_sample(dsa_c, frame, interp, i, v_pos, q_orient);
+
+            // Generate new matrix
+            dsma_gx_restore(curr_stack_level);
+            matrix_mult_by_joint(v_pos, q_orient);
+
+            // Store it in the right position in the stack
+            dsma_gx_store(base_matrix + i);
+        }
+    }
+    else if (dsa->version == DSA_VERSION_MATRICES)
+    {
+        const dsa_matrix_t *frame_ptr_1 = dsa_get_frame_matrices(dsa, frame);
+
+        if (interp == 0)
+        {
+            // The matrices can be sent as they are
+            for (uint32_t i = 0; i < num_joints; i++)
+            {
+                const int32_t *m = frame_ptr_1->m;
+                frame_ptr_1++;
+
+                dsma_gx_restore(curr_stack_level);
+                for (int j = 0; j < 12; j++)
+                    dsma_gx_mult4x3(m[j]);
+
+                dsma_gx_store(base_matrix + i);
+            }
+        }
+        else
+        {
+            uint32_t next_frame = frame + 1;
+            if (next_frame == num_frames)
+                next_frame = 0;
+
+            const dsa_matrix_t *frame_ptr_2 =
+                    dsa_get_frame_matrices(dsa, next_frame);
+
+            for (uint32_t i = 0; i < num_joints; i++)
+            {
+                const int32_t *m1 = frame_ptr_1->m;
+                const int32_t *m2 = frame_ptr_2->m;
+                frame_ptr_1++;
+                frame_ptr_2++;
+
+                dsma_gx_restore(curr_stack_level);
+                for (int j = 0; j < 12; j++)
+                    dsma_gx_mult4x3(lerp(m1[j], m2[j], interp));
+
+                dsma_gx_store(base_matrix + i);
+            }
+        }
+    }
+    else if (interp != 0)
     {
         uint32_t next_frame = frame + 1;
         if (next_frame == num_frames)
@@ -180,11 +1363,11 @@ int DSMA_DrawModel(const void *dsm_file, const void *dsa_file, uint32_t frame_in
             frame_ptr_2++;
 
             // Generate new matrix
-            MATRIX_RESTORE = curr_stack_level;
+            dsma_gx_restore(curr_stack_level);
             matrix_mult_by_joint(v_pos, q_orient);
 
             // Store it in the right position in the stack
-            MATRIX_STORE = base_matrix + i;
+            dsma_gx_store(base_matrix + i);
         }
     }
     else
@@ -199,20 +1382,20 @@ int DSMA_DrawModel(const void *dsm_file, const void *dsa_file, uint32_t frame_in
             frame_ptr++;
 
             // Generate new matrix
-            MATRIX_RESTORE = curr_stack_level;
+            dsma_gx_restore(curr_stack_level);
             matrix_mult_by_joint(v_pos, q_orient);
 
             // Store it in the right position in the stack
-            MATRIX_STORE = base_matrix + i;
+            dsma_gx_store(base_matrix + i);
         }
     }
 
     // Draw model
     // ----------
 
-    glCallList((uint32_t *)dsm_file);
+    dsma_gx_call_list(dsm_file);
 
-    MATRIX_POP = 1;
+    dsma_gx_pop();
 
     return DSMA_SUCCESS;
 }
@@ -226,10 +1409,10 @@ int DSMA_DrawModelBlendAnimation(const void *dsm_file,
     const dsa_t *dsa_1 = dsa_file_1;
     const dsa_t *dsa_2 = dsa_file_2;
 
-    if (dsa_1->version != DSA_VERSION_NUMBER)
+    if (!dsa_version_is_valid(dsa_1))
         return DSMA_INVALID_VERSION;
 
-    if (dsa_2->version != DSA_VERSION_NUMBER)
+    if (!dsa_version_is_valid(dsa_2))
         return DSMA_INVALID_VERSION;
 
     uint32_t num_joints = dsa_1->num_joints;
@@ -255,82 +1438,196 @@ int DSMA_DrawModelBlendAnimation(const void *dsm_file,
     if (blend > inttof32(1))
         return DSMA_INVALID_BLENDING;
 
+    uint32_t next_frame_1 = frame_1 + 1;
+    if (next_frame_1 == num_frames_1)
+        next_frame_1 = 0;
+
+    uint32_t next_frame_2 = frame_2 + 1;
+    if (next_frame_2 == num_frames_2)
+        next_frame_2 = 0;
+
+    if (dsm_is_partitioned(dsm_file))
+    {
+        dsm_blend_arg_t arg = {
+            { dsa_1, dsa_2 },
+            { frame_1, frame_2 },
+            { next_frame_1, next_frame_2 },
+            { interp_1, interp_2 },
+            blend
+        };
+        return dsm_draw_partitioned(dsm_file, num_joints,
+                                    dsm_blend_joint_matrix, &arg);
+    }
+
     // Make sure that there is enough space in the matrix stack
     // --------------------------------------------------------
 
     uint32_t base_matrix = 30 - num_joints + 1;
 
-    // Wait for matrix push/pop operations to end
-    while (GFX_STATUS & BIT(14));
-
-    uint32_t curr_stack_level = (GFX_STATUS >> 8) & 0x1F;
+    uint32_t curr_stack_level = dsma_gx_stack_level();
     if (curr_stack_level >= base_matrix)
         return DSMA_MATRIX_STACK_FULL;
 
-    MATRIX_PUSH = 0;
+    dsma_gx_push();
 
     // Generate matrices with bone transformations
     // -------------------------------------------
 
-    uint32_t next_frame_1 = frame_1 + 1;
-    if (next_frame_1 == num_frames_1)
-        next_frame_1 = 0;
+    if ((dsa_1->version != DSA_VERSION_NUMBER) ||
+        (dsa_2->version != DSA_VERSION_NUMBER))
+    {
+        for (uint32_t i = 0; i < num_joints; i++)
+        {
+            int32_t m_1[12];
+            int32_t m_2[12];
+            int32_t m[12];
 
-    uint32_t next_frame_2 = frame_2 + 1;
-    if (next_frame_2 == num_frames_2)
-        next_frame_2 = 0;
+            dsa_get_joint_matrix(dsa_1, frame_1, next_frame_1, interp_1, i,
+                                 m_1);
+            dsa_get_joint_matrix(dsa_2, frame_2, next_frame_2, interp_2, i,
+                                 m_2);
 
-    const dsa_joint_t *frame_1_ptr_1 = dsa_get_frame(dsa_1, frame_1);
-    const dsa_joint_t *frame_1_ptr_2 = dsa_get_frame(dsa_1, next_frame_1);
+            matrix_lerp(m_1, m_2, blend, m);
 
-    const dsa_joint_t *frame_2_ptr_1 = dsa_get_frame(dsa_2, frame_2);
-    const dsa_joint_t *frame_2_ptr_2 = dsa_get_frame(dsa_2, next_frame_2);
+            // Generate new matrix
+            dsma_gx_restore(curr_stack_level);
+            for (int j = 0; j < 12; j++)
+                dsma_gx_mult4x3(m[j]);
 
-    for (uint32_t i = 0; i < num_joints; i++)
+            // Store it in the right position in the stack
+            dsma_gx_store(base_matrix + i);
+        }
+    }
+    else
     {
-        int32_t v_pos_1[3];
-        int32_t q_orient_1[4];
+        const dsa_joint_t *frame_1_ptr_1 = dsa_get_frame(dsa_1, frame_1);
+        const dsa_joint_t *frame_1_ptr_2 = dsa_get_frame(dsa_1, next_frame_1);
 
-        dsa_interpolate_frames(&frame_1_ptr_1->pos[0],
-                               &frame_1_ptr_1->orient[0],
-                               &frame_1_ptr_2->pos[0],
-                               &frame_1_ptr_2->orient[0],
-                               interp_1, &v_pos_1[0], &q_orient_1[0]);
-        frame_1_ptr_1++;
-        frame_1_ptr_2++;
+        const dsa_joint_t *frame_2_ptr_1 = dsa_get_frame(dsa_2, frame_2);
+        const dsa_joint_t *frame_2_ptr_2 = dsa_get_frame(dsa_2, next_frame_2);
 
-        int32_t v_pos_2[3];
-        int32_t q_orient_2[4];
+        for (uint32_t i = 0; i < num_joints; i++)
+        {
+            int32_t v_pos_1[3];
+            int32_t q_orient_1[4];
+
+            dsa_interpolate_frames(&frame_1_ptr_1->pos[0],
+                                   &frame_1_ptr_1->orient[0],
+                                   &frame_1_ptr_2->pos[0],
+                                   &frame_1_ptr_2->orient[0],
+                                   interp_1, &v_pos_1[0], &q_orient_1[0]);
+            frame_1_ptr_1++;
+            frame_1_ptr_2++;
+
+            int32_t v_pos_2[3];
+            int32_t q_orient_2[4];
+
+            dsa_interpolate_frames(&frame_2_ptr_1->pos[0],
+                                   &frame_2_ptr_1->orient[0],
+                                   &frame_2_ptr_2->pos[0],
+                                   &frame_2_ptr_2->orient[0],
+                                   interp_2, &v_pos_2[0], &q_orient_2[0]);
+            frame_2_ptr_1++;
+            frame_2_ptr_2++;
 
-        dsa_interpolate_frames(&frame_2_ptr_1->pos[0],
-                               &frame_2_ptr_1->orient[0],
-                               &frame_2_ptr_2->pos[0],
-                               &frame_2_ptr_2->orient[0],
-                               interp_2, &v_pos_2[0], &q_orient_2[0]);
-        frame_2_ptr_1++;
-        frame_2_ptr_2++;
+            int32_t v_pos[3];
+            int32_t q_orient[4];
 
-        int32_t v_pos[3];
-        int32_t q_orient[4];
+            dsa_interpolate_frames(&v_pos_1[0], &q_orient_1[0],
+                                   &v_pos_2[0], &q_orient_2[0],
+                                   blend, &v_pos[0], &q_orient[0]);
 
-        dsa_interpolate_frames(&v_pos_1[0], &q_orient_1[0],
-                               &v_pos_2[0], &q_orient_2[0],
-                               blend, &v_pos[0], &q_orient[0]);
+            // Generate new matrix
+            dsma_gx_restore(curr_stack_level);
+            matrix_mult_by_joint(v_pos, q_orient);
+
+            // Store it in the right position in the stack
+            dsma_gx_store(base_matrix + i);
+        }
+    }
+
+    // Draw model
+    // ----------
+
+    dsma_gx_call_list(dsm_file);
+
+    dsma_gx_pop();
+
+    return DSMA_SUCCESS;
+}
+
+ITCM_CODE ARM_CODE
+int DSMA_ComputePoseLayers(int32_t *pose, const DSMA_Layer *layers,
+                           uint32_t num_layers)
+{
+    dsa_layers_t state;
+
+    int ret = dsa_layers_prepare(layers, num_layers, &state);
+    if (ret != DSMA_SUCCESS)
+        return ret;
+
+    for (uint32_t i = 0; i < state.num_joints; i++)
+    {
+        dsa_layers_joint_matrix(&state, i, pose);
+        pose += DSMA_POSE_MATRIX_SIZE;
+    }
+
+    return DSMA_SUCCESS;
+}
+
+ITCM_CODE ARM_CODE
+int DSMA_DrawModelLayers(const void *dsm_file, const DSMA_Layer *layers,
+                         uint32_t num_layers)
+{
+    dsa_layers_t state;
+
+    int ret = dsa_layers_prepare(layers, num_layers, &state);
+    if (ret != DSMA_SUCCESS)
+        return ret;
+
+    uint32_t num_joints = state.num_joints;
+
+    if (dsm_is_partitioned(dsm_file))
+    {
+        return dsm_draw_partitioned(dsm_file, num_joints,
+                                    dsm_layers_joint_matrix, &state);
+    }
+
+    // Make sure that there is enough space in the matrix stack
+    // --------------------------------------------------------
+
+    uint32_t base_matrix = 30 - num_joints + 1;
+
+    uint32_t curr_stack_level = dsma_gx_stack_level();
+    if (curr_stack_level >= base_matrix)
+        return DSMA_MATRIX_STACK_FULL;
+
+    dsma_gx_push();
+
+    // Generate matrices with bone transformations
+    // -------------------------------------------
+
+    for (uint32_t i = 0; i < num_joints; i++)
+    {
+        int32_t m[12];
+
+        dsa_layers_joint_matrix(&state, i, m);
 
         // Generate new matrix
-        MATRIX_RESTORE = curr_stack_level;
-        matrix_mult_by_joint(v_pos, q_orient);
+        dsma_gx_restore(curr_stack_level);
+        for (int j = 0; j < 12; j++)
+            dsma_gx_mult4x3(m[j]);
 
         // Store it in the right position in the stack
-        MATRIX_STORE = base_matrix + i;
+        dsma_gx_store(base_matrix + i);
     }
 
     // Draw model
     // ----------
 
-    glCallList((uint32_t *)dsm_file);
+    dsma_gx_call_list(dsm_file);
 
-    MATRIX_POP = 1;
+    dsma_gx_pop();
 
     return DSMA_SUCCESS;
 }
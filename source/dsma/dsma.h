@@ -7,7 +7,11 @@
 #ifndef DSMA_H__
 #define DSMA_H__
 
-#include <nds.h>
+#ifdef DSMA_HOST
+# include "dsma_host.h"
+#else
+# include <nds.h>
+#endif
 
 #ifdef __cplusplus
 extern "C" {
@@ -17,9 +21,86 @@ extern "C" {
 # define ARM_CODE __attribute__((target("arm")))
 #endif
 
+// DSA files can be stored in three formats. Version 1 stores the position and
+// orientation (as a quaternion) of each joint, and the matrices of the joints
+// are generated when drawing the model. Version 2 stores the 4x3 matrix of each
+// joint, so the files are bigger, but drawing a model at an exact frame only
+// needs to send the matrices to the geometry engine. Version 3 is compressed:
+// values are quantized to 16 bits and each joint only stores the frames that
+// can't be interpolated from the frames around them, so the files are smaller
+// but drawing a model needs more CPU time. All functions accept all versions,
+// and animations of different versions can be blended.
+
+// When interpolating two frames (or blending two animations) the quaternions of
+// the joints are interpolated linearly, which makes them shorter than they
+// should be, and the model shrinks a bit. This enables normalizing them after
+// interpolating them. It uses a lookup table instead of a square root and a
+// division, but it still needs some CPU time. It is disabled by default. It
+// doesn't affect animations with baked matrices (version 2).
+void DSMA_SetQuaternionNormalization(bool enabled);
+
+// Returns true if quaternion normalization is enabled.
+bool DSMA_GetQuaternionNormalization(void);
+
+// Normalizes the specified quaternion (w, x, y, z in 20.12 format) in place
+// with the same method used when quaternion normalization is enabled.
+void DSMA_QuaternionNormalize(int32_t *q);
+
 // Returns the number of frames stored in the specified DSA file.
 uint32_t DSMA_GetNumFrames(const void *dsa_file);
 
+// Returns the number of joints of each frame of the specified DSA file.
+uint32_t DSMA_GetNumJoints(const void *dsa_file);
+
+// DSM files can be split in sub-meshes that use a subset of the joints of the
+// skeleton each (see the "--max-joints" option of md5_to_dsma). This allows
+// models with more joints than the ones that fit in the matrix stack. All
+// drawing functions accept them. When drawing them, only the matrices of the
+// joints used by each sub-mesh are stored in the stack before drawing it.
+// Joints used by several sub-meshes are calculated once per sub-mesh, except
+// with DSMA_DrawModelPose(), which uses a pose calculated beforehand.
+//
+// Returns the number of sub-meshes of the DSM file (1 if it isn't split).
+uint32_t DSMA_GetNumSubmeshes(const void *dsm_file);
+
+// Returns the display list of the specified sub-mesh of a DSM file, or NULL if
+// the index isn't valid. If the file isn't split, sub-mesh 0 is the whole file.
+const void *DSMA_GetSubmeshDisplayList(const void *dsm_file, uint32_t index);
+
+// Number of values of the matrix of each joint in a pose.
+#define DSMA_POSE_MATRIX_SIZE 12
+
+// Calculates the pose of the skeleton in the DSA file at the requested frame,
+// and stores it in 'pose'. The pose is made of one 4x3 matrix per joint (with
+// values in 20.12 format), so 'pose' must have space for DSMA_GetNumJoints() *
+// DSMA_POSE_MATRIX_SIZE values.
+//
+// The pose can be drawn with DSMA_DrawModelPose() as many times as needed, so
+// several models at the same frame of the same animation only need to calculate
+// it once. The frame works the same way as in DSMA_DrawModel().
+//
+// It returns a DSMA_* code (0 for success).
+ITCM_CODE ARM_CODE
+int DSMA_ComputePose(const void *dsa_file, uint32_t frame_interp, int32_t *pose);
+
+// Like DSMA_ComputePose(), but blending two animations like
+// DSMA_DrawModelBlendAnimation().
+//
+// It returns a DSMA_* code (0 for success).
+ITCM_CODE ARM_CODE
+int DSMA_ComputePoseBlendAnimation(int32_t *pose,
+        const void *dsa_file_1, uint32_t frame_interp_1,
+        const void *dsa_file_2, uint32_t frame_interp_2,
+        uint32_t blend);
+
+// Draws the model in the DSM file with a pose calculated by DSMA_ComputePose()
+// or DSMA_ComputePoseBlendAnimation().
+//
+// It returns a DSMA_* code (0 for success).
+ITCM_CODE ARM_CODE
+int DSMA_DrawModelPose(const void *dsm_file, const int32_t *pose,
+                       uint32_t num_joints);
+
 // Draws the model in the DSM file animated with the data in the specified DSA
 // file, at the requested frame.
 //
@@ -50,12 +131,58 @@ int DSMA_DrawModelBlendAnimation(const void *dsm_file,
         const void *dsa_file_2, uint32_t frame_interp_2,
         uint32_t blend);
 
+// Max number of layers that can be blended by DSMA_DrawModelLayers() and
+// DSMA_ComputePoseLayers().
+#define DSMA_MAX_LAYERS 8
+
+// Animation layer used by DSMA_DrawModelLayers() and DSMA_ComputePoseLayers().
+typedef struct {
+    const void *dsa_file;  // DSA file of the layer
+    uint32_t frame_interp; // Frame in 20.12 format
+    int32_t weight;        // Weight from 0.0 to 1.0 in 20.12 format
+    bool additive;         // Additive layer (true) or blended layer (false)
+} DSMA_Layer;
+
+// Calculates the pose of the skeleton by blending any number of animation
+// layers (up to DSMA_MAX_LAYERS), and stores it in 'pose' like
+// DSMA_ComputePose().
+//
+// Layers that aren't additive are averaged using their weights. The weights
+// are normalized, so they don't need to add up to 1.0, but at least one of
+// them must be greater than 0. This can be used to blend several animations
+// (for example, walking and running at different speeds).
+//
+// Additive layers are applied on top of the result. The difference between
+// the current frame and frame 0 of the additive animation, scaled by the
+// weight, is added to the pose. This can be used to animate parts of the
+// skeleton independently (for example, waving while walking), as long as the
+// joints that shouldn't be affected don't move in the additive animation.
+//
+// If all the layers that aren't additive are version 1 files, they are blended
+// as positions and quaternions, like in DSMA_ComputePoseBlendAnimation().
+// Otherwise, they are blended as matrices. DSA files of any version can be
+// used. The reference pose of each additive layer is calculated once per call.
+//
+// It returns a DSMA_* code (0 for success).
+ITCM_CODE ARM_CODE
+int DSMA_ComputePoseLayers(int32_t *pose, const DSMA_Layer *layers,
+                           uint32_t num_layers);
+
+// Draws the model in the DSM file with the pose obtained by blending the
+// specified animation layers, like DSMA_ComputePoseLayers().
+//
+// It returns a DSMA_* code (0 for success).
+ITCM_CODE ARM_CODE
+int DSMA_DrawModelLayers(const void *dsm_file, const DSMA_Layer *layers,
+                         uint32_t num_layers);
+
 #define DSMA_SUCCESS                    0
 #define DSMA_INVALID_VERSION            -1
 #define DSMA_INVALID_FRAME              -2
 #define DSMA_INVALID_BLENDING           -3
 #define DSMA_MATRIX_STACK_FULL          -4
 #define DSMA_INCOMPATIBLE_ANIMATIONS    -5
+#define DSMA_INVALID_MODEL              -6
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,90 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright (c) 2022 Antonio Niño Díaz <antonio_nd@outlook.com>
+
+// DS Model Animation Library v0.2.0
+
+#ifndef DSMA_GX_H__
+#define DSMA_GX_H__
+
+// Interface between DSMA and the geometry engine. All accesses to the matrix
+// stack and the GXFIFO go through these functions. When building DSMA for the
+// host (with DSMA_HOST defined) they aren't defined here, and the program that
+// uses DSMA must provide them (for example, with a software matrix stack).
+
+#include "dsma.h"
+
+#ifdef DSMA_HOST
+
+// Waits for matrix push/pop operations to end and returns the current level
+// of the matrix stack.
+uint32_t dsma_gx_stack_level(void);
+
+// Pushes the current matrix to the stack.
+void dsma_gx_push(void);
+
+// Pops one matrix from the stack.
+void dsma_gx_pop(void);
+
+// Loads the matrix at the specified position of the stack.
+void dsma_gx_restore(uint32_t index);
+
+// Stores the current matrix at the specified position of the stack.
+void dsma_gx_store(uint32_t index);
+
+// Sends one value of a 4x3 matrix to multiply the current matrix by. The
+// current matrix is multiplied after receiving 12 values.
+void dsma_gx_mult4x3(int32_t value);
+
+// Sends a display list to the geometry engine.
+void dsma_gx_call_list(const void *list);
+
+#else // DSMA_HOST
+
+ITCM_CODE ARM_CODE static inline
+uint32_t dsma_gx_stack_level(void)
+{
+    while (GFX_STATUS & BIT(14));
+
+    return (GFX_STATUS >> 8) & 0x1F;
+}
+
+ITCM_CODE ARM_CODE static inline
+void dsma_gx_push(void)
+{
+    MATRIX_PUSH = 0;
+}
+
+ITCM_CODE ARM_CODE static inline
+void dsma_gx_pop(void)
+{
+    MATRIX_POP = 1;
+}
+
+ITCM_CODE ARM_CODE static inline
+void dsma_gx_restore(uint32_t index)
+{
+    MATRIX_RESTORE = index;
+}
+
+ITCM_CODE ARM_CODE static inline
+void dsma_gx_store(uint32_t index)
+{
+    MATRIX_STORE = index;
+}
+
+ITCM_CODE ARM_CODE static inline
+void dsma_gx_mult4x3(int32_t value)
+{
+    MATRIX_MULT4x3 = value;
+}
+
+ITCM_CODE ARM_CODE static inline
+void dsma_gx_call_list(const void *list)
+{
+    glCallList((uint32_t *)list);
+}
+
+#endif // DSMA_HOST
+
+#endif // DSMA_GX_H__
@@ -0,0 +1,65 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright (c) 2022 Antonio Niño Díaz <antonio_nd@outlook.com>
+
+// DS Model Animation Library v0.2.0
+
+#ifndef DSMA_HOST_H__
+#define DSMA_HOST_H__
+
+// Replacement of the parts of libnds used by DSMA when it is built for the
+// host (with DSMA_HOST defined). The fixed point functions return the same
+// results as the ones of libnds, which use the hardware divider and square
+// root units of the NDS.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define ITCM_CODE
+#define ARM_CODE
+
+#define BIT(n) (1 << (n))
+
+#define inttof32(n) ((n) * (1 << 12))
+
+static inline int32_t mulf32(int32_t a, int32_t b)
+{
+    return (int32_t)(((int64_t)a * b) >> 12);
+}
+
+static inline int32_t divf32(int32_t num, int32_t den)
+{
+    return (int32_t)(((int64_t)num << 12) / den);
+}
+
+// GCC has a built-in function called sqrtf32 (for _Float32 values)
+#define sqrtf32 dsma_host_sqrtf32
+
+static inline int32_t sqrtf32(int32_t a)
+{
+    uint64_t value = (uint64_t)(int64_t)a << 12;
+    uint64_t result = 0;
+    uint64_t bit = 1ULL << 62;
+
+    while (bit > value)
+        bit >>= 2;
+
+    while (bit != 0)
+    {
+        if (value >= result + bit)
+        {
+            value -= result + bit;
+            result = (result >> 1) + bit;
+        }
+        else
+        {
+            result >>= 1;
+        }
+        bit >>= 2;
+    }
+
+    return (int32_t)result;
+}
+
+#endif // DSMA_HOST_H__
@@ -0,0 +1,232 @@
+// SPDX-License-Identifier: CC0-1.0
+//
+// SPDX-FileContributor: Antonio Niño Díaz, 2023
+//
+// This file is part of Nitro Engine
+
+// This test records display lists with the display list recorder, merges them,
+// and decodes the vertices of the resulting lists to check that they are the
+// same ones that were recorded. The recorder picks different vertex commands
+// depending on the vertices, so the vertices are chosen so that all of them are
+// used (including VTX_DIFF, which uses a different fixed point format).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <NEMain.h>
+
+#define ASSERT(cond)                                \
+    do {                                            \
+        if (!(cond)) {                              \
+            printf("Line %d\n", __LINE__);          \
+            while (1);                              \
+        }                                           \
+    } while (0)
+
+#define MAX_VERTICES    16
+
+typedef struct {
+    int num_vertices;
+    int vertices[MAX_VERTICES][3];
+    int commands[0x80]; // Number of times each command has been found
+} decoded_list_t;
+
+static int32_t sign_extend(uint32_t value, int bits)
+{
+    return (int32_t)(value << (32 - bits)) >> (32 - bits);
+}
+
+// Decodes the vertices of a display list. It only supports the commands that
+// are used in this test.
+static void decode_list(const uint32_t *list, decoded_list_t *out)
+{
+    const uint32_t *p = list + 1;
+    const uint32_t *end = p + list[0];
+    int vtx[3] = { 0, 0, 0 };
+
+    memset(out, 0, sizeof(decoded_list_t));
+
+    while (p < end)
+    {
+        uint32_t header = *p++;
+
+        for (int i = 0; i < 4; i++)
+        {
+            uint32_t cmd = (header >> (i * 8)) & 0xFF;
+            const uint32_t *param = p;
+
+            out->commands[cmd & 0x7F]++;
+
+            switch (cmd)
+            {
+                case FIFO_NOP:
+                case FIFO_END:
+                    continue;
+                case FIFO_BEGIN:
+                case FIFO_COLOR:
+                case FIFO_NORMAL:
+                case FIFO_TEX_COORD:
+                    p++;
+                    continue;
+                case FIFO_VERTEX16:
+                    vtx[0] = sign_extend(param[0], 16);
+                    vtx[1] = sign_extend(param[0] >> 16, 16);
+                    vtx[2] = sign_extend(param[1], 16);
+                    p += 2;
+                    break;
+                case FIFO_VERTEX10:
+                    vtx[0] = sign_extend(param[0], 10) << 6;
+                    vtx[1] = sign_extend(param[0] >> 10, 10) << 6;
+                    vtx[2] = sign_extend(param[0] >> 20, 10) << 6;
+                    p++;
+                    break;
+                case FIFO_VERTEX_XY:
+                    vtx[0] = sign_extend(param[0], 16);
+                    vtx[1] = sign_extend(param[0] >> 16, 16);
+                    p++;
+                    break;
+                case FIFO_VERTEX_XZ:
+                    vtx[0] = sign_extend(param[0], 16);
+                    vtx[2] = sign_extend(param[0] >> 16, 16);
+                    p++;
+                    break;
+                case FIFO_VERTEX_YZ:
+                    vtx[1] = sign_extend(param[0], 16);
+                    vtx[2] = sign_extend(param[0] >> 16, 16);
+                    p++;
+                    break;
+                case FIFO_VERTEX_DIFF:
+                    // The differences are in 1.0.9 format, not in v16 format
+                    vtx[0] += sign_extend(param[0], 10) << 3;
+                    vtx[1] += sign_extend(param[0] >> 10, 10) << 3;
+                    vtx[2] += sign_extend(param[0] >> 20, 10) << 3;
+                    p++;
+                    break;
+                default:
+                    printf("Unknown command: 0x%02X\n", (unsigned int)cmd);
+                    ASSERT(0);
+                    break;
+            }
+
+            ASSERT(out->num_vertices < MAX_VERTICES);
+            for (int j = 0; j < 3; j++)
+                out->vertices[out->num_vertices][j] = vtx[j];
+            out->num_vertices++;
+        }
+    }
+}
+
+// Vertices of the test triangles (v16). The second vertex of each triangle is
+// close to the first one and the difference is a multiple of 8, so it can be
+// sent with VTX_DIFF. The third vertex is also close, but the difference isn't
+// a multiple of 8, so it can't. None of the coordinates are shared between
+// vertices, so VTX_XY, VTX_XZ and VTX_YZ can't be used.
+static const int triangles[][3] = {
+    { 256, 512, 768 },
+    { 256 + 24, 512 - 40, 768 + 56 },
+    { 256 + 29, 512 - 37, 768 + 49 },
+
+    { -1024, 2048, -3072 },
+    { -1024 - 4096, 2048 + 4088, -3072 - 8 },
+    { -1024 - 4096 + 3, 2048 + 4088 + 1, -3072 - 8 - 1 },
+};
+
+#define NUM_VERTICES (int)(sizeof(triangles) / sizeof(triangles[0]))
+
+static void *record_list(void)
+{
+    ASSERT(NE_DisplayListBegin() == 1);
+
+    NE_PolyBegin(GL_TRIANGLES);
+    NE_PolyColor(NE_White);
+    for (int i = 0; i < NUM_VERTICES; i++)
+    {
+        NE_PolyVertexI(triangles[i][0], triangles[i][1], triangles[i][2]);
+    }
+    NE_PolyEnd();
+
+    void *list = NE_DisplayListEnd();
+    ASSERT(list != NULL);
+
+    return list;
+}
+
+static void test_record(void)
+{
+    void *list = record_list();
+
+    decoded_list_t decoded;
+    decode_list(list, &decoded);
+
+    // The second vertex of each triangle must use VTX_DIFF
+    ASSERT(decoded.commands[FIFO_VERTEX_DIFF] == 2);
+
+    ASSERT(decoded.num_vertices == NUM_VERTICES);
+    for (int i = 0; i < NUM_VERTICES; i++)
+    {
+        for (int j = 0; j < 3; j++)
+            ASSERT(decoded.vertices[i][j] == triangles[i][j]);
+    }
+
+    free(list);
+
+    printf("Record: OK\n");
+}
+
+static void test_merge(void)
+{
+    void *list = record_list();
+
+    NE_DisplayListInstance instance = {
+        list,
+        0, 0, 0,
+        0, 0, 0,
+        inttof32(1), inttof32(1), inttof32(1)
+    };
+
+    int32_t position[3];
+    int32_t scale;
+    void *merged = NE_DisplayListMerge(&instance, 1, position, &scale);
+    ASSERT(merged != NULL);
+
+    decoded_list_t decoded;
+    decode_list(merged, &decoded);
+
+    // The merged list is scaled by a power of two, so the vertices may be
+    // rounded to a multiple of the scale.
+    int32_t max_error = scale >> 12;
+
+    ASSERT(decoded.num_vertices == NUM_VERTICES);
+    for (int i = 0; i < NUM_VERTICES; i++)
+    {
+        for (int j = 0; j < 3; j++)
+        {
+            int32_t v = ((decoded.vertices[i][j] * scale) >> 12) + position[j];
+            ASSERT(abs(v - triangles[i][j]) <= max_error);
+        }
+    }
+
+    free(merged);
+    free(list);
+
+    printf("Merge: OK\n");
+}
+
+int main(void)
+{
+    // Nitro Engine isn't initialized because display lists are recorded and
+    // merged without using the GPU. Initialize the default console of libnds
+    // to print the results of the tests.
+    consoleDemoInit();
+
+    test_record();
+    test_merge();
+
+    printf("Done!");
+
+    while (1)
+        swiWaitForVBlank();
+
+    return 0;
+}
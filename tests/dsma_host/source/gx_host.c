@@ -0,0 +1,133 @@
+// SPDX-License-Identifier: CC0-1.0
+//
+// SPDX-FileContributor: Antonio Niño Díaz, 2022
+//
+// This file is part of Nitro Engine
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "dsma_gx.h"
+
+#include "gx_host.h"
+
+// Matrices are stored as 4x4 matrices in the same layout as the geometry
+// engine: the translation is in the last row.
+typedef struct {
+    int32_t m[4][4];
+} matrix4x4_t;
+
+static matrix4x4_t current;
+static matrix4x4_t stack[GX_HOST_STACK_SIZE];
+static uint32_t stack_level;
+
+static int32_t mult_values[12];
+static int mult_count;
+
+static gx_host_call_list_fn call_list_fn;
+
+static void matrix_identity(matrix4x4_t *mtx)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        for (int j = 0; j < 4; j++)
+            mtx->m[i][j] = (i == j) ? inttof32(1) : 0;
+    }
+}
+
+void gx_host_reset(void)
+{
+    matrix_identity(&current);
+    stack_level = 0;
+    mult_count = 0;
+}
+
+void gx_host_get_stack_matrix(uint32_t index, int32_t *m)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        for (int j = 0; j < 3; j++)
+            m[i * 3 + j] = stack[index].m[i][j];
+    }
+}
+
+void gx_host_set_call_list_callback(gx_host_call_list_fn fn)
+{
+    call_list_fn = fn;
+}
+
+// GX interface of DSMA
+// ====================
+
+uint32_t dsma_gx_stack_level(void)
+{
+    return stack_level;
+}
+
+void dsma_gx_push(void)
+{
+    if (stack_level >= GX_HOST_STACK_SIZE)
+    {
+        printf("Matrix stack overflow\n");
+        exit(1);
+    }
+
+    stack[stack_level++] = current;
+}
+
+void dsma_gx_pop(void)
+{
+    if (stack_level == 0)
+    {
+        printf("Matrix stack underflow\n");
+        exit(1);
+    }
+
+    current = stack[--stack_level];
+}
+
+void dsma_gx_restore(uint32_t index)
+{
+    current = stack[index];
+}
+
+void dsma_gx_store(uint32_t index)
+{
+    stack[index] = current;
+}
+
+void dsma_gx_mult4x3(int32_t value)
+{
+    mult_values[mult_count++] = value;
+    if (mult_count < 12)
+        return;
+
+    mult_count = 0;
+
+    // The new matrix is the received matrix multiplied by the current one
+    matrix4x4_t result;
+
+    for (int i = 0; i < 4; i++)
+    {
+        for (int j = 0; j < 4; j++)
+        {
+            int64_t sum = 0;
+
+            for (int k = 0; k < 3; k++)
+                sum += (int64_t)mult_values[i * 3 + k] * current.m[k][j];
+
+            if (i == 3)
+                sum += (int64_t)inttof32(1) * current.m[3][j];
+
+            result.m[i][j] = (int32_t)(sum >> 12);
+        }
+    }
+
+    current = result;
+}
+
+void dsma_gx_call_list(const void *list)
+{
+    if (call_list_fn != NULL)
+        call_list_fn(list);
+}
@@ -0,0 +1,30 @@
+// SPDX-License-Identifier: CC0-1.0
+//
+// SPDX-FileContributor: Antonio Niño Díaz, 2022
+//
+// This file is part of Nitro Engine
+
+#ifndef GX_HOST_H__
+#define GX_HOST_H__
+
+#include <stdint.h>
+
+// Software replacement of the matrix stack of the geometry engine, used to run
+// DSMA on the host. It implements the functions of the GX interface of DSMA.
+
+#define GX_HOST_STACK_SIZE 31
+
+// Called by dsma_gx_call_list() with the display list that has been sent.
+typedef void (*gx_host_call_list_fn)(const void *list);
+
+// Loads the identity matrix as current matrix and empties the stack.
+void gx_host_reset(void);
+
+// Gets the matrix stored at the specified position of the stack, in the same
+// order as it would be sent to MATRIX_MULT4x3.
+void gx_host_get_stack_matrix(uint32_t index, int32_t *m);
+
+// Sets the function called whenever a display list is sent.
+void gx_host_set_call_list_callback(gx_host_call_list_fn fn);
+
+#endif // GX_HOST_H__
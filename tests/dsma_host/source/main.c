@@ -0,0 +1,501 @@
+// SPDX-License-Identifier: CC0-1.0
+//
+// SPDX-FileContributor: Antonio Niño Díaz, 2022
+//
+// This file is part of Nitro Engine
+
+// This test builds DSMA for the host, with a software matrix stack instead of
+// the geometry engine. It checks the poses calculated by DSMA from animations
+// in all formats (regular, baked matrices and compressed) against the matrices
+// calculated with floating point values by md5_to_dsma, checks that blending
+// animation layers gives the same results as the other blending functions, and
+// checks that the matrices stored in the matrix stack by the drawing functions
+// match the calculated poses. Then, it measures how many joints per second can be
+// calculated when playing one animation and when blending two animations.
+//
+// The files are generated by the Makefile. Run it with "make run".
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "dsma.h"
+
+#include "gx_host.h"
+
+#define ASSERT(cond)                                \
+    do {                                            \
+        if (!(cond)) {                              \
+            printf("Line %d\n", __LINE__);          \
+            exit(1);                                \
+        }                                           \
+    } while (0)
+
+// Max error allowed against the floating point matrices (20.12 format).
+// Compressed animations lose some precision when removing keys and quantizing
+// values. Baked matrices are exact in the frames of the animation, but they are
+// interpolated without normalizing them, so the error between frames is much
+// bigger.
+#define MAX_GOLDEN_ERROR            16
+#define MAX_GOLDEN_ERROR_COMPRESSED 32
+#define MAX_GOLDEN_ERROR_BAKED      768
+
+// Max error allowed when an additive layer is applied on top of frame 0 of its
+// own animation, which must give the pose of the additive animation.
+#define MAX_ADDITIVE_ERROR          32
+
+#define MAX_JOINTS          32
+
+#define BENCHMARK_TIME_NS   (500 * 1000 * 1000LL)
+
+typedef struct {
+    uint32_t num_frames;
+    uint32_t num_joints;
+    uint32_t steps;
+    int32_t matrices[];
+} golden_t;
+
+static void *load_file(const char *folder, const char *name)
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", folder, name);
+
+    FILE *f = fopen(path, "rb");
+    if (f == NULL)
+    {
+        printf("Can't open %s\n", path);
+        exit(1);
+    }
+
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    void *data = malloc(size);
+    ASSERT(data != NULL);
+    ASSERT(fread(data, 1, size, f) == (size_t)size);
+
+    fclose(f);
+
+    return data;
+}
+
+static int32_t matrix_error(const int32_t *a, const int32_t *b)
+{
+    int32_t max = 0;
+
+    for (int i = 0; i < DSMA_POSE_MATRIX_SIZE; i++)
+    {
+        int32_t diff = abs(a[i] - b[i]);
+        if (diff > max)
+            max = diff;
+    }
+
+    return max;
+}
+
+// Compares the poses calculated by DSMA with the golden matrices. If
+// 'exact_frames' is true, only the frames of the animation are checked, not the
+// interpolated ones. Returns the max error found.
+static int32_t test_golden(const void *dsa, const golden_t *golden,
+                           bool exact_frames)
+{
+    int32_t pose[MAX_JOINTS * DSMA_POSE_MATRIX_SIZE];
+    int32_t max_error = 0;
+
+    ASSERT(DSMA_GetNumFrames(dsa) == golden->num_frames);
+    ASSERT(DSMA_GetNumJoints(dsa) == golden->num_joints);
+    ASSERT(golden->num_joints <= MAX_JOINTS);
+
+    const int32_t *ref = golden->matrices;
+
+    for (uint32_t frame = 0; frame < golden->num_frames; frame++)
+    {
+        for (uint32_t step = 0; step < golden->steps; step++)
+        {
+            uint32_t frame_interp = (frame << 12) +
+                                    (step << 12) / golden->steps;
+
+            ASSERT(DSMA_ComputePose(dsa, frame_interp, pose) == DSMA_SUCCESS);
+
+            if (exact_frames && (step != 0))
+            {
+                ref += golden->num_joints * DSMA_POSE_MATRIX_SIZE;
+                continue;
+            }
+
+            for (uint32_t i = 0; i < golden->num_joints; i++)
+            {
+                int32_t error = matrix_error(&pose[i * DSMA_POSE_MATRIX_SIZE],
+                                             ref);
+                if (error > max_error)
+                    max_error = error;
+
+                ref += DSMA_POSE_MATRIX_SIZE;
+            }
+        }
+    }
+
+    return max_error;
+}
+
+// Checks the poses calculated with DSMA_ComputePoseLayers(). Two layers that
+// aren't additive must give the same pose as DSMA_ComputePoseBlendAnimation().
+// An additive layer applied on top of frame 0 of its own animation must give
+// the golden matrices of that animation. Returns the max error of the
+// additive layer.
+static int32_t test_layers(const void *dsa_1, const void *dsa_2,
+                           const golden_t *golden_2)
+{
+    int32_t pose[MAX_JOINTS * DSMA_POSE_MATRIX_SIZE];
+    int32_t pose_ref[MAX_JOINTS * DSMA_POSE_MATRIX_SIZE];
+    int32_t max_error = 0;
+
+    uint32_t num_joints = golden_2->num_joints;
+
+    uint32_t num_frames = DSMA_GetNumFrames(dsa_1);
+    if (DSMA_GetNumFrames(dsa_2) < num_frames)
+        num_frames = DSMA_GetNumFrames(dsa_2);
+
+    for (uint32_t frame_interp = 0; (frame_interp >> 12) < num_frames;
+         frame_interp += inttof32(1) / 3)
+    {
+        for (uint32_t blend = 0; blend <= inttof32(1); blend += inttof32(1) / 4)
+        {
+            DSMA_Layer layers[2] = {
+                { dsa_1, frame_interp, inttof32(1) - blend, false },
+                { dsa_2, frame_interp, blend, false },
+            };
+
+            ASSERT(DSMA_ComputePoseLayers(pose, layers, 2) == DSMA_SUCCESS);
+            ASSERT(DSMA_ComputePoseBlendAnimation(pose_ref,
+                                                  dsa_1, frame_interp,
+                                                  dsa_2, frame_interp, blend)
+                   == DSMA_SUCCESS);
+
+            for (uint32_t i = 0; i < num_joints * DSMA_POSE_MATRIX_SIZE; i++)
+                ASSERT(pose[i] == pose_ref[i]);
+        }
+    }
+
+    // The golden matrices normalize the interpolated quaternions
+    DSMA_SetQuaternionNormalization(true);
+
+    const int32_t *ref = golden_2->matrices;
+
+    for (uint32_t frame = 0; frame < golden_2->num_frames; frame++)
+    {
+        for (uint32_t step = 0; step < golden_2->steps; step++)
+        {
+            uint32_t frame_interp = (frame << 12) +
+                                    (step << 12) / golden_2->steps;
+
+            DSMA_Layer layers[3] = {
+                { dsa_2, 0, inttof32(1), false },
+                { dsa_1, 0, 0, true },
+                { dsa_2, frame_interp, inttof32(1), true },
+            };
+
+            ASSERT(DSMA_ComputePoseLayers(pose, layers, 3) == DSMA_SUCCESS);
+
+            for (uint32_t i = 0; i < num_joints; i++)
+            {
+                int32_t error = matrix_error(&pose[i * DSMA_POSE_MATRIX_SIZE],
+                                             ref);
+                if (error > max_error)
+                    max_error = error;
+
+                ref += DSMA_POSE_MATRIX_SIZE;
+            }
+        }
+    }
+
+    DSMA_SetQuaternionNormalization(false);
+
+    return max_error;
+}
+
+// Information about the display lists sent while drawing a model
+static int32_t drawn_matrices[8][MAX_JOINTS * DSMA_POSE_MATRIX_SIZE];
+static uint32_t drawn_num_joints;
+static int num_calls;
+
+static void call_list_callback(const void *list)
+{
+    (void)list;
+
+    ASSERT(num_calls < 8);
+
+    // Save the matrices of the joints, which are at the end of the stack
+    uint32_t base_matrix = GX_HOST_STACK_SIZE - drawn_num_joints;
+
+    for (uint32_t i = 0; i < drawn_num_joints; i++)
+    {
+        int32_t *m = &drawn_matrices[num_calls][i * DSMA_POSE_MATRIX_SIZE];
+        gx_host_get_stack_matrix(base_matrix + i, m);
+    }
+
+    num_calls++;
+}
+
+// Checks that the matrices stored in the stack while drawing a regular DSM
+// file match the pose.
+static void check_drawn_pose(const int32_t *pose, uint32_t num_joints)
+{
+    ASSERT(num_calls == 1);
+
+    for (uint32_t i = 0; i < num_joints * DSMA_POSE_MATRIX_SIZE; i++)
+        ASSERT(drawn_matrices[0][i] == pose[i]);
+}
+
+// Checks that the matrices stored in the stack while drawing a DSM file split
+// in sub-meshes match the pose.
+static void check_drawn_pose_split(const uint32_t *dsm, const int32_t *pose)
+{
+    // Header: magic, number of sub-meshes, max joints per sub-mesh
+    ASSERT(num_calls == (int)dsm[1]);
+
+    const uint32_t *data = &dsm[3];
+
+    for (int s = 0; s < num_calls; s++)
+    {
+        uint32_t num_joints = *data++;
+
+        for (uint32_t i = 0; i < num_joints; i++)
+        {
+            const int32_t *m = &drawn_matrices[s][i * DSMA_POSE_MATRIX_SIZE];
+            const int32_t *ref = &pose[data[i] * DSMA_POSE_MATRIX_SIZE];
+            ASSERT(matrix_error(m, ref) == 0);
+        }
+
+        data += num_joints;
+        data += data[0] + 1;
+    }
+}
+
+static void draw_start(uint32_t num_joints)
+{
+    gx_host_reset();
+    drawn_num_joints = num_joints;
+    num_calls = 0;
+}
+
+static long long time_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Draws a model in a loop for some time and returns the number of joints that
+// have been calculated per second.
+static double benchmark(const void *dsm, const void *dsa_1, const void *dsa_2)
+{
+    uint32_t num_frames = DSMA_GetNumFrames(dsa_1);
+    if (dsa_2 != NULL && DSMA_GetNumFrames(dsa_2) < num_frames)
+        num_frames = DSMA_GetNumFrames(dsa_2);
+
+    uint32_t num_joints = DSMA_GetNumJoints(dsa_1);
+
+    gx_host_set_call_list_callback(NULL);
+
+    long long start = time_ns();
+    long long end;
+    long long draws = 0;
+    uint32_t frame_interp = 0;
+
+    do
+    {
+        for (int i = 0; i < 1000; i++)
+        {
+            gx_host_reset();
+
+            int ret;
+            if (dsa_2 == NULL)
+            {
+                ret = DSMA_DrawModel(dsm, dsa_1, frame_interp);
+            }
+            else
+            {
+                ret = DSMA_DrawModelBlendAnimation(dsm, dsa_1, frame_interp,
+                                                   dsa_2, frame_interp,
+                                                   inttof32(1) / 3);
+            }
+            ASSERT(ret == DSMA_SUCCESS);
+
+            frame_interp += inttof32(1) / 5;
+            if ((frame_interp >> 12) >= num_frames)
+                frame_interp = 0;
+        }
+
+        draws += 1000;
+        end = time_ns();
+    }
+    while (end - start < BENCHMARK_TIME_NS);
+
+    return (double)draws * num_joints * 1e9 / (end - start);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2)
+    {
+        printf("Usage: %s <folder with the assets>\n", argv[0]);
+        return 1;
+    }
+
+    const char *folder = argv[1];
+
+    const uint32_t *dsm = load_file(folder, "robot_dsm.bin");
+    const uint32_t *dsm_split = load_file(folder, "robot_split_dsm.bin");
+    const void *walk = load_file(folder, "robot_walk_dsa.bin");
+    const void *wave = load_file(folder, "robot_wave_dsa.bin");
+    const void *walk_baked = load_file(folder, "robot_baked_walk_dsa.bin");
+    const void *wave_baked = load_file(folder, "robot_baked_wave_dsa.bin");
+    const void *walk_compressed =
+            load_file(folder, "robot_compressed_walk_dsa.bin");
+    const void *wave_compressed =
+            load_file(folder, "robot_compressed_wave_dsa.bin");
+    const golden_t *walk_golden = load_file(folder, "robot_walk_golden.bin");
+    const golden_t *wave_golden = load_file(folder, "robot_wave_golden.bin");
+
+    uint32_t num_joints = DSMA_GetNumJoints(walk);
+    ASSERT(num_joints == DSMA_GetNumJoints(wave));
+    ASSERT(num_joints <= MAX_JOINTS);
+
+    // Poses against golden matrices
+    // -----------------------------
+
+    // The golden matrices normalize the interpolated quaternions
+    DSMA_SetQuaternionNormalization(true);
+
+    int32_t error_walk = test_golden(walk, walk_golden, false);
+    int32_t error_wave = test_golden(wave, wave_golden, false);
+    int32_t error_walk_compressed =
+            test_golden(walk_compressed, walk_golden, false);
+    int32_t error_wave_compressed =
+            test_golden(wave_compressed, wave_golden, false);
+    int32_t error_walk_baked = test_golden(walk_baked, walk_golden, true);
+    int32_t error_wave_baked = test_golden(wave_baked, wave_golden, true);
+    int32_t error_walk_baked_interp =
+            test_golden(walk_baked, walk_golden, false);
+    int32_t error_wave_baked_interp =
+            test_golden(wave_baked, wave_golden, false);
+
+    printf("Max error against golden matrices:\n");
+    printf("  Walk: %d (compressed %d, baked %d, baked interpolated %d)\n",
+           (int)error_walk, (int)error_walk_compressed, (int)error_walk_baked,
+           (int)error_walk_baked_interp);
+    printf("  Wave: %d (compressed %d, baked %d, baked interpolated %d)\n",
+           (int)error_wave, (int)error_wave_compressed, (int)error_wave_baked,
+           (int)error_wave_baked_interp);
+
+    ASSERT(error_walk <= MAX_GOLDEN_ERROR);
+    ASSERT(error_wave <= MAX_GOLDEN_ERROR);
+    ASSERT(error_walk_compressed <= MAX_GOLDEN_ERROR_COMPRESSED);
+    ASSERT(error_wave_compressed <= MAX_GOLDEN_ERROR_COMPRESSED);
+    ASSERT(error_walk_baked <= MAX_GOLDEN_ERROR);
+    ASSERT(error_wave_baked <= MAX_GOLDEN_ERROR);
+    ASSERT(error_walk_baked_interp <= MAX_GOLDEN_ERROR_BAKED);
+    ASSERT(error_wave_baked_interp <= MAX_GOLDEN_ERROR_BAKED);
+
+    // Layers against blended animations and golden matrices
+    // -----------------------------------------------------
+
+    int32_t error_additive = test_layers(walk, wave, wave_golden);
+    int32_t error_additive_compressed =
+            test_layers(walk_compressed, wave_compressed, wave_golden);
+
+    printf("Max error of additive layers: %d (compressed %d)\n",
+           (int)error_additive, (int)error_additive_compressed);
+
+    ASSERT(error_additive <= MAX_ADDITIVE_ERROR);
+    ASSERT(error_additive_compressed <= MAX_ADDITIVE_ERROR);
+
+    DSMA_SetQuaternionNormalization(false);
+
+    // Drawn matrices against poses
+    // ----------------------------
+
+    gx_host_set_call_list_callback(call_list_callback);
+
+    uint32_t num_frames = DSMA_GetNumFrames(walk);
+    if (DSMA_GetNumFrames(wave) < num_frames)
+        num_frames = DSMA_GetNumFrames(wave);
+
+    uint32_t split_joints = dsm_split[2];
+
+    for (uint32_t frame_interp = 0; (frame_interp >> 12) < num_frames;
+         frame_interp += inttof32(1) / 3)
+    {
+        int32_t pose[MAX_JOINTS * DSMA_POSE_MATRIX_SIZE];
+        int32_t pose_2[MAX_JOINTS * DSMA_POSE_MATRIX_SIZE];
+
+        // One animation
+
+        ASSERT(DSMA_ComputePose(walk, frame_interp, pose) == DSMA_SUCCESS);
+
+        draw_start(num_joints);
+        ASSERT(DSMA_DrawModel(dsm, walk, frame_interp) == DSMA_SUCCESS);
+        check_drawn_pose(pose, num_joints);
+
+        draw_start(num_joints);
+        ASSERT(DSMA_DrawModelPose(dsm, pose, num_joints) == DSMA_SUCCESS);
+        check_drawn_pose(pose, num_joints);
+
+        draw_start(split_joints);
+        ASSERT(DSMA_DrawModel(dsm_split, walk, frame_interp) == DSMA_SUCCESS);
+        check_drawn_pose_split(dsm_split, pose);
+
+        draw_start(split_joints);
+        ASSERT(DSMA_DrawModelPose(dsm_split, pose, num_joints) == DSMA_SUCCESS);
+        check_drawn_pose_split(dsm_split, pose);
+
+        // Two blended animations. Blending an animation with itself must
+        // return the same pose.
+
+        uint32_t blend = inttof32(1) / 4;
+
+        ASSERT(DSMA_ComputePoseBlendAnimation(pose_2, walk, frame_interp,
+                                              walk, frame_interp, blend)
+               == DSMA_SUCCESS);
+        for (uint32_t i = 0; i < num_joints; i++)
+        {
+            ASSERT(matrix_error(&pose[i * DSMA_POSE_MATRIX_SIZE],
+                                &pose_2[i * DSMA_POSE_MATRIX_SIZE]) <= 1);
+        }
+
+        ASSERT(DSMA_ComputePoseBlendAnimation(pose_2, walk, frame_interp,
+                                              wave, frame_interp, blend)
+               == DSMA_SUCCESS);
+
+        draw_start(num_joints);
+        ASSERT(DSMA_DrawModelBlendAnimation(dsm, walk, frame_interp,
+                                            wave, frame_interp, blend)
+               == DSMA_SUCCESS);
+        check_drawn_pose(pose_2, num_joints);
+
+        draw_start(split_joints);
+        ASSERT(DSMA_DrawModelBlendAnimation(dsm_split, walk, frame_interp,
+                                            wave, frame_interp, blend)
+               == DSMA_SUCCESS);
+        check_drawn_pose_split(dsm_split, pose_2);
+    }
+
+    printf("Drawn matrices match the poses\n");
+
+    // Benchmark
+    // ---------
+
+    double single = benchmark(dsm, walk, NULL);
+    double blended = benchmark(dsm, walk, wave);
+
+    printf("Joints per second:\n");
+    printf("  Single:  %.0f\n", single);
+    printf("  Blended: %.0f\n", blended);
+
+    printf("Test passed\n");
+
+    return 0;
+}
@@ -0,0 +1,196 @@
+// SPDX-License-Identifier: CC0-1.0
+//
+// SPDX-FileContributor: Antonio Niño Díaz, 2022
+//
+// This file is part of Nitro Engine
+
+// When models are drawn between two frames of an animation, the orientations of
+// the joints are interpolated linearly, and the resulting quaternions aren't
+// normalized unless it is requested. This test checks the accuracy of the
+// normalization done by DSMA and measures how much CPU time it needs compared
+// to not normalizing the quaternions and to normalizing them with the hardware
+// square root and divider.
+
+#include <math.h>
+#include <stdio.h>
+
+#include <nds.h>
+
+// From DSMA (part of Nitro Engine)
+void DSMA_QuaternionNormalize(int32_t *q);
+
+#define NUM_QUATERNIONS     256
+
+#define ASSERT(cond)                                \
+    if (!(cond)) {                                  \
+        printf("Line %d\n", __LINE__);              \
+        while (1);                                  \
+    }
+
+int my_rand(void)
+{
+    static unsigned long int next = 1;
+    next = next * 1103515245 + 12345;
+    return (unsigned int)(next / 65536) % 32768;
+}
+
+typedef enum {
+    METHOD_NONE,
+    METHOD_LUT,
+    METHOD_HARDWARE,
+    METHOD_NUM
+} method_t;
+
+static const char *method_name[METHOD_NUM] = {
+    "None", "LUT", "Hardware"
+};
+
+// Interpolated quaternions and the result of normalizing them as floats
+static int32_t quaternions[NUM_QUATERNIONS][4];
+static float reference[NUM_QUATERNIONS][4];
+
+static int32_t results[NUM_QUATERNIONS][4];
+
+// Generates a random normalized quaternion
+void random_quaternion(float *q)
+{
+    float len = 0;
+
+    while (len < 0.01)
+    {
+        len = 0;
+        for (int i = 0; i < 4; i++)
+        {
+            q[i] = (my_rand() - 16384) / 16384.0;
+            len += q[i] * q[i];
+        }
+    }
+
+    len = sqrtf(len);
+    for (int i = 0; i < 4; i++)
+        q[i] /= len;
+}
+
+// Generates quaternions by interpolating pairs of random quaternions, like DSMA
+// does when drawing a model between two frames.
+void generate_quaternions(void)
+{
+    for (int i = 0; i < NUM_QUATERNIONS; i++)
+    {
+        float q1[4], q2[4];
+        random_quaternion(q1);
+        random_quaternion(q2);
+
+        // Interpolate along the shortest path
+        float dot = 0;
+        for (int j = 0; j < 4; j++)
+            dot += q1[j] * q2[j];
+        if (dot < 0)
+        {
+            for (int j = 0; j < 4; j++)
+                q2[j] = -q2[j];
+        }
+
+        int32_t t = my_rand() & 0xFFF;
+        float len = 0;
+
+        for (int j = 0; j < 4; j++)
+        {
+            int32_t a = floattof32(q1[j]);
+            int32_t b = floattof32(q2[j]);
+            int32_t v = a + (((b - a) * t) >> 12);
+
+            quaternions[i][j] = v;
+            reference[i][j] = f32tofloat(v);
+            len += reference[i][j] * reference[i][j];
+        }
+
+        len = sqrtf(len);
+        for (int j = 0; j < 4; j++)
+            reference[i][j] /= len;
+    }
+}
+
+ARM_CODE void normalize_all(method_t method)
+{
+    for (int i = 0; i < NUM_QUATERNIONS; i++)
+    {
+        int32_t *q = results[i];
+
+        for (int j = 0; j < 4; j++)
+            q[j] = quaternions[i][j];
+
+        if (method == METHOD_LUT)
+        {
+            DSMA_QuaternionNormalize(q);
+        }
+        else if (method == METHOD_HARDWARE)
+        {
+            int32_t len2 = (q[0] * q[0] + q[1] * q[1] + q[2] * q[2]
+                         + q[3] * q[3]) >> 12;
+            int32_t len = sqrtf32(len2);
+            for (int j = 0; j < 4; j++)
+                q[j] = divf32(q[j], len);
+        }
+    }
+}
+
+// Returns the max error of any component of the results compared to the
+// reference, in 20.12 units.
+int32_t max_error(void)
+{
+    int32_t max = 0;
+
+    for (int i = 0; i < NUM_QUATERNIONS; i++)
+    {
+        for (int j = 0; j < 4; j++)
+        {
+            int32_t err = abs(results[i][j] - floattof32(reference[i][j]));
+            if (err > max)
+                max = err;
+        }
+    }
+
+    return max;
+}
+
+int main(void)
+{
+    // This test doesn't use the 3D engine. Initialize the default console of
+    // libnds to print the results of the tests.
+    consoleDemoInit();
+
+    generate_quaternions();
+
+    printf("Quaternions: %d\n\n", NUM_QUATERNIONS);
+    printf("Method    Error  Ticks/quat\n");
+
+    int32_t error[METHOD_NUM];
+
+    for (int m = 0; m < METHOD_NUM; m++)
+    {
+        cpuStartTiming(0);
+        normalize_all(m);
+        u32 ticks = cpuEndTiming();
+
+        error[m] = max_error();
+
+        printf("%-9s %5ld  %ld\n", method_name[m], error[m],
+               ticks / NUM_QUATERNIONS);
+    }
+
+    printf("\nError is in 1/4096 units\n");
+    printf("1 tick = 2 CPU cycles\n\n");
+
+    // The lookup table and the hardware must be just as accurate
+    ASSERT(error[METHOD_LUT] <= 3);
+    ASSERT(error[METHOD_HARDWARE] <= 3);
+    ASSERT(error[METHOD_LUT] < error[METHOD_NONE]);
+
+    printf("Done!");
+
+    while (1)
+        swiWaitForVBlank();
+
+    return 0;
+}
@@ -140,6 +140,9 @@ class DisplayList():
 
         self.display_list = []
 
+        # Statistics
+        self.num_mtx_restore = 0
+
     def add_command(self, command, *args):
         self.commands.append(command)
         if len(args) > 0:
@@ -185,6 +188,7 @@ class DisplayList():
 
     def mtx_restore(self, index):
         self.add_command(command_name_to_id("MTX_RESTORE"), index)
+        self.num_mtx_restore += 1
 
     def mtx_load_4x3(self, m):
         fixed_m = [float_to_f32(v) for v in m]
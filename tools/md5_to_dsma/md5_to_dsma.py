@@ -7,7 +7,7 @@
 import os
 
 from collections import namedtuple
-from math import sqrt
+from math import isqrt, sqrt
 
 from display_list import DisplayList, float_to_f32
 
@@ -550,9 +550,43 @@ def parse_md5anim(input_file):
 
     return frames
 
-def save_animation(frames, output_file, blender_fix):
+def get_joint_transform(joint, blender_fix):
+    """
+    Returns the position and orientation of a joint as they are stored in DSA
+    files.
+    """
+    this_pos = joint.pos
+    this_orient = joint.orient
+
+    if blender_fix:
+        # It is needed to rotate all bones because all bones have absolute
+        # transformations. Rotate orientation and position by -90 degrees on the
+        # X axis.
+        q_rot = Quaternion(0.7071068, -0.7071068, 0, 0)
+        this_orient = q_rot.mul(this_orient)
+        this_pos = Vector(this_pos.x, this_pos.z, -this_pos.y)
+
+    return this_pos, this_orient
+
+def write_u32_array(output_file, u32_array):
+    with open(output_file, "wb") as f:
+        for u32 in u32_array:
+            b = [u32 & 0xFF, \
+                (u32 >> 8) & 0xFF, \
+                (u32 >> 16) & 0xFF, \
+                (u32 >> 24) & 0xFF]
+            f.write(bytearray(b))
+
+def save_animation(frames, output_file, blender_fix, baked_matrices=False):
+    """
+    Saves a list of frames as a DSA file. Version 1 stores the position and
+    orientation (as a quaternion) of each joint. Version 2 stores the 4x3
+    matrix of each joint, in the order used by MTX_MULT_4x3, so that the NDS
+    doesn't need to convert quaternions into matrices. Version 2 files are
+    about 70% bigger.
+    """
 
-    version = 1
+    version = 2 if baked_matrices else 1
     num_frames = len(frames)
     num_bones = len(frames[0])
 
@@ -563,16 +597,15 @@ def save_animation(frames, output_file, blender_fix):
             raise MD5FormatError("Different number of bones across frames")
 
         for joint in joints:
-            this_pos = joint.pos
-            this_orient = joint.orient
-
-            if blender_fix:
-                # It is needed to rotate all bones because all bones have
-                # absolute transformations. Rotate orientation and position by
-                # -90 degrees on the X axis.
-                q_rot = Quaternion(0.7071068, -0.7071068, 0, 0)
-                this_orient = q_rot.mul(this_orient)
-                this_pos = Vector(this_pos.x, this_pos.z, -this_pos.y)
+            this_pos, this_orient = get_joint_transform(joint, blender_fix)
+
+            if baked_matrices:
+                m = joint_info_to_m4x3(this_orient.normalize(), this_pos)
+                # MTX_MULT_4x3 expects the matrix column by column
+                for col in range(4):
+                    for row in range(3):
+                        u32_array.append(float_to_f32(m[row][col]))
+                continue
 
             pos = [float_to_f32(this_pos.x), float_to_f32(this_pos.y),
                    float_to_f32(this_pos.z)]
@@ -582,17 +615,532 @@ def save_animation(frames, output_file, blender_fix):
             u32_array.extend(pos)
             u32_array.extend(orient)
 
-    with open(output_file, "wb") as f:
-        for u32 in u32_array:
-            b = [u32 & 0xFF, \
-                (u32 >> 8) & 0xFF, \
-                (u32 >> 16) & 0xFF, \
-                (u32 >> 24) & 0xFF]
-            f.write(bytearray(b))
+    write_u32_array(output_file, u32_array)
+
+def save_golden_poses(frames, output_file, blender_fix, steps):
+    """
+    Saves the matrices of all joints of an animation, calculated with floating
+    point values, so that they can be used as reference to test the NDS code.
+    Each frame is sampled 'steps' times, interpolating it with the next frame
+    (the last frame is interpolated with frame 0). The position is interpolated
+    linearly, and the orientation is interpolated linearly and normalized.
+
+    The file starts with the number of frames, the number of joints and the
+    number of steps. Then, for each frame, for each step, for each joint, the
+    matrix is stored in the same order as in DSA files with baked matrices.
+    """
+
+    num_frames = len(frames)
+    num_bones = len(frames[0])
+
+    u32_array = [num_frames, num_bones, steps]
+
+    transforms = [[get_joint_transform(joint, blender_fix) for joint in joints]
+                  for joints in frames]
+
+    for frame in range(num_frames):
+        next_frame = (frame + 1) % num_frames
+
+        for step in range(steps):
+            t = step / steps
+
+            for bone in range(num_bones):
+                pos_1, orient_1 = transforms[frame][bone]
+                pos_2, orient_2 = transforms[next_frame][bone]
+
+                pos = Vector(pos_1.x + (pos_2.x - pos_1.x) * t,
+                             pos_1.y + (pos_2.y - pos_1.y) * t,
+                             pos_1.z + (pos_2.z - pos_1.z) * t)
+                orient = Quaternion(orient_1.w + (orient_2.w - orient_1.w) * t,
+                                    orient_1.x + (orient_2.x - orient_1.x) * t,
+                                    orient_1.y + (orient_2.y - orient_1.y) * t,
+                                    orient_1.z + (orient_2.z - orient_1.z) * t)
+
+                m = joint_info_to_m4x3(orient.normalize(), pos)
+                for col in range(4):
+                    for row in range(3):
+                        u32_array.append(float_to_f32(m[row][col]))
+
+    write_u32_array(output_file, u32_array)
+
+class CompressedKey():
+    """
+    Key of a joint in a compressed DSA file. It stores the quantized values, and
+    it can decode them the same way as the NDS.
+    """
+    def __init__(self, frame, pos, orient, pos_shift):
+        self.frame = frame
+        self.inv_span = 0
+
+        # Positions are stored as 16-bit values shifted right by pos_shift
+        self.pos = []
+        for v in pos:
+            p = round(v * (1 << 12) / (1 << pos_shift))
+            self.pos.append(max(-32768, min(32767, p)))
+
+        # Orientations are stored with the "smallest three" method. The biggest
+        # component is dropped and forced to be positive.
+        q = orient.normalize()
+        q = [q.w, q.x, q.y, q.z]
+        self.index = max(range(4), key=lambda i: abs(q[i]))
+        if q[self.index] < 0:
+            q = [-v for v in q]
+        self.rot = []
+        for i in range(4):
+            if i == self.index:
+                continue
+            r = round(q[i] * 16384 * sqrt(2)) + 16384
+            self.rot.append(max(0, min(32767, r)))
+
+        self.pos_shift = pos_shift
+
+    def to_u16(self):
+        rot = list(self.rot)
+        rot[0] |= (self.index & 1) << 15
+        rot[1] |= (self.index >> 1) << 15
+        values = [self.frame, self.inv_span]
+        values.extend([p & 0xFFFF for p in self.pos])
+        values.extend(rot)
+        return values
+
+    def decode(self):
+        """
+        Returns the position and orientation in 20.12 fixed point format.
+        """
+        pos = [p << self.pos_shift for p in self.pos]
+
+        abc = [((r - 16384) * 181) >> 10 for r in self.rot]
+        d2 = (1 << 12) - ((abc[0] ** 2 + abc[1] ** 2 + abc[2] ** 2) >> 12)
+        d = isqrt(d2 << 12) if d2 > 0 else 0
+        abc.insert(self.index, d)
+
+        return pos, abc
+
+def lerp_f32(start, end, pos):
+    return start + (((end - start) * pos) >> 12)
+
+def sample_compressed_keys(k1, k2, t):
+    """
+    Interpolates between two keys the same way as the NDS. The interpolation
+    factor goes from 0 to 4096. It returns the position and orientation in
+    20.12 fixed point format.
+    """
+    pos_1, q_1 = k1.decode()
+    pos_2, q_2 = k2.decode()
+
+    # The missing component is always positive, so the quaternions of two
+    # consecutive keys may be in opposite hemispheres.
+    dot = sum(a * b for a, b in zip(q_1, q_2))
+    if dot < 0:
+        q_2 = [-v for v in q_2]
+
+    pos = [lerp_f32(a, b, t) for a, b in zip(pos_1, pos_2)]
+    orient = [lerp_f32(a, b, t) for a, b in zip(q_1, q_2)]
+    return pos, orient
+
+def joint_error(pos, orient, ref_pos, ref_orient):
+    """
+    Returns the error of a decoded position and orientation (in 20.12 format)
+    compared to the original values. The position error is in model units and
+    the orientation error is the biggest difference of a quaternion component.
+    """
+    pos_err = max(abs(p / (1 << 12) - r) for p, r in zip(pos, ref_pos))
+
+    q = ref_orient.normalize()
+    q = [q.w, q.x, q.y, q.z]
+    o = [v / (1 << 12) for v in orient]
+    # q and -q are the same orientation
+    orient_err = min(max(abs(a - b) for a, b in zip(o, q)),
+                     max(abs(a + b) for a, b in zip(o, q)))
+
+    return pos_err, orient_err
+
+def compress_track(track, pos_shift, tolerance):
+    """
+    Generates the list of keys of one joint. The first and last frames are
+    always kept. Frames in between are removed while interpolating the keys
+    around them keeps the error under the tolerance.
+    """
+    num_frames = len(track)
+
+    def make_key(frame):
+        pos, orient = track[frame]
+        return CompressedKey(frame, [pos.x, pos.y, pos.z], orient, pos_shift)
+
+    def segment_error(k1, k2):
+        inv_span = min(0xFFFF, 0x10000 // max(1, k2.frame - k1.frame))
+        max_pos_err = 0
+        max_orient_err = 0
+        for frame in range(k1.frame, k2.frame + 1):
+            t = (((frame - k1.frame) << 12) * inv_span) >> 16
+            pos, orient = sample_compressed_keys(k1, k2, t)
+            ref_pos, ref_orient = track[frame]
+            pos_err, orient_err = joint_error(pos, orient,
+                    [ref_pos.x, ref_pos.y, ref_pos.z], ref_orient)
+            max_pos_err = max(max_pos_err, pos_err)
+            max_orient_err = max(max_orient_err, orient_err)
+        return max_pos_err, max_orient_err
+
+    keys = [make_key(0)]
+    errors = (0, 0)
+
+    start = 0
+    while start < num_frames - 1:
+        end = start + 1
+        best = end
+        best_errors = segment_error(keys[-1], make_key(end))
+        end += 1
+
+        while end < num_frames:
+            errs = segment_error(keys[-1], make_key(end))
+            if errs[0] > tolerance or errs[1] > tolerance:
+                break
+            best = end
+            best_errors = errs
+            end += 1
+
+        keys.append(make_key(best))
+        errors = (max(errors[0], best_errors[0]),
+                  max(errors[1], best_errors[1]))
+        start = best
+
+    if num_frames == 1:
+        errors = segment_error(keys[0], keys[0])
+
+    # The NDS uses this value to avoid divisions when interpolating keys
+    for k1, k2 in zip(keys, keys[1:]):
+        k1.inv_span = min(0xFFFF, 0x10000 // (k2.frame - k1.frame))
+
+    return keys, errors
+
+def save_animation_compressed(frames, output_file, blender_fix, tolerance):
+    """
+    Saves a list of frames as a compressed DSA file (version 3). Positions are
+    quantized to 16 bits, orientations are stored with the "smallest three"
+    method, and frames that can be interpolated from the frames around them
+    with an error under the tolerance are removed from each joint.
+    """
+
+    num_frames = len(frames)
+    num_bones = len(frames[0])
+
+    if num_frames > 0xFFFF:
+        raise MD5FormatError("Too many frames for a compressed DSA file")
+
+    tracks = [[] for i in range(num_bones)]
+    max_pos = 0
+
+    for joints in frames:
+        if num_bones != len(joints):
+            raise MD5FormatError("Different number of bones across frames")
+
+        for i, joint in enumerate(joints):
+            this_pos, this_orient = get_joint_transform(joint, blender_fix)
+            tracks[i].append((this_pos, this_orient))
+            max_pos = max(max_pos, abs(this_pos.x), abs(this_pos.y),
+                          abs(this_pos.z))
+
+    # Find the smallest shift that lets all positions fit in 16 bits
+    pos_shift = 0
+    while (max_pos * (1 << 12)) / (1 << pos_shift) > 32767:
+        pos_shift += 1
+
+    u32_array = [3, num_frames, num_bones, pos_shift]
+    u16_keys = []
+    max_errors = (0, 0)
+
+    for track in tracks:
+        keys, errors = compress_track(track, pos_shift, tolerance)
+        u32_array.extend([len(u16_keys) // 8, len(keys)])
+        for key in keys:
+            u16_keys.extend(key.to_u16())
+        max_errors = (max(max_errors[0], errors[0]),
+                      max(max_errors[1], errors[1]))
+
+    for i in range(0, len(u16_keys), 2):
+        u32_array.append(u16_keys[i] | (u16_keys[i + 1] << 16))
+
+    write_u32_array(output_file, u32_array)
+
+    num_keys = len(u16_keys) // 8
+    size = len(u32_array) * 4
+    size_uncompressed = (3 + num_frames * num_bones * 7) * 4
+
+    print(f"  Keys:        {num_keys} / {num_frames * num_bones}")
+    print(f"  Size:        {size} / {size_uncompressed} bytes "
+          f"({size * 100 / size_uncompressed:.1f}% of version 1)")
+    print(f"  Max error:   position {max_errors[0]:.6f}, "
+          f"orientation {max_errors[1]:.6f}")
+
+# Magic number of DSM files split in sub-meshes ("DSMP")
+DSM_PARTITIONED_MAGIC = 0x504D5344
+
+def generate_display_list(triangles, joints, joint_matrix, texture_size,
+                          draw_normal_polygons):
+    """
+    Generates the display list of a list of triangles. Each triangle is a
+    tuple (mesh, tri, normal). The matrix stack index of each joint is
+    provided in the dictionary joint_matrix.
+    """
+    dl = DisplayList()
+    dl.switch_vtxs("triangles")
+
+    last_joint_index = None
+
+    for mesh, tri, norm in triangles:
+        verts = [mesh.verts[i] for i in tri]
+        weights = [mesh.weights[v.startWeight] for v in verts]
+
+        finals = []
+
+        for vert, weight in zip(verts, weights):
+
+            # Texture
+            # -------
+
+            st = vert.st
+
+            u = st[0] * texture_size[0]
+            v = st[1] * texture_size[1]
+            dl.texcoord(u, v)
+
+            # Vertex and normal
+            # -----------------
+
+            # Load joint matrix. When drawing normal polygons it has to be
+            # loaded every time, because drawing the normal restores the
+            # original matrix.
+
+            joint_index = weight.joint
+            if draw_normal_polygons or joint_index != last_joint_index:
+                dl.mtx_restore(joint_matrix[joint_index])
+                last_joint_index = joint_index
+
+            # Calculate normal in joint space
+
+            joint = joints[joint_index]
+
+            q = joint.orient
+            qt = q.complement()
+            n = norm.to_q()
+
+            # Transform by the inverted quaternion
+            n = qt.mul(n).mul(q).to_v3()
+            if n.length() > 0:
+                n = n.normalize()
+            dl.normal(n.x, n.y, n.z)
+
+            # The vertex is already in joint space
+
+            dl.vtx(weight.pos.x, weight.pos.y, weight.pos.z)
+
+            if draw_normal_polygons:
+                # Calculate actual location of the vertex so that the
+                # vertices of the triangle can be averaged as origin of the
+                # normal polygon.
+                q = joint.orient
+                qt = q.complement()
+                v = weight.pos.to_q()
+
+                delta = q.mul(v).mul(qt).to_v3()
+
+                final = joint.pos.add(delta)
+                finals.append(final)
+
+        if draw_normal_polygons:
+
+            # Don't use any of the joint transformation matrices
+            dl.mtx_restore(1)
+
+            vert_avg = Vector(
+                (finals[0].x + finals[1].x + finals[2].x) / 3,
+                (finals[0].y + finals[1].y + finals[2].y) / 3,
+                (finals[0].z + finals[1].z + finals[2].z) / 3
+            )
+
+            vert_avg_end = vert_avg.add(norm)
+
+            dl.texcoord(0, 0)
+
+            dl.color(1, 0, 0)
+            dl.vtx(vert_avg.x + 0.1, vert_avg.y, vert_avg.z)
+            dl.vtx(vert_avg.x, vert_avg.y, vert_avg.z)
+            dl.color(0, 1, 0)
+            dl.vtx(vert_avg_end.x, vert_avg_end.y, vert_avg_end.z)
+
+            dl.color(1, 0, 0)
+            dl.vtx(vert_avg.x, vert_avg.y, vert_avg.z)
+            dl.vtx(vert_avg.x, vert_avg.y + 0.1, vert_avg.z)
+            dl.color(0, 1, 0)
+            dl.vtx(vert_avg_end.x, vert_avg_end.y, vert_avg_end.z)
+
+            dl.color(1, 0, 0)
+            dl.vtx(vert_avg.x, vert_avg.y, vert_avg.z)
+            dl.vtx(vert_avg.x, vert_avg.y, vert_avg.z + 0.1)
+            dl.color(0, 1, 0)
+            dl.vtx(vert_avg_end.x, vert_avg_end.y, vert_avg_end.z)
+
+    dl.end_vtxs()
+    dl.finalize()
+
+    return dl
+
+def sort_triangles_by_joint(triangles):
+    """
+    Reorders a list of triangles so that vertices that use the same joint are
+    drawn one after the other, which reduces the number of MTX_RESTORE commands
+    in the display list. The vertices of each triangle are rotated so that the
+    first one uses the joint of the last vertex of the previous triangle when
+    possible. Rotating them doesn't change the winding order of the triangle.
+    All triangles belong to the same polygon batch, so they can be reordered
+    freely.
+    """
+    def vertex_joints(triangle):
+        mesh, tri, norm = triangle
+        return [mesh.weights[mesh.verts[i].startWeight].joint for i in tri]
+
+    def rotate(triangle, r):
+        mesh, tri, norm = triangle
+        return (mesh, tuple(tri[r:]) + tuple(tri[:r]), norm)
+
+    def joint_changes(j):
+        return (j[0] != j[1]) + (j[1] != j[2])
+
+    remaining = [ (t, vertex_joints(t)) for t in triangles ]
+    pending = set(range(len(remaining)))
+
+    # Triangles that use each joint
+    by_joint = {}
+    for index, (t, j) in enumerate(remaining):
+        for joint in set(j):
+            by_joint.setdefault(joint, []).append(index)
+
+    result = []
+    last_joint = None
+
+    while len(pending) > 0:
+        best = None
+
+        # Look for the triangle that can start with the current joint and has
+        # the fewest joint changes inside it.
+        for index in by_joint.get(last_joint, []):
+            if index not in pending:
+                continue
+            j = remaining[index][1]
+            for r in range(3):
+                rj = j[r:] + j[:r]
+                if rj[0] != last_joint:
+                    continue
+                cost = joint_changes(rj)
+                if best is None or cost < best[0]:
+                    best = (cost, index, r)
+            if best[0] == 0:
+                break
+
+        if best is None:
+            # Nothing left uses the current joint. Start a new group with the
+            # triangle that has the fewest joint changes.
+            for index in sorted(pending):
+                j = remaining[index][1]
+                for r in range(3):
+                    rj = j[r:] + j[:r]
+                    cost = joint_changes(rj)
+                    if best is None or cost < best[0]:
+                        best = (cost, index, r)
+                if best[0] == 0:
+                    break
+
+        cost, index, r = best
+        pending.remove(index)
+
+        t, j = remaining[index]
+        result.append(rotate(t, r))
+        last_joint = (j[r:] + j[:r])[2]
+
+        # Drop triangles that have already been used from the list of the
+        # joint that is going to be checked next.
+        if last_joint in by_joint:
+            by_joint[last_joint] = [i for i in by_joint[last_joint]
+                                    if i in pending]
+
+    return result
+
+def generate_sorted_display_list(triangles, joints, joint_matrix, texture_size,
+                                 draw_normal_polygons):
+    """
+    Generates the display list of a list of triangles sorted by joint and
+    prints how many MTX_RESTORE commands have been saved.
+    """
+    dl = generate_display_list(triangles, joints, joint_matrix, texture_size,
+                               draw_normal_polygons)
+
+    # When drawing normal polygons the matrix is restored for every vertex, so
+    # the order doesn't matter.
+    if draw_normal_polygons:
+        return dl
+
+    dl_sorted = generate_display_list(sort_triangles_by_joint(triangles),
+                                      joints, joint_matrix, texture_size,
+                                      draw_normal_polygons)
+
+    print(f"  MTX_RESTORE commands: {dl.num_mtx_restore} -> "
+          f"{dl_sorted.num_mtx_restore}")
+    print(f"  Display list size:    {len(dl.display_list) * 4} -> "
+          f"{len(dl_sorted.display_list) * 4} bytes")
+
+    # Reordering vertices may change the vertex commands that can be used, so
+    # it is possible (but unlikely) for the sorted list to be bigger.
+    if len(dl_sorted.display_list) > len(dl.display_list):
+        print("  Keeping original order")
+        return dl
+
+    return dl_sorted
+
+def triangle_joints(triangle):
+    mesh, tri, norm = triangle
+    return set(mesh.weights[mesh.verts[i].startWeight].joint for i in tri)
+
+def partition_triangles(triangles, max_joints):
+    """
+    Splits a list of triangles in groups that use at most max_joints joints
+    each. It returns a list of tuples (joints, triangles), where joints is the
+    sorted list of joints used by the group.
+    """
+    # Sort triangles by the joints they use so that triangles that use the
+    # same joints end up next to each other. Every triangle is added to the
+    # group that needs the fewest new joints to fit it, or to a new group if
+    # it doesn't fit in any of them.
+    tris = sorted(triangles, key=lambda t: sorted(triangle_joints(t)))
+
+    groups = []
+    for tri in tris:
+        tri_joints = triangle_joints(tri)
+
+        best = None
+        best_new = None
+        for group in groups:
+            new_joints = len(tri_joints - group[0])
+            if len(group[0]) + new_joints > max_joints:
+                continue
+            if best is None or new_joints < best_new:
+                best = group
+                best_new = new_joints
+                if new_joints == 0:
+                    break
+
+        if best is None:
+            best = (set(), [])
+            groups.append(best)
+
+        best[0].update(tri_joints)
+        best[1].append(tri)
+
+    return [(sorted(group_joints), group_tris)
+            for group_joints, group_tris in groups]
 
 def convert_md5mesh(model_file, name, output_folder, texture_size,
                     draw_normal_polygons, extension, blender_fix,
-                    export_base_pose):
+                    export_base_pose, max_joints=None):
 
     print(f"Converting model: {model_file}")
 
@@ -615,12 +1163,8 @@ def convert_md5mesh(model_file, name, output_folder, texture_size,
 
     print("Converting meshes...")
 
-    # Display list shared between all meshes
-    dl = DisplayList()
-    dl.switch_vtxs("triangles")
-
-    base_matrix = 30 - len(joints) + 1
-    last_joint_index = None
+    # Triangles of all meshes, with their normals
+    triangles = []
 
     for mesh in meshes:
         print(f"  Vertices: {mesh.numverts}")
@@ -629,7 +1173,6 @@ def convert_md5mesh(model_file, name, output_folder, texture_size,
 
         print("  Generating per-triangle normals...")
 
-        tri_normal = []
         for tri in mesh.tris:
             verts = [mesh.verts[i] for i in tri]
             weights = [mesh.weights[v.startWeight] for v in verts]
@@ -648,113 +1191,65 @@ def convert_md5mesh(model_file, name, output_folder, texture_size,
 
             if n.length() > 0:
                 n = n.normalize()
-                tri_normal.append(n)
+                triangles.append((mesh, tri, n))
             else:
-                tri_normal.append(Vector(0, 0, 0))
+                triangles.append((mesh, tri, Vector(0, 0, 0)))
 
-        print("  Generating display list...")
+    output_file = os.path.join(output_folder, f"{name}{extension}")
 
-        for tri, norm in zip(mesh.tris, tri_normal):
-            verts = [mesh.verts[i] for i in tri]
-            weights = [mesh.weights[v.startWeight] for v in verts]
+    if max_joints is None or len(joints) <= max_joints:
+        if len(joints) > 30:
+            print(f"WARNING: The model has {len(joints)} joints, but only 30 "
+                  "fit in the matrix stack. Use --max-joints to split it.")
 
-            finals = []
+        print("Generating display list...")
 
-            for vert, weight in zip(verts, weights):
+        # The joint matrices are stored at the end of the matrix stack
+        base_matrix = 30 - len(joints) + 1
+        joint_matrix = { i: base_matrix + i for i in range(len(joints)) }
 
-                # Texture
-                # -------
+        dl = generate_sorted_display_list(triangles, joints, joint_matrix,
+                                          texture_size, draw_normal_polygons)
+        dl.save_to_file(output_file)
+        return
 
-                st = vert.st
+    print(f"Splitting model in sub-meshes of up to {max_joints} joints...")
 
-                u = st[0] * texture_size[0]
-                v = st[1] * texture_size[1]
-                dl.texcoord(u, v)
+    groups = partition_triangles(triangles, max_joints)
 
-                # Vertex and normal
-                # -----------------
+    # All sub-meshes use the same area of the matrix stack, which needs to be
+    # big enough for the sub-mesh with the most joints.
+    used_joints = max(len(group_joints) for group_joints, _ in groups)
+    base_matrix = 30 - used_joints + 1
 
-                # Load joint matrix. When drawing normal polygons it has to be
-                # loaded every time, because drawing the normal restores the
-                # original matrix.
+    data = [DSM_PARTITIONED_MAGIC, len(groups), used_joints]
+    total_joints = 0
 
-                joint_index = weight.joint
-                if draw_normal_polygons or joint_index != last_joint_index:
-                    dl.mtx_restore(base_matrix + joint_index)
-                    last_joint_index = joint_index
+    for i, (group_joints, group_tris) in enumerate(groups):
+        print(f"  Sub-mesh {i}: {len(group_tris)} tris, "
+              f"{len(group_joints)} joints")
 
-                # Calculate normal in joint space
+        joint_matrix = { joint: base_matrix + index
+                         for index, joint in enumerate(group_joints) }
 
-                joint = joints[joint_index]
+        dl = generate_sorted_display_list(group_tris, joints, joint_matrix,
+                                          texture_size, draw_normal_polygons)
 
-                q = joint.orient
-                qt = q.complement()
-                n = norm.to_q()
-
-                # Transform by the inverted quaternion
-                n = qt.mul(n).mul(q).to_v3()
-                if n.length() > 0:
-                    n = n.normalize()
-                dl.normal(n.x, n.y, n.z)
+        data.append(len(group_joints))
+        data.extend(group_joints)
+        data.extend(dl.display_list)
 
-                # The vertex is already in joint space
+        total_joints += len(group_joints)
 
-                dl.vtx(weight.pos.x, weight.pos.y, weight.pos.z)
+    print(f"  {len(groups)} sub-meshes, {total_joints} joint matrices per "
+          f"draw ({len(joints)} joints in the skeleton)")
 
-                if draw_normal_polygons:
-                    # Calculate actual location of the vertex so that the
-                    # vertices of the triangle can be averaged as origin of the
-                    # normal polygon.
-                    q = joint.orient
-                    qt = q.complement()
-                    v = weight.pos.to_q()
-
-                    delta = q.mul(v).mul(qt).to_v3()
-
-                    final = joint.pos.add(delta)
-                    finals.append(final)
-
-            if draw_normal_polygons:
-
-                # Don't use any of the joint transformation matrices
-                dl.mtx_restore(1)
-
-                vert_avg = Vector(
-                    (finals[0].x + finals[1].x + finals[2].x) / 3,
-                    (finals[0].y + finals[1].y + finals[2].y) / 3,
-                    (finals[0].z + finals[1].z + finals[2].z) / 3
-                )
-
-                vert_avg_end = vert_avg.add(norm)
-
-                dl.texcoord(0, 0)
-
-                dl.color(1, 0, 0)
-                dl.vtx(vert_avg.x + 0.1, vert_avg.y, vert_avg.z)
-                dl.vtx(vert_avg.x, vert_avg.y, vert_avg.z)
-                dl.color(0, 1, 0)
-                dl.vtx(vert_avg_end.x, vert_avg_end.y, vert_avg_end.z)
-
-                dl.color(1, 0, 0)
-                dl.vtx(vert_avg.x, vert_avg.y, vert_avg.z)
-                dl.vtx(vert_avg.x, vert_avg.y + 0.1, vert_avg.z)
-                dl.color(0, 1, 0)
-                dl.vtx(vert_avg_end.x, vert_avg_end.y, vert_avg_end.z)
-
-                dl.color(1, 0, 0)
-                dl.vtx(vert_avg.x, vert_avg.y, vert_avg.z)
-                dl.vtx(vert_avg.x, vert_avg.y, vert_avg.z + 0.1)
-                dl.color(0, 1, 0)
-                dl.vtx(vert_avg_end.x, vert_avg_end.y, vert_avg_end.z)
-
-    dl.end_vtxs()
-    dl.finalize()
-
-    dl.save_to_file(os.path.join(output_folder, f"{name}{extension}"))
+    write_u32_array(output_file, data)
 
 
 def convert_md5anim(name, output_folder, anim_file, skip_frames, extension,
-                    blender_fix):
+                    blender_fix, baked_matrices=False, compress=False,
+                    tolerance=0.0, golden_steps=0):
 
     print(f"Converting animation: {anim_file}")
 
@@ -765,8 +1260,16 @@ def convert_md5anim(name, output_folder, anim_file, skip_frames, extension,
     anim_name = file_basename.replace(".", "_").lower()
 
     frames = frames[::skip_frames+1]
-    save_animation(frames, os.path.join(output_folder,
-                   f"{name}_{anim_name}{extension}"), blender_fix)
+    output_file = os.path.join(output_folder, f"{name}_{anim_name}{extension}")
+    if compress:
+        save_animation_compressed(frames, output_file, blender_fix, tolerance)
+    else:
+        save_animation(frames, output_file, blender_fix, baked_matrices)
+
+    if golden_steps > 0:
+        golden_file = os.path.join(output_folder,
+                                   f"{name}_{anim_name}_golden.bin")
+        save_golden_poses(frames, golden_file, blender_fix, golden_steps)
 
 
 if __name__ == "__main__":
@@ -775,7 +1278,7 @@ if __name__ == "__main__":
     import sys
     import traceback
 
-    print("md5_to_dsma v0.1.0")
+    print("md5_to_dsma v0.3.0")
     print("Copyright (c) 2022 Antonio Niño Díaz <antonio_nd@outlook.com>")
     print("All rights reserved")
     print("")
@@ -810,6 +1313,30 @@ if __name__ == "__main__":
     parser.add_argument("--skip-frames", required=False,
                         default=0, type=int,
                         help="number of frames to skip in an animation (0 = export all, 1 = export half, 2 = export 33%, etc)")
+    parser.add_argument("--baked-matrices", required=False, type=str,
+                        default=None, nargs="*",
+                        help="store joint matrices instead of quaternions in "
+                             "the DSA files (bigger files, faster to draw). If "
+                             "md5anim files are listed, only those are affected")
+    parser.add_argument("--compress", required=False,
+                        action='store_true',
+                        help="store animations as compressed DSA files "
+                             "(quantized values and reduced number of keys)")
+    parser.add_argument("--tolerance", required=False,
+                        default=0.001, type=float,
+                        help="max error allowed when removing keys of "
+                             "compressed animations (default: 0.001)")
+    parser.add_argument("--golden", required=False,
+                        default=0, type=int, metavar="STEPS",
+                        help="also export the joint matrices of each animation "
+                             "calculated with floating point values, sampled "
+                             "STEPS times per frame, to test DSMA")
+    parser.add_argument("--max-joints", required=False,
+                        default=None, type=int,
+                        help="split the model in sub-meshes that use at most "
+                             "this number of joints each (3 to 30), so that "
+                             "models with more joints than the ones that fit in "
+                             "the matrix stack can be drawn")
     parser.add_argument("--draw-normal-polygons", required=False,
                         action='store_true',
                         help="draw polygons with the shape of normals for debugging")
@@ -829,6 +1356,15 @@ if __name__ == "__main__":
             print(f"Invalid texture height. Valid values: {VALID_TEXTURE_SIZES}")
             sys.exit(1)
 
+    if args.max_joints is not None:
+        if args.max_joints < 3 or args.max_joints > 30:
+            print("The value of --max-joints must be between 3 and 30")
+            sys.exit(1)
+
+    if args.compress and args.baked_matrices is not None:
+        print("--compress and --baked-matrices can't be used at the same time")
+        sys.exit(1)
+
     # Create output directory if it doesn't exist
     os.makedirs(args.output, exist_ok=True)
 
@@ -840,11 +1376,19 @@ if __name__ == "__main__":
         if args.model is not None:
             convert_md5mesh(args.model, args.name, args.output, args.texture,
                             args.draw_normal_polygons, extension_mesh,
-                            args.blender_fix, args.export_base_pose)
+                            args.blender_fix, args.export_base_pose,
+                            args.max_joints)
 
         for anim_file in args.anims:
+            if args.baked_matrices is None:
+                baked = False
+            elif len(args.baked_matrices) == 0:
+                baked = True
+            else:
+                baked = anim_file in args.baked_matrices
             convert_md5anim(args.name, args.output, anim_file, args.skip_frames,
-                            extension_anim, args.blender_fix)
+                            extension_anim, args.blender_fix, baked,
+                            args.compress, args.tolerance, args.golden)
 
     except BaseException as e:
         print("ERROR: " + str(e))
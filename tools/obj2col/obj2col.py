@@ -0,0 +1,291 @@
+#!/usr/bin/env python3
+
+# SPDX-License-Identifier: MIT
+#
+# Copyright (c) 2023 Antonio Niño Díaz <antonio_nd@outlook.com>
+
+import math
+import struct
+
+class OBJFormatError(Exception):
+    pass
+
+# Format of the collision mesh files. All values are little endian 32-bit
+# integers, and coordinates are in 20.12 fixed point format.
+#
+# Header:
+#   magic ("NCOL"), version, number of triangles, number of nodes
+#
+# Nodes of the bounding volume hierarchy, in depth-first order:
+#   min x, min y, min z, max x, max y, max z, first, count
+#
+#   If count is 0, the node has two children. The first one is the next node,
+#   and the second one is the node with index "first". If count isn't 0, the
+#   node is a leaf that contains "count" triangles starting at index "first".
+#
+# Triangles:
+#   v0 x, v0 y, v0 z, v1 x, v1 y, v1 z, v2 x, v2 y, v2 z, normal x, y, z
+#
+#   Vertices are in counter-clockwise order when looking at the front face,
+#   which is the one that the normal points to.
+
+COL_MAGIC = 0x4C4F434E # "NCOL"
+COL_VERSION = 1
+
+# This must match NE_PHYSICS_MESH_MAX_DEPTH
+MAX_DEPTH = 32
+
+def float_to_f32(val):
+    res = int(round(val * (1 << 12)))
+    if res < -0x80000000:
+        raise OverflowError(f"{val} too small for f32: {res:#08x}")
+    if res > 0x7FFFFFFF:
+        raise OverflowError(f"{val} too big for f32: {res:#08x}")
+    return res
+
+def load_obj(input_file):
+
+    vertices = []
+    faces = []
+
+    with open(input_file, 'r') as obj_file:
+        for line in obj_file:
+            # Remove comments
+            line = line.split('#')[0]
+
+            # Parse line
+            tokens = line.split()
+
+            # Empty line, skip it
+            if len(tokens) < 2:
+                continue
+
+            cmd = tokens[0]
+            tokens = tokens[1:]
+
+            if cmd == 'v': # Vertex
+                if len(tokens) not in [3, 6]:
+                    raise OBJFormatError(f"Unsupported vertex command: {tokens}")
+                v = [float(tokens[i]) for i in range(3)]
+                vertices.append(v)
+
+            elif cmd == 'f': # Face
+                if len(tokens) < 3:
+                    raise OBJFormatError(f"Invalid face: {tokens}")
+
+                face = []
+                for vertex in tokens:
+                    vertex_index = int(vertex.split('/')[0])
+                    if vertex_index < 0:
+                        raise OBJFormatError(f"Unsupported negative indices")
+                    face.append(vertex_index - 1)
+                faces.append(face)
+
+            elif cmd in ['vt', 'vn', 'usemtl', 'mtllib', 'o', 'g', 's']:
+                # Not needed for collisions
+                pass
+
+            else:
+                print(f"Ignored unsupported command: {cmd} {tokens}")
+
+    print("Vertices:  " + str(len(vertices)))
+    print("Faces:     " + str(len(faces)))
+    print("")
+
+    return (vertices, faces)
+
+def sub(a, b):
+    return [a[i] - b[i] for i in range(3)]
+
+def cross(a, b):
+    return [a[1] * b[2] - a[2] * b[1],
+            a[2] * b[0] - a[0] * b[2],
+            a[0] * b[1] - a[1] * b[0]]
+
+class Triangle():
+    def __init__(self, v0, v1, v2):
+        self.v = [v0, v1, v2]
+
+        n = cross(sub(v1, v0), sub(v2, v0))
+        length = math.sqrt(sum(n[i] * n[i] for i in range(3)))
+        self.normal = [n[i] / length for i in range(3)] if length > 0 else None
+
+        self.min = [min(v[i] for v in self.v) for i in range(3)]
+        self.max = [max(v[i] for v in self.v) for i in range(3)]
+        self.center = [(self.min[i] + self.max[i]) / 2 for i in range(3)]
+
+def build_triangles(obj, model_scale, model_translation):
+    """
+    Converts all faces into triangles. Polygons with more than 3 vertices are
+    split in a fan. Degenerate triangles are dropped, as they can't be
+    collided with.
+    """
+    vertices, faces = obj
+
+    triangles = []
+    degenerate = 0
+
+    def transform(index):
+        v = vertices[index][0:3]
+        return [(v[i] + model_translation[i]) * model_scale for i in range(3)]
+
+    for face in faces:
+        v = [transform(i) for i in face]
+        for i in range(1, len(v) - 1):
+            tri = Triangle(v[0], v[i], v[i + 1])
+            if tri.normal is None:
+                degenerate += 1
+                continue
+            triangles.append(tri)
+
+    print("Triangles: " + str(len(triangles)))
+    if degenerate > 0:
+        print(f"Dropped {degenerate} degenerate triangles")
+
+    return triangles
+
+class Node():
+    def __init__(self, triangles):
+        self.min = [min(t.min[i] for t in triangles) for i in range(3)]
+        self.max = [max(t.max[i] for t in triangles) for i in range(3)]
+        self.triangles = None
+        self.children = None
+
+def build_bvh(triangles, leaf_size, depth=1):
+    """
+    Builds the tree by splitting the triangles in two halves along the longest
+    axis of the box that contains their centers.
+    """
+    if depth > MAX_DEPTH:
+        raise OverflowError(f"BVH deeper than {MAX_DEPTH} levels")
+
+    node = Node(triangles)
+
+    if len(triangles) <= leaf_size:
+        node.triangles = triangles
+        return node
+
+    cmin = [min(t.center[i] for t in triangles) for i in range(3)]
+    cmax = [max(t.center[i] for t in triangles) for i in range(3)]
+    extent = [cmax[i] - cmin[i] for i in range(3)]
+    axis = extent.index(max(extent))
+
+    triangles = sorted(triangles, key=lambda t: t.center[axis])
+    half = len(triangles) // 2
+
+    node.children = (build_bvh(triangles[:half], leaf_size, depth + 1),
+                     build_bvh(triangles[half:], leaf_size, depth + 1))
+    return node
+
+def flatten_bvh(root):
+    """
+    Returns the list of nodes in depth-first order and the list of triangles
+    in the order in which they are referenced by the leaves.
+    """
+    nodes = []
+    triangles = []
+    max_depth = 0
+
+    def visit(node, depth):
+        nonlocal max_depth
+        max_depth = max(max_depth, depth)
+
+        entry = [node.min, node.max, 0, 0]
+        nodes.append(entry)
+
+        if node.triangles is not None:
+            entry[2] = len(triangles)
+            entry[3] = len(node.triangles)
+            triangles.extend(node.triangles)
+        else:
+            visit(node.children[0], depth + 1)
+            entry[2] = len(nodes)
+            visit(node.children[1], depth + 1)
+
+    visit(root, 1)
+
+    print("Nodes:     " + str(len(nodes)))
+    print("Depth:     " + str(max_depth))
+    print("")
+
+    return nodes, triangles
+
+def convert_obj(input_file, output_file, model_scale, model_translation,
+                leaf_size):
+
+    obj = load_obj(input_file)
+
+    triangles = build_triangles(obj, model_scale, model_translation)
+    if len(triangles) == 0:
+        raise OBJFormatError("The model has no triangles")
+
+    root = build_bvh(triangles, leaf_size)
+    nodes, triangles = flatten_bvh(root)
+
+    data = [COL_MAGIC, COL_VERSION, len(triangles), len(nodes)]
+
+    for bmin, bmax, first, count in nodes:
+        data.extend([float_to_f32(v) for v in bmin])
+        data.extend([float_to_f32(v) for v in bmax])
+        data.extend([first, count])
+
+    for tri in triangles:
+        for v in tri.v:
+            data.extend([float_to_f32(c) for c in v])
+        data.extend([float_to_f32(c) for c in tri.normal])
+
+    with open(output_file, 'wb') as f:
+        f.write(struct.pack(f"<4I{len(data) - 4}i", *data))
+
+if __name__ == "__main__":
+
+    import argparse
+    import sys
+    import traceback
+
+    print("obj2col v0.1.0")
+    print("Copyright (c) 2023 Antonio Niño Díaz <antonio_nd@outlook.com>")
+    print("All rights reserved")
+    print("")
+
+    parser = argparse.ArgumentParser(
+            description='Convert Wavefront OBJ files into collision meshes.')
+
+    # Required arguments
+    parser.add_argument("--input", required=True,
+                        help="input file")
+    parser.add_argument("--output", required=True,
+                        help="output file")
+
+    # Optional arguments
+    parser.add_argument("--translation", default=None, type=float, nargs=3,
+                        help="translate model by this value")
+    parser.add_argument("--scale", default=1.0, type=float,
+                        help="scale model by this value (after the translation)")
+    parser.add_argument("--leaf-size", default=4, type=int,
+                        help="max number of triangles in each leaf of the tree")
+
+    args = parser.parse_args()
+
+    if args.translation is None:
+        args.translation = [0, 0, 0]
+
+    if args.leaf_size < 1:
+        print("The size of the leaves must be at least 1")
+        sys.exit(1)
+
+    try:
+        convert_obj(args.input, args.output, args.scale, args.translation,
+                    args.leaf_size)
+    except BaseException as e:
+        print("ERROR: " + str(e))
+        traceback.print_exc()
+        sys.exit(1)
+    except OBJFormatError as e:
+        print("ERROR: Invalid OBJ file: " + str(e))
+        traceback.print_exc()
+        sys.exit(1)
+
+    print("Done!")
+
+    sys.exit(0)
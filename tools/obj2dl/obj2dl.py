@@ -4,6 +4,9 @@
 #
 # Copyright (c) 2022-2023 Antonio Niño Díaz <antonio_nd@outlook.com>
 
+import math
+import os
+
 from display_list import DisplayList
 
 class OBJFormatError(Exception):
@@ -14,8 +17,7 @@ VALID_TEXTURE_SIZES = [8, 16, 32, 64, 128, 256, 512, 1024]
 def is_valid_texture_size(size):
     return size in VALID_TEXTURE_SIZES
 
-def convert_obj(input_file, output_file, texture_size,
-                model_scale, model_translation, use_vertex_color):
+def load_obj(input_file, use_vertex_color):
 
     vertices = []
     texcoords = []
@@ -73,7 +75,50 @@ def convert_obj(input_file, output_file, texture_size,
     print("Faces:     " + str(len(faces)))
     print("")
 
-    dl = DisplayList()
+    return (vertices, texcoords, normals, faces)
+
+class Transform():
+    """
+    Position, rotation and scale of an instance of a model. The transformation
+    is applied in the same order as in NE_ModelDraw(): scale, rotation around
+    the Z, Y and X axes, and translation.
+    """
+
+    def __init__(self, translation=(0, 0, 0), rotation=(0, 0, 0),
+                 scale=(1, 1, 1)):
+        self.translation = translation
+        self.scale = scale
+
+        sx, cx = math.sin(math.radians(rotation[0])), math.cos(math.radians(rotation[0]))
+        sy, cy = math.sin(math.radians(rotation[1])), math.cos(math.radians(rotation[1]))
+        sz, cz = math.sin(math.radians(rotation[2])), math.cos(math.radians(rotation[2]))
+
+        rx = [[1, 0, 0], [0, cx, -sx], [0, sx, cx]]
+        ry = [[cy, 0, sy], [0, 1, 0], [-sy, 0, cy]]
+        rz = [[cz, -sz, 0], [sz, cz, 0], [0, 0, 1]]
+
+        self.rotation = mat3_mul(mat3_mul(rx, ry), rz)
+
+    def vertex(self, v):
+        v = [v[i] * self.scale[i] for i in range(3)]
+        v = mat3_apply(self.rotation, v)
+        return [v[i] + self.translation[i] for i in range(3)]
+
+    def normal(self, n):
+        return mat3_apply(self.rotation, n)
+
+def mat3_mul(a, b):
+    return [[sum(a[i][k] * b[k][j] for k in range(3)) for j in range(3)]
+            for i in range(3)]
+
+def mat3_apply(m, v):
+    return [sum(m[i][k] * v[k] for k in range(3)) for i in range(3)]
+
+def add_obj_to_display_list(dl, obj, texture_size, model_scale,
+                            model_translation, use_vertex_color,
+                            transform=None):
+
+    vertices, texcoords, normals, faces = obj
 
     for face in faces:
 
@@ -133,14 +178,17 @@ def convert_obj(input_file, output_file, texture_size,
 
             if normal_index is not None:
                 n = normals[normal_index]
+                if transform is not None:
+                    n = transform.normal(n)
                 dl.normal(n[0], n[1], n[2])
 
-            vtx = []
+            vtx = vertices[vertex_index][0:3]
+            if transform is not None:
+                vtx = transform.vertex(vtx)
+
             for i in range(3):
-                v = vertices[vertex_index][i]
-                v += model_translation[i]
-                v *= model_scale
-                vtx.append(v)
+                vtx[i] += model_translation[i]
+                vtx[i] *= model_scale
 
             if use_vertex_color:
                 rgb = [vertices[vertex_index][i] for i in range(3, 6)]
@@ -149,6 +197,74 @@ def convert_obj(input_file, output_file, texture_size,
             # Let the DisplayList class pick the best vtx command
             dl.vtx(vtx[0], vtx[1], vtx[2])
 
+def convert_obj(input_file, output_file, texture_size,
+                model_scale, model_translation, use_vertex_color):
+
+    obj = load_obj(input_file, use_vertex_color)
+
+    dl = DisplayList()
+
+    add_obj_to_display_list(dl, obj, texture_size, model_scale,
+                            model_translation, use_vertex_color)
+
+    dl.end_vtxs()
+    dl.finalize()
+    dl.save_to_file(output_file)
+
+def load_batch(batch_file):
+    """
+    Reads a list of instances of models. Each line has the path to an OBJ file
+    followed by its position, and optionally its rotation (in degrees) and its
+    scale: "path x y z [rx ry rz [sx sy sz]]". Relative paths are relative to
+    the folder of the batch file.
+    """
+    instances = []
+    base_dir = os.path.dirname(batch_file)
+
+    with open(batch_file, 'r') as f:
+        for line in f:
+            # Remove comments
+            tokens = line.split('#')[0].split()
+            if len(tokens) == 0:
+                continue
+
+            if len(tokens) not in [4, 7, 10]:
+                raise OBJFormatError(f"Invalid batch line: {line.strip()}")
+
+            path = os.path.join(base_dir, tokens[0])
+            values = [float(t) for t in tokens[1:]]
+
+            translation = values[0:3]
+            rotation = values[3:6] if len(values) >= 6 else (0, 0, 0)
+            scale = values[6:9] if len(values) >= 9 else (1, 1, 1)
+
+            instances.append((path, Transform(translation, rotation, scale)))
+
+    return instances
+
+def convert_batch(batch_file, output_file, texture_size,
+                  model_scale, model_translation, use_vertex_color):
+    """
+    Merges all the instances of a batch file into one display list. All models
+    must use the same material, as the display list can only use one.
+    """
+    instances = load_batch(batch_file)
+
+    objs = {}
+
+    dl = DisplayList()
+
+    for path, transform in instances:
+        if path not in objs:
+            print(f"Loading {path}")
+            objs[path] = load_obj(path, use_vertex_color)
+
+        add_obj_to_display_list(dl, objs[path], texture_size, model_scale,
+                                model_translation, use_vertex_color, transform)
+
+    print(f"Instances: {len(instances)}")
+    print("")
+
     dl.end_vtxs()
     dl.finalize()
     dl.save_to_file(output_file)
@@ -159,7 +275,7 @@ if __name__ == "__main__":
     import sys
     import traceback
 
-    print("obj2dl v0.1.1")
+    print("obj2dl v0.2.0")
     print("Copyright (c) 2022-2023 Antonio Niño Díaz <antonio_nd@outlook.com>")
     print("All rights reserved")
     print("")
@@ -168,7 +284,7 @@ if __name__ == "__main__":
             description='Convert Wavefront OBJ files into NDS display lists.')
 
     # Required arguments
-    parser.add_argument("--input", required=True,
+    parser.add_argument("--input", required=False,
                         help="input file")
     parser.add_argument("--output", required=True,
                         help="output file")
@@ -185,9 +301,17 @@ if __name__ == "__main__":
     parser.add_argument("--use-vertex-color", required=False,
                         action='store_true',
                         help="use vertex colors instead of normals")
+    parser.add_argument("--batch", required=False,
+                        help="merge all models listed in this file into one "
+                             "display list instead of converting --input. "
+                             "Each line is 'file.obj x y z [rx ry rz [sx sy sz]]'")
 
     args = parser.parse_args()
 
+    if (args.input is None) == (args.batch is None):
+        print("Please, provide exactly one of --input or --batch")
+        sys.exit(1)
+
     if len(args.texture) != 2:
         print("Please, provide exactly 2 values to the --texture argument")
         sys.exit(1)
@@ -204,8 +328,12 @@ if __name__ == "__main__":
         sys.exit(1)
 
     try:
-        convert_obj(args.input, args.output, args.texture,
-                    args.scale, args.translation, args.use_vertex_color)
+        if args.batch is not None:
+            convert_batch(args.batch, args.output, args.texture,
+                          args.scale, args.translation, args.use_vertex_color)
+        else:
+            convert_obj(args.input, args.output, args.texture,
+                        args.scale, args.translation, args.use_vertex_color)
     except BaseException as e:
         print("ERROR: " + str(e))
         traceback.print_exc()